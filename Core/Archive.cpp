@@ -2,8 +2,9 @@
 #include "Archive.h"
 #include "FileUtility.h"
 
-#include <mutex>
-#include <sstream>
+extern "C" {
+#include <zlib.h>
+}
 
 using namespace Utility;
 
@@ -42,9 +43,168 @@ Utility::ByteArray RelativeFile::GetFile( fs::path name )
 	return Utility::ReadFileSync( GetKeyName(name).generic_wstring() );
 }
 
+namespace {
+	const uint32_t kLocalHeaderSignature = 0x04034b50;
+	const uint32_t kCentralHeaderSignature = 0x02014b50;
+	const uint32_t kEndOfCentralSignature = 0x06054b50;
+	const size_t kLocalHeaderSize = 30;
+	const size_t kCentralHeaderSize = 46;
+	const size_t kEndOfCentralSize = 22;
+
+	template <typename T>
+	T Get( const StorageType* p )
+	{
+		T t;
+		memcpy( &t, p, sizeof( T ) );
+		return t;
+	}
+
+	//
+	// Raw inflate state reused by every extraction on the same thread
+	//
+	class Inflater
+	{
+	public:
+		Inflater() : m_bValid(false)
+		{
+			memset( &m_Stream, 0, sizeof( m_Stream ) );
+			m_bValid = inflateInit2( &m_Stream, -MAX_WBITS ) == Z_OK;
+		}
+		~Inflater()
+		{
+			if (m_bValid)
+				inflateEnd( &m_Stream );
+		}
+
+		bool Inflate( const StorageType* src, uint32_t srcSize, StorageType* dest, uint32_t destSize )
+		{
+			if (!m_bValid || inflateReset( &m_Stream ) != Z_OK)
+				return false;
+			m_Stream.next_in = reinterpret_cast<Bytef*>(const_cast<StorageType*>(src));
+			m_Stream.avail_in = srcSize;
+			m_Stream.next_out = reinterpret_cast<Bytef*>(dest);
+			m_Stream.avail_out = destSize;
+			const int result = inflate( &m_Stream, Z_FINISH );
+			return result == Z_STREAM_END && m_Stream.total_out == destSize;
+		}
+
+	private:
+		z_stream m_Stream;
+		bool m_bValid;
+	};
+}
+
+ZipArchive::ZipArchive( const std::wstring& path ) :
+	m_Path( path ), m_File( std::make_shared<MappedFile>() )
+{
+	if (!m_File->Open( path ) || !ReadCentralDirectory())
+	{
+		std::wcerr << L"ZIP: invalid or corrupt archive " << path << std::endl;
+		m_Entries.clear();
+	}
+	m_PathList.reserve( m_Entries.size() );
+	for (auto& entry : m_Entries)
+		m_PathList.push_back( entry.first );
+}
+
+bool ZipArchive::ReadCentralDirectory( void )
+{
+	const StorageType* data = m_File->Data();
+	const size_t size = m_File->Size();
+	if (size < kEndOfCentralSize)
+		return false;
+
+	// End of central directory record is followed by a comment of up to 64K
+	const size_t searchEnd = size > kEndOfCentralSize + 0xFFFF ? size - kEndOfCentralSize - 0xFFFF : 0;
+	size_t end = size - kEndOfCentralSize + 1;
+	do {
+		if (end-- == searchEnd)
+			return false;
+	} while (Get<uint32_t>( data + end ) != kEndOfCentralSignature);
+
+	const uint16_t disk = Get<uint16_t>( data + end + 4 );
+	const uint16_t centralDisk = Get<uint16_t>( data + end + 6 );
+	const uint16_t numEntriesDisk = Get<uint16_t>( data + end + 8 );
+	const uint16_t numEntries = Get<uint16_t>( data + end + 10 );
+	const uint32_t centralOffset = Get<uint32_t>( data + end + 16 );
+	if (disk != 0 || centralDisk != 0 || numEntries != numEntriesDisk)
+	{
+		std::cerr << "ZIP: multi disk zip files are not supported" << std::endl;
+		return false;
+	}
+
+	size_t offset = centralOffset;
+	for (uint16_t i = 0; i < numEntries; i++)
+	{
+		if (offset + kCentralHeaderSize > end || Get<uint32_t>( data + offset ) != kCentralHeaderSignature)
+			return false;
+
+		const StorageType* header = data + offset;
+		Entry entry;
+		entry.Method = Get<uint16_t>( header + 10 );
+		entry.CompressedSize = Get<uint32_t>( header + 20 );
+		entry.UncompressedSize = Get<uint32_t>( header + 24 );
+		entry.LocalHeaderOffset = Get<uint32_t>( header + 42 );
+		const uint16_t nameLength = Get<uint16_t>( header + 28 );
+		const uint16_t extraLength = Get<uint16_t>( header + 30 );
+		const uint16_t commentLength = Get<uint16_t>( header + 32 );
+		if (offset + kCentralHeaderSize + nameLength > end)
+			return false;
+
+		m_Entries[std::string( header + kCentralHeaderSize, nameLength )] = entry;
+		offset += kCentralHeaderSize + nameLength + extraLength + commentLength;
+	}
+	return true;
+}
+
+const ZipArchive::Entry* ZipArchive::Find( fs::path name ) const
+{
+	auto it = m_Entries.find( GetKeyName( name ).generic_string() );
+	if (it == m_Entries.end())
+		return nullptr;
+	return &it->second;
+}
+
+// Compressed bytes of the entry, nullptr when it lies outside the file
+const StorageType* ZipArchive::GetData( const Entry& entry ) const
+{
+	const StorageType* data = m_File->Data();
+	const size_t size = m_File->Size();
+	const size_t header = entry.LocalHeaderOffset;
+	if (header + kLocalHeaderSize > size || Get<uint32_t>( data + header ) != kLocalHeaderSignature)
+		return nullptr;
+	const size_t offset = header + kLocalHeaderSize
+		+ Get<uint16_t>( data + header + 26 ) + Get<uint16_t>( data + header + 28 );
+	if (offset + entry.CompressedSize > size)
+		return nullptr;
+	return data + offset;
+}
+
+bool ZipArchive::Extract( const Entry& entry, StorageType* dest ) const
+{
+	static thread_local Inflater s_Inflater;
+
+	const StorageType* src = GetData( entry );
+	if (src == nullptr)
+		return false;
+	if (entry.Method == 0)
+	{
+		if (entry.CompressedSize != entry.UncompressedSize)
+			return false;
+		memcpy( dest, src, entry.UncompressedSize );
+		return true;
+	}
+	if (entry.Method != 8)
+	{
+		std::cerr << "ZIP: unsupported compression method " << entry.Method << std::endl;
+		return false;
+	}
+	return s_Inflater.Inflate( src, entry.CompressedSize, dest, entry.UncompressedSize );
+}
+
 bool ZipArchive::IsExist( fs::path name ) const
 {
-    return m_ZipReader.IsExist( GetKeyName(name).generic_string() );
+    return Find( name ) != nullptr;
 }
 
 //
@@ -53,7 +213,9 @@ bool ZipArchive::IsExist( fs::path name ) const
 //
 fs::path ZipArchive::GetKeyName( fs::path name ) const
 {
-	// Patio contains "filename/" at front
+	// Archive contains "filename/" at front
+	if (m_PathList.empty())
+		return name;
 	fs::path root(m_PathList.front());
 	root += name;
 	return root;
@@ -61,14 +223,28 @@ fs::path ZipArchive::GetKeyName( fs::path name ) const
 
 Utility::ByteArray ZipArchive::GetFile( fs::path name )
 {
-    static std::mutex s_ZipIterMutex;
+	const Entry* entry = Find( name );
+	if (entry == nullptr)
+		return NullFile;
 
-    // Patio use file stream as shared
-    lock_guard<mutex> CS( s_ZipIterMutex );
-    auto stream = std::unique_ptr<std::istream>( m_ZipReader.Get_File( GetKeyName(name).generic_string() ) );
+	auto file = std::make_shared<FileContainer>( entry->UncompressedSize );
+	if (entry->UncompressedSize > 0 && !Extract( *entry, file->data() ))
+		return NullFile;
+	return file;
+}
+
+Utility::ByteView ZipArchive::GetView( fs::path name )
+{
+	const Entry* entry = Find( name );
+	if (entry == nullptr)
+		return ByteView();
 
-    std::ostringstream ss;
-    ss << stream->rdbuf();
-    const std::string& s = ss.str();
-    return std::make_shared<FileContainer>( s.begin(), s.end() );
-}
\ No newline at end of file
+	if (entry->Method == 0 && entry->CompressedSize == entry->UncompressedSize)
+	{
+		const StorageType* data = GetData( *entry );
+		if (data == nullptr)
+			return ByteView();
+		return ByteView( m_File, data, entry->UncompressedSize );
+	}
+	return ByteView( GetFile( name ) );
+}
@@ -30,7 +30,10 @@ namespace Utility
         virtual bool IsExist( fs::path name ) const = 0;
 		virtual fs::path GetKeyName( fs::path name ) const = 0;
 		virtual Utility::ByteArray GetFile( fs::path name ) = 0;
+		// Contents without a copy where the archive allows it
+		virtual Utility::ByteView GetView( fs::path name ) { return Utility::ByteView( GetFile( name ) ); }
 	};
+	using ArchivePtr = std::shared_ptr<Archive>;
 
 	class RelativeFile : public Archive
 	{
@@ -40,26 +43,29 @@ namespace Utility
 		{
 		}
 
-		virtual EArchiveType GetType() override { return kArchiveZip; }
+		virtual EArchiveType GetType() override { return kArchiveFile; }
         virtual bool IsExist( fs::path name ) const override;
 		virtual fs::path GetKeyName( fs::path name ) const override;
 		virtual Utility::ByteArray GetFile( fs::path name ) override;
 		fs::path m_Path;
 	};
 
+	//
+	// Zip file mapped into memory. Entries are looked up in the central directory
+	// and deflated ones are inflated straight into the returned buffer with a
+	// per thread decompressor, so several threads can extract at once.
+	// Stored entries are returned by GetView() as views into the mapping.
+	//
 	class ZipArchive : public Archive
 	{
 	public:
-		ZipArchive( const std::wstring& path ) :
-			m_Path( path ), m_ZipReader( path )
-		{
-			m_ZipReader.Get_File_List( m_PathList );
-		}
+		ZipArchive( const std::wstring& path );
 
 		virtual EArchiveType GetType() override { return kArchiveZip; }
         virtual bool IsExist( fs::path name ) const override;
 		virtual fs::path GetKeyName( fs::path name ) const override;
 		virtual Utility::ByteArray GetFile( fs::path name ) override;
+		virtual Utility::ByteView GetView( fs::path name ) override;
 
 		const std::vector<std::string>& GetFileList() const
 		{
@@ -68,6 +74,22 @@ namespace Utility
 
 		std::wstring m_Path;
 		std::vector<std::string> m_PathList;
-		Partio::ZipFileReader m_ZipReader;
+
+	private:
+		struct Entry
+		{
+			uint16_t Method; // 0: stored, 8: deflate
+			uint32_t CompressedSize;
+			uint32_t UncompressedSize;
+			uint32_t LocalHeaderOffset;
+		};
+
+		bool ReadCentralDirectory( void );
+		const Entry* Find( fs::path name ) const;
+		const StorageType* GetData( const Entry& entry ) const;
+		bool Extract( const Entry& entry, StorageType* dest ) const;
+
+		MappedFilePtr m_File;
+		std::map<std::string, Entry, Partio::NocaseLess> m_Entries;
 	};
 }
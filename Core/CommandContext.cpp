@@ -103,6 +103,31 @@ void CommandContext::WriteBuffer( GpuResource& Dest, size_t DestOffset, const vo
     CopyBufferRegion(Dest, DestOffset, TempSpace.Buffer, TempSpace.FirstConstant*16, NumBytes );
 }
 
+void CommandContext::UpdateBuffer( GpuResource& Dest, size_t DestOffset, const void* BufferData, size_t NumBytes )
+{
+    ASSERT(Dest.GetResource() != nullptr && BufferData != nullptr);
+
+    // Without driver command lists, the runtime offsets the source of a deferred update by the
+    // destination box too (remarks of ID3D11DeviceContext::UpdateSubresource)
+    static const bool s_bDriverCommandLists = []
+    {
+        D3D11_FEATURE_DATA_THREADING Threading = {};
+        g_Device->CheckFeatureSupport( D3D11_FEATURE_THREADING, &Threading, sizeof(Threading) );
+        return Threading.DriverCommandLists != FALSE;
+    }();
+    const uint8_t* Source = static_cast<const uint8_t*>(BufferData);
+    if (!s_bDriverCommandLists)
+        Source -= DestOffset;
+
+    D3D11_BOX DestBox;
+    DestBox.left = (UINT)DestOffset;
+    DestBox.right = (UINT)(DestOffset + NumBytes);
+    DestBox.top = 0;
+    DestBox.bottom = 1;
+    DestBox.front = 0;
+    DestBox.back = 1;
+    m_CommandList->UpdateSubresource( Dest.GetResource(), 0, &DestBox, Source, 0, 0 );
+}
 
 void CommandContext::FillBuffer( GpuResource& Dest, size_t DestOffset, DWParam Value, size_t NumBytes )
 {
@@ -111,6 +111,8 @@ public:
 
     void WriteBuffer( GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes );
     void FillBuffer( GpuResource& Dest, size_t DestOffset, DWParam Value, size_t NumBytes );
+    // Copies NumBytes from unaligned memory into a default usage buffer, leaving the rest as it is
+    void UpdateBuffer( GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes );
 
     void TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
     void BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
@@ -1,8 +1,182 @@
 #include "pch.h"
 #include "Encoding.h"
 
-namespace Utility 
+#include <emmintrin.h>
+#include <boost/locale/encoding.hpp>
+
+namespace Utility
 {
+	namespace {
+		static_assert(sizeof(wchar_t) == sizeof(uint16_t), "UTF-16 wchar_t is expected");
+
+		#include "EncodingTable.inl"
+
+		const wchar_t kReplacement = 0xFFFD;
+
+		//
+		// Widens leading 7 bit bytes 16 at a time. Returns number of bytes consumed,
+		// which stops at the first block containing a non ASCII byte
+		//
+		size_t WidenAscii( const char* src, size_t srcSize, wchar_t* dest, size_t destSize )
+		{
+			const size_t count = srcSize < destSize ? srcSize : destSize;
+			const __m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + i) );
+				if (_mm_movemask_epi8( bytes ) != 0)
+					break;
+				_mm_storeu_si128( reinterpret_cast<__m128i*>(dest + i), _mm_unpacklo_epi8( bytes, zero ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i*>(dest + i + 8), _mm_unpackhi_epi8( bytes, zero ) );
+			}
+			return i;
+		}
+
+		inline int SjisLeadIndex( uint8_t c )
+		{
+			if (c >= 0x81 && c <= 0x9F)
+				return c - 0x81;
+			if (c >= 0xE0 && c <= 0xFC)
+				return c - 0xE0 + (0xA0 - 0x81);
+			return -1;
+		}
+
+		// Single byte codes other than ASCII, as mapped by CP932
+		inline wchar_t SjisSingleByte( uint8_t c )
+		{
+			if (c >= 0xA1 && c <= 0xDF)
+				return static_cast<wchar_t>(0xFF61 + (c - 0xA1)); // half width katakana
+			if (c == 0x80)
+				return 0x0080;
+			if (c == 0xA0)
+				return 0xF8F0;
+			if (c >= 0xFD)
+				return static_cast<wchar_t>(0xF8F1 + (c - 0xFD));
+			return kReplacement;
+		}
+	}
+
+	size_t SjisToUtf16( const char* src, size_t srcSize, wchar_t* dest, size_t destSize )
+	{
+		const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+		size_t i = 0, n = 0;
+		while (i < srcSize && n < destSize)
+		{
+			const uint8_t c = s[i];
+			if (c < 0x80)
+			{
+				const size_t ascii = WidenAscii( src + i, srcSize - i, dest + n, destSize - n );
+				if (ascii > 0)
+				{
+					i += ascii;
+					n += ascii;
+					continue;
+				}
+				dest[n++] = c;
+				i++;
+				continue;
+			}
+
+			const int lead = SjisLeadIndex( c );
+			if (lead < 0)
+			{
+				dest[n++] = SjisSingleByte( c );
+				i++;
+				continue;
+			}
+
+			// Invalid trail byte is left to be decoded on its own
+			const uint8_t trail = i + 1 < srcSize ? s[i + 1] : 0;
+			const wchar_t code = (trail >= 0x40 && trail <= 0xFC) ? s_SjisDoubleByte[lead][trail - 0x40] : 0;
+			if (code == 0)
+			{
+				dest[n++] = kReplacement;
+				i++;
+				continue;
+			}
+			dest[n++] = code;
+			i += 2;
+		}
+		return n;
+	}
+
+	size_t Utf8ToUtf16( const char* src, size_t srcSize, wchar_t* dest, size_t destSize )
+	{
+		const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+		size_t i = 0, n = 0;
+		while (i < srcSize && n < destSize)
+		{
+			const uint8_t c = s[i];
+			if (c < 0x80)
+			{
+				const size_t ascii = WidenAscii( src + i, srcSize - i, dest + n, destSize - n );
+				if (ascii > 0)
+				{
+					i += ascii;
+					n += ascii;
+					continue;
+				}
+				dest[n++] = c;
+				i++;
+				continue;
+			}
+
+			size_t length = 0;
+			uint32_t code = 0, minCode = 0;
+			// C0, C1 and F5-FF never start a valid sequence
+			if (c >= 0xC2 && c <= 0xDF)
+				length = 2, code = c & 0x1F, minCode = 0x80;
+			else if (c >= 0xE0 && c <= 0xEF)
+				length = 3, code = c & 0x0F, minCode = 0x800;
+			else if (c >= 0xF0 && c <= 0xF4)
+				length = 4, code = c & 0x07, minCode = 0x10000;
+
+			size_t k = 1;
+			for (; k < length && i + k < srcSize && (s[i + k] & 0xC0) == 0x80; k++)
+				code = (code << 6) | (s[i + k] & 0x3F);
+
+			// Truncated, overlong, surrogate or out of range sequence
+			if (length == 0 || k < length || code < minCode || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+			{
+				dest[n++] = kReplacement;
+				i += k;
+				continue;
+			}
+
+			if (code >= 0x10000)
+			{
+				if (n + 2 > destSize)
+					break;
+				code -= 0x10000;
+				dest[n++] = static_cast<wchar_t>(0xD800 + (code >> 10));
+				dest[n++] = static_cast<wchar_t>(0xDC00 + (code & 0x3FF));
+			}
+			else
+			{
+				dest[n++] = static_cast<wchar_t>(code);
+			}
+			i += length;
+		}
+		return n;
+	}
+
+	std::wstring SjisToUtf16( const char* src, size_t srcSize )
+	{
+		std::wstring text( srcSize, L'\0' );
+		if (srcSize > 0)
+			text.resize( SjisToUtf16( src, srcSize, &text[0], srcSize ) );
+		return text;
+	}
+
+	std::wstring Utf8ToUtf16( const char* src, size_t srcSize )
+	{
+		std::wstring text( srcSize, L'\0' );
+		if (srcSize > 0)
+			text.resize( Utf8ToUtf16( src, srcSize, &text[0], srcSize ) );
+		return text;
+	}
+
 	std::wstring to_utf( const std::string& t, std::string enc )
 	{
 		using boost::locale::conv::to_utf;
@@ -1,24 +1,36 @@
 #pragma once
 
-#include <boost/locale.hpp>
-#include <boost/locale/encoding.hpp>
+#include <string>
+#include <cstring>
 
-namespace Utility 
+namespace Utility
 {
-	template <typename T>
-	std::wstring to_utf( const T& t, std::string enc )
-	{
-		using boost::locale::conv::to_utf;
-		return to_utf<wchar_t>(
-			std::string( (char*)(t) ), enc );
-	}
+	//
+	// Table driven decoders into caller provided UTF-16 buffers. They do not allocate,
+	// stop when 'destSize' is reached and return the number of wchar_t written.
+	// Neither produces more code units than source bytes, so a destination
+	// of 'srcSize' elements always holds the whole text.
+	// Ill-formed input is replaced with U+FFFD.
+	//
+	size_t SjisToUtf16( const char* src, size_t srcSize, wchar_t* dest, size_t destSize );
+	size_t Utf8ToUtf16( const char* src, size_t srcSize, wchar_t* dest, size_t destSize );
+
+	std::wstring SjisToUtf16( const char* src, size_t srcSize );
+	std::wstring Utf8ToUtf16( const char* src, size_t srcSize );
 
+	// Conversion through boost::locale for encodings without own decoder
 	std::wstring to_utf( const std::string& t, std::string enc );
 
-	template <typename T>
-	std::wstring sjis_to_utf( const T& t )
+	// Fixed size name field, text ends at the first NUL or at the end of the field
+	template <size_t N>
+	std::wstring sjis_to_utf( const char (&t)[N] )
+	{
+		return SjisToUtf16( t, strnlen( t, N ) );
+	}
+
+	inline std::wstring sjis_to_utf( const std::string& t )
 	{
-		return to_utf( t, "shift-jis" );
+		return SjisToUtf16( t.data(), t.size() );
 	}
 
 	template <typename T>
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "FileUtility.h"
 #include <fstream>
+#include <iterator>
 #include <boost/filesystem.hpp>
 
 using namespace std;
@@ -25,6 +26,96 @@ namespace Utility
 		return buf;
 	}
 
+	MappedFile::MappedFile() :
+		m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr), m_Data(nullptr), m_Size(0)
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open( const wstring& fileName )
+	{
+		Close();
+
+		m_File = CreateFileW( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+		if (m_File == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx( m_File, &size ) || size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_Mapping = CreateFileMappingW( m_File, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if (m_Mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = static_cast<const StorageType*>(MapViewOfFile( m_Mapping, FILE_MAP_READ, 0, 0, 0 ));
+		if (m_Data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data != nullptr)
+			UnmapViewOfFile( m_Data );
+		if (m_Mapping != nullptr)
+			CloseHandle( m_Mapping );
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle( m_File );
+		m_File = INVALID_HANDLE_VALUE;
+		m_Mapping = nullptr;
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
+	ByteReader MakeReader( bufferstream& is, FileContainer& storage )
+	{
+		auto buf = dynamic_cast<ByteArrayWrapBuf*>(is.rdbuf());
+		if (buf != nullptr)
+			return ByteReader( buf->Current(), buf->Remaining() );
+
+		storage.assign( istreambuf_iterator<StorageType>( is ), istreambuf_iterator<StorageType>() );
+		return ByteReader( storage );
+	}
+
+	void Consume( bufferstream& is, const ByteReader& reader )
+	{
+		auto buf = dynamic_cast<ByteArrayWrapBuf*>(is.rdbuf());
+		if (buf != nullptr)
+			buf->Advance( reader.Tell() );
+		if (reader.IsFail())
+			is.setstate( ios::failbit );
+	}
+
+	uint32_t ReadUint( ByteReader& is )
+	{
+		uint32_t t;
+		Read( is, t );
+		return t;
+	}
+
+	uint16_t ReadShort( ByteReader& is )
+	{
+		uint16_t t;
+		Read( is, t );
+		return t;
+	}
+
 	uint32_t ReadUint( bufferstream& is )
 	{
 		uint32_t t;
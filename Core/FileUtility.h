@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstring>
 #include <DirectXMath.h>
 
 namespace Utility
@@ -22,6 +23,10 @@ namespace Utility
 		{
 			setg( m_Vec->data(), m_Vec->data(), m_Vec->data() + m_Vec->size() );
 		}
+		// Unread part of the buffer
+		const CharT* Current() const { return this->gptr(); }
+		size_t Remaining() const { return size_t(this->egptr() - this->gptr()); }
+		void Advance( size_t count ) { setg( this->eback(), this->gptr() + count, this->egptr() ); }
 		ByteArray m_Vec;
 	};
 
@@ -41,6 +46,145 @@ namespace Utility
 	// Reads the entire contents of a binary file.  
 	ByteArray ReadFileSync(const wstring& fileName);
 
+	// Read-only view of a whole file mapped into the address space
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open( const wstring& fileName );
+		void Close();
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		const StorageType* Data() const { return m_Data; }
+		size_t Size() const { return m_Size; }
+
+	private:
+		MappedFile( const MappedFile& ) = delete;
+		MappedFile& operator=( const MappedFile& ) = delete;
+
+		void* m_File;
+		void* m_Mapping;
+		const StorageType* m_Data;
+		size_t m_Size;
+	};
+	using MappedFilePtr = shared_ptr<MappedFile>;
+
+	//
+	// Read-only byte range. Holds a reference to whatever owns the bytes
+	// (ByteArray, MappedFile), so a view into a mapped archive stays valid
+	// after the archive itself is released.
+	//
+	class ByteView
+	{
+	public:
+		ByteView() : m_Data(nullptr), m_Size(0) {}
+		ByteView( shared_ptr<const void> owner, const StorageType* data, size_t size ) :
+			m_Owner(std::move(owner)), m_Data(data), m_Size(size) {}
+		explicit ByteView( const ByteArray& ba ) :
+			m_Owner(ba), m_Data(ba ? ba->data() : nullptr), m_Size(ba ? ba->size() : 0) {}
+
+		const StorageType* Data() const { return m_Data; }
+		size_t Size() const { return m_Size; }
+		bool Empty() const { return m_Size == 0; }
+
+	private:
+		shared_ptr<const void> m_Owner;
+		const StorageType* m_Data;
+		size_t m_Size;
+	};
+
+	//
+	// Cursor over a contiguous byte range (in-memory buffer or mapped file).
+	// Nothing is copied until a value is read. Reading past the end zero fills
+	// the destination and latches the fail state, so parsers check IsFail() once
+	// at the end instead of after every field.
+	//
+	class ByteReader
+	{
+	public:
+		ByteReader() : m_Begin(nullptr), m_Cur(nullptr), m_End(nullptr), m_bFail(false) {}
+		ByteReader( const void* data, size_t size ) :
+			m_Begin(static_cast<const StorageType*>(data)), m_Cur(m_Begin), m_End(m_Begin + size), m_bFail(false) {}
+		explicit ByteReader( const FileContainer& container ) :
+			ByteReader( container.data(), container.size() ) {}
+		explicit ByteReader( const MappedFile& file ) :
+			ByteReader( file.Data(), file.Size() ) {}
+
+		bool Read( void* dest, size_t size )
+		{
+			if (size > Remaining())
+			{
+				memset( dest, 0, size );
+				SetFail();
+				return false;
+			}
+			memcpy( dest, m_Cur, size );
+			m_Cur += size;
+			return true;
+		}
+
+		// Returns pointer to the next 'size' bytes and moves past them (nullptr when out of range)
+		const StorageType* Skip( size_t size )
+		{
+			if (size > Remaining())
+			{
+				SetFail();
+				return nullptr;
+			}
+			const StorageType* data = m_Cur;
+			m_Cur += size;
+			return data;
+		}
+
+		// Reads element count and rejects counts that can not fit in the remaining bytes
+		uint32_t ReadCount( size_t minElementSize )
+		{
+			uint32_t count = 0;
+			Read( &count, sizeof(count) );
+			if (minElementSize > 0 && count > Remaining() / minElementSize)
+			{
+				SetFail();
+				return 0;
+			}
+			return count;
+		}
+
+		bool Seek( size_t offset )
+		{
+			if (offset > Size())
+			{
+				SetFail();
+				return false;
+			}
+			m_Cur = m_Begin + offset;
+			return true;
+		}
+
+		void SetFail() { m_bFail = true; m_Cur = m_End; }
+		bool IsFail() const { return m_bFail; }
+		bool IsEnd() const { return m_Cur >= m_End; }
+
+		const StorageType* Data() const { return m_Begin; }
+		const StorageType* Current() const { return m_Cur; }
+		size_t Tell() const { return size_t(m_Cur - m_Begin); }
+		size_t Size() const { return size_t(m_End - m_Begin); }
+		size_t Remaining() const { return size_t(m_End - m_Cur); }
+
+	private:
+		const StorageType* m_Begin;
+		const StorageType* m_Cur;
+		const StorageType* m_End;
+		bool m_bFail;
+	};
+
+	// Reader over the unread part of 'is'. Zero-copy when 'is' is a ByteStream,
+	// otherwise the rest of the stream is copied into 'storage'
+	ByteReader MakeReader( bufferstream& is, FileContainer& storage );
+	// Move 'is' past the bytes consumed through 'reader'
+	void Consume( bufferstream& is, const ByteReader& reader );
+
 	template <typename T, typename R>
 	void Read( basic_istream<T, char_traits<T>>& is, R& t, uint32_t size)
 	{
@@ -96,6 +240,57 @@ namespace Utility
 	uint32_t ReadUint( bufferstream& is );
 	uint16_t ReadShort( bufferstream & is );
 
+	template <typename R>
+	void Read( ByteReader& is, R& t, uint32_t size )
+	{
+		ASSERT( size <= sizeof( R ), "buffer overflow" );
+		if (size > sizeof( R ))
+			return is.SetFail();
+		is.Read( &t, size );
+	}
+
+	template <typename R>
+	void Read( ByteReader& is, R& t )
+	{
+		is.Read( &t, sizeof( R ) );
+	}
+
+	template <typename R>
+	void Read( ByteReader& is, std::vector<R>& t )
+	{
+		is.Read( t.data(), t.size() * sizeof( R ) );
+	}
+
+	inline void ReadPosition( ByteReader& is, DirectX::XMFLOAT3& t, bool bRH )
+	{
+		Read( is, t );
+		if (bRH) t.z *= -1.0;
+	}
+
+	inline void ReadNormal( ByteReader& is, DirectX::XMFLOAT3& t, bool bRH )
+	{
+		Read( is, t );
+		if (bRH) t.z *= -1.0;
+	}
+
+	inline void ReadRotation( ByteReader& is, DirectX::XMFLOAT3& t, bool bRH )
+	{
+		Read( is, t );
+		if (bRH) t.x *= -1.0;
+		if (bRH) t.y *= -1.0;
+	}
+
+	// Quaternion
+	inline void ReadRotation( ByteReader& is, DirectX::XMFLOAT4& t, bool bRH )
+	{
+		Read( is, t );
+		if (bRH) t.x *= -1.0;
+		if (bRH) t.y *= -1.0;
+	}
+
+	uint32_t ReadUint( ByteReader& is );
+	uint16_t ReadShort( ByteReader& is );
+
 	template <typename T>
 	T Read( bufferstream& is )
 	{
@@ -104,6 +299,14 @@ namespace Utility
 		return t;
 	}
 
+	template <typename T>
+	T Read( ByteReader& is )
+	{
+		T t;
+		Read( is, t );
+		return t;
+	}
+
 	template <typename T, typename R>
 	void Write( basic_ostream<T, char_traits<T>>& is, const R& t )
 	{
@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <cstring>
 #include "Math/Common.h"
 
 // This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
@@ -25,6 +26,7 @@
 #endif
 
 #if ENABLE_SSE_CRC32
+#pragma intrinsic(_mm_crc32_u8)
 #pragma intrinsic(_mm_crc32_u32)
 #pragma intrinsic(_mm_crc32_u64)
 #endif
@@ -57,6 +59,72 @@ namespace Utility
 		return Hash;
 	}
 
+	// Byte range of any length or alignment (file contents, encoded names)
+	inline size_t HashBytes(const void* const Data, size_t Size, size_t Hash = 2166136261U)
+	{
+		const uint8_t* Iter = (const uint8_t*)Data;
+		const uint8_t* const End = Iter + Size;
+#if ENABLE_SSE_CRC32
+		for (; Iter + 8 <= End; Iter += 8)
+			Hash = _mm_crc32_u64((uint64_t)Hash, *(const uint64_t*)Iter);
+		for (; Iter < End; ++Iter)
+			Hash = _mm_crc32_u8((uint32_t)Hash, *Iter);
+#else
+		for (; Iter < End; ++Iter)
+			Hash = 16777619U * Hash ^ *Iter;
+#endif
+		return Hash;
+	}
+
+	// xxHash64, for content keys where HashBytes (32-bit CRC) would collide
+	inline uint64_t HashBytes64(const void* const Data, size_t Size, uint64_t Seed = 0)
+	{
+		const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL, P3 = 1609587929392839161ULL;
+		const uint64_t P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+		auto Rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+		auto Read64 = [](const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+		auto Read32 = [](const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; };
+		auto Round = [&](uint64_t Acc, uint64_t Input) { return Rotl(Acc + Input * P2, 31) * P1; };
+		auto Merge = [&](uint64_t Acc, uint64_t Val) { return (Acc ^ Round(0, Val)) * P1 + P4; };
+
+		const uint8_t* Iter = (const uint8_t*)Data;
+		const uint8_t* const End = Iter + Size;
+		uint64_t Hash;
+		if (Size >= 32)
+		{
+			uint64_t V1 = Seed + P1 + P2, V2 = Seed + P2, V3 = Seed, V4 = Seed - P1;
+			for (; Iter + 32 <= End; Iter += 32)
+			{
+				V1 = Round(V1, Read64(Iter));
+				V2 = Round(V2, Read64(Iter + 8));
+				V3 = Round(V3, Read64(Iter + 16));
+				V4 = Round(V4, Read64(Iter + 24));
+			}
+			Hash = Rotl(V1, 1) + Rotl(V2, 7) + Rotl(V3, 12) + Rotl(V4, 18);
+			Hash = Merge(Merge(Merge(Merge(Hash, V1), V2), V3), V4);
+		}
+		else
+			Hash = Seed + P5;
+		Hash += Size;
+
+		for (; Iter + 8 <= End; Iter += 8)
+			Hash = Rotl(Hash ^ Round(0, Read64(Iter)), 27) * P1 + P4;
+		if (Iter + 4 <= End)
+		{
+			Hash = Rotl(Hash ^ (Read32(Iter) * P1), 23) * P2 + P3;
+			Iter += 4;
+		}
+		for (; Iter < End; ++Iter)
+			Hash = Rotl(Hash ^ (*Iter * P5), 11) * P1;
+
+		Hash ^= Hash >> 33;
+		Hash *= P2;
+		Hash ^= Hash >> 29;
+		Hash *= P3;
+		Hash ^= Hash >> 32;
+		return Hash;
+	}
+
 	template <typename T> inline size_t HashState( const T* StateDesc, size_t Count = 1, size_t Hash = 2166136261U )
 	{
 		static_assert((sizeof(T) & 3) == 0 && alignof(T) >= 4, "State object is not word-aligned");
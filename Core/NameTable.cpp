@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "NameTable.h"
+#include "Hash.h"
+
+#include <algorithm>
+
+using namespace Utility;
+
+void NameTable::Clear( void )
+{
+	m_Bytes.clear();
+	m_Entries.clear();
+	m_Slots.clear();
+}
+
+void NameTable::Reserve( size_t count )
+{
+	m_Entries.reserve( count );
+	size_t numSlots = 16;
+	while (numSlots < count * 2)
+		numSlots *= 2;
+	if (numSlots > m_Slots.size())
+		Rehash( numSlots );
+}
+
+// Slot holding the name, or the empty slot where it would be placed
+size_t NameTable::Probe( const void* data, size_t size, size_t hash ) const
+{
+	const size_t mask = m_Slots.size() - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		const uint32_t id = m_Slots[i];
+		if (id == kInvalid)
+			return i;
+		const Entry& entry = m_Entries[id];
+		if (entry.Hash == hash && entry.Length == size && memcmp( m_Bytes.data() + entry.Offset, data, size ) == 0)
+			return i;
+	}
+}
+
+void NameTable::Rehash( size_t numSlots )
+{
+	m_Slots.assign( numSlots, kInvalid );
+	const size_t mask = numSlots - 1;
+	for (uint32_t id = 0; id < m_Entries.size(); id++)
+	{
+		size_t i = m_Entries[id].Hash & mask;
+		while (m_Slots[i] != kInvalid)
+			i = (i + 1) & mask;
+		m_Slots[i] = id;
+	}
+}
+
+uint32_t NameTable::Intern( const void* data, size_t size )
+{
+	// Keep load factor under 1/2
+	if ((m_Entries.size() + 1) * 2 > m_Slots.size())
+		Rehash( std::max<size_t>( 16, m_Slots.size() * 2 ) );
+
+	const size_t hash = HashBytes( data, size );
+	const size_t slot = Probe( data, size, hash );
+	if (m_Slots[slot] != kInvalid)
+		return m_Slots[slot];
+
+	const uint32_t id = static_cast<uint32_t>(m_Entries.size());
+	const Entry entry = { static_cast<uint32_t>(m_Bytes.size()), static_cast<uint32_t>(size), hash };
+	const char* bytes = static_cast<const char*>(data);
+	m_Bytes.insert( m_Bytes.end(), bytes, bytes + size );
+	m_Entries.push_back( entry );
+	m_Slots[slot] = id;
+	return id;
+}
+
+uint32_t NameTable::Find( const void* data, size_t size ) const
+{
+	if (m_Slots.empty())
+		return kInvalid;
+	return m_Slots[Probe( data, size, HashBytes( data, size ) )];
+}
+
+const char* NameTable::GetBytes( uint32_t id, size_t& size ) const
+{
+	ASSERT( id < m_Entries.size() );
+	const Entry& entry = m_Entries[id];
+	size = entry.Length;
+	return m_Bytes.data() + entry.Offset;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+namespace Utility
+{
+	//
+	// Interned names keyed on their raw encoded bytes (Shift-JIS, UTF-16, ...).
+	// Each distinct name gets a dense id in insertion order that stays valid
+	// until Clear(). Lookup is a linear probe over a flat slot array and
+	// does not convert or allocate.
+	//
+	class NameTable
+	{
+	public:
+		enum : uint32_t { kInvalid = 0xFFFFFFFF };
+
+		void Clear( void );
+		void Reserve( size_t count );
+
+		// Returns id of the name, adding it when not present
+		uint32_t Intern( const void* data, size_t size );
+		// Returns id of the name or kInvalid
+		uint32_t Find( const void* data, size_t size ) const;
+
+		uint32_t Intern( const std::wstring& name ) { return Intern( name.data(), name.size() * sizeof(wchar_t) ); }
+		uint32_t Find( const std::wstring& name ) const { return Find( name.data(), name.size() * sizeof(wchar_t) ); }
+
+		uint32_t Size( void ) const { return static_cast<uint32_t>(m_Entries.size()); }
+		const char* GetBytes( uint32_t id, size_t& size ) const;
+
+	private:
+		struct Entry
+		{
+			uint32_t Offset; // in m_Bytes
+			uint32_t Length;
+			size_t Hash;
+		};
+
+		size_t Probe( const void* data, size_t size, size_t hash ) const;
+		void Rehash( size_t numSlots );
+
+		std::vector<char> m_Bytes;
+		std::vector<Entry> m_Entries;
+		std::vector<uint32_t> m_Slots; // entry id, kInvalid when empty
+	};
+}
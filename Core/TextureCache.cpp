@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "TextureCache.h"
+#include "EngineTuning.h"
+#include "Hash.h"
+#include "DirectXTex.h"
+
+#include <boost/filesystem.hpp>
+#include <sstream>
+#include <thread>
+
+namespace TextureCache
+{
+    namespace fs = boost::filesystem;
+    using namespace DirectX;
+
+    BoolVar s_bEnable( "Graphics/Texture/Decode Cache", true );
+    BoolVar s_bCompress( "Graphics/Texture/Block Compress", true );
+
+    // Bump when the baked content changes
+    const uint32_t kCacheVersion = 2;
+    // Small images (toon ramps, gradients) band visibly when block compressed
+    const size_t kMinCompressSize = 64;
+
+    fs::path s_CacheRoot;
+
+    void Initialize( const std::wstring& CacheRoot )
+    {
+        s_CacheRoot = CacheRoot;
+        boost::system::error_code ec;
+        if (!s_CacheRoot.empty())
+            fs::create_directories( s_CacheRoot, ec );
+        if (ec)
+            s_CacheRoot.clear();
+    }
+
+    std::wstring GetCachePath( const void* Data, size_t Size, uint32_t Flags )
+    {
+        if (!s_bEnable || s_CacheRoot.empty())
+            return std::wstring();
+
+        // Content only keys the file, so the hash is wide enough not to collide
+        const uint64_t Hash = Utility::HashBytes64( Data, Size, (uint64_t(kCacheVersion) << 32) | Flags );
+        const uint32_t Options = s_bCompress ? 1 : 0;
+        wchar_t Name[64];
+        swprintf_s( Name, L"%016llX_%08X_%08X_%X.dds", (unsigned long long)Hash, (uint32_t)Size, Flags, Options );
+        return (s_CacheRoot / Name).generic_wstring();
+    }
+
+    bool Load( const std::wstring& CachePath, ScratchImage& Image )
+    {
+        if (CachePath.empty() || !fs::exists( CachePath ))
+            return false;
+        return SUCCEEDED( LoadFromDDSFile( CachePath.c_str(), DDS_FLAGS_NONE, nullptr, Image ) );
+    }
+
+    bool Store( const std::wstring& CachePath, const ScratchImage& Image )
+    {
+        if (CachePath.empty())
+            return false;
+
+        // Write aside and move in place, so a concurrent load never sees a partial file
+        std::wstringstream ss;
+        ss << CachePath << L"." << std::hash<std::thread::id>()( std::this_thread::get_id() ) << L".tmp";
+        const std::wstring TempPath = ss.str();
+
+        HRESULT hr = SaveToDDSFile( Image.GetImages(), Image.GetImageCount(), Image.GetMetadata(), DDS_FLAGS_NONE, TempPath.c_str() );
+        boost::system::error_code ec;
+        if (SUCCEEDED(hr))
+            fs::rename( TempPath, CachePath, ec );
+        if (FAILED(hr) || ec)
+        {
+            fs::remove( TempPath, ec );
+            return false;
+        }
+        return true;
+    }
+
+    bool Bake( ScratchImage& Image )
+    {
+        const TexMetadata& Info = Image.GetMetadata();
+        if (Info.mipLevels == 1 && (Info.width > 1 || Info.height > 1))
+        {
+            ScratchImage MipChain;
+            HRESULT hr = GenerateMipMaps( Image.GetImages(), Image.GetImageCount(), Info, TEX_FILTER_DEFAULT, 0, MipChain );
+            if (FAILED(hr))
+                return false;
+            Image = std::move( MipChain );
+        }
+
+        const TexMetadata& Baked = Image.GetMetadata();
+        const DXGI_FORMAT Format = MakeTypeless( Baked.format );
+        const bool bColor8 = Format == DXGI_FORMAT_R8G8B8A8_TYPELESS || Format == DXGI_FORMAT_B8G8R8A8_TYPELESS;
+        // BC base level has to be made of whole 4x4 blocks
+        const bool bBlock = Baked.width % 4 == 0 && Baked.height % 4 == 0
+            && Baked.width >= kMinCompressSize && Baked.height >= kMinCompressSize;
+        if (!s_bCompress || !bColor8 || !bBlock)
+            return true;
+
+        const bool bSRGB = IsSRGB( Baked.format );
+        DXGI_FORMAT Target = Image.IsAlphaAllOpaque() ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC3_UNORM;
+        if (bSRGB)
+            Target = MakeSRGB( Target );
+
+        ScratchImage Compressed;
+        HRESULT hr = Compress( Image.GetImages(), Image.GetImageCount(), Baked, Target,
+            bSRGB ? TEX_COMPRESS_SRGB : TEX_COMPRESS_DEFAULT, TEX_THRESHOLD_DEFAULT, Compressed );
+        // Uncompressed mip chain is still usable
+        if (SUCCEEDED(hr))
+            Image = std::move( Compressed );
+        return true;
+    }
+}
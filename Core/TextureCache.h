@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace DirectX {
+    class ScratchImage;
+}
+
+//
+// Content addressed cache of decoded textures
+//
+// Entry is a DDS file named after the hash and size of the source bytes (png, tga,
+// bmp ... as stored in the model folder or archive) and the decode flags. It holds
+// the full mip chain, block compressed where the format allows, so a warm load
+// skips image decode, mip generation and compression. Identical files shared by
+// several models (toon, sphere maps) resolve to the same entry.
+//
+namespace TextureCache
+{
+    void Initialize( const std::wstring& CacheRoot );
+
+    // Entry path for the source, empty when the cache is disabled
+    std::wstring GetCachePath( const void* Data, size_t Size, uint32_t Flags );
+
+    bool Load( const std::wstring& CachePath, DirectX::ScratchImage& Image );
+    bool Store( const std::wstring& CachePath, const DirectX::ScratchImage& Image );
+
+    // Generates the mip chain and block compresses 8 bit color images, in place
+    bool Bake( DirectX::ScratchImage& Image );
+}
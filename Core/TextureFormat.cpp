@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "TextureFormat.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+namespace Utility
+{
+    namespace {
+        bool StartsWith( const uint8_t* data, size_t size, const char* magic, size_t length )
+        {
+            return size >= length && memcmp( data, magic, length ) == 0;
+        }
+
+        bool IsTGAHeader( const uint8_t* data, size_t size )
+        {
+            const size_t kHeaderSize = 18;
+            if (size < kHeaderSize)
+                return false;
+            const uint8_t colorMapType = data[1];
+            const uint8_t imageType = data[2];
+            const uint16_t width = uint16_t(data[12] | (data[13] << 8));
+            const uint16_t height = uint16_t(data[14] | (data[15] << 8));
+            const uint8_t depth = data[16];
+            const bool bType = (imageType >= 1 && imageType <= 3) || (imageType >= 9 && imageType <= 11);
+            const bool bDepth = depth == 8 || depth == 15 || depth == 16 || depth == 24 || depth == 32;
+            return colorMapType <= 1 && bType && bDepth && width > 0 && height > 0;
+        }
+    }
+
+    ETextureFormat DetectTextureFormat( const void* data, size_t size, const std::wstring& name )
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        if (StartsWith( bytes, size, "DDS ", 4 ))
+            return kTextureDDS;
+        if (StartsWith( bytes, size, "\x89PNG", 4 )
+            || StartsWith( bytes, size, "\xFF\xD8\xFF", 3 )
+            || StartsWith( bytes, size, "BM", 2 )
+            || StartsWith( bytes, size, "GIF8", 4 )
+            || StartsWith( bytes, size, "II*\0", 4 )
+            || StartsWith( bytes, size, "MM\0*", 4 ))
+            return kTextureWIC;
+        if (StartsWith( bytes, size, "#?", 2 ))
+            return kTextureHDR;
+
+        const std::wstring ext = boost::to_lower_copy( boost::filesystem::path( name ).extension().generic_wstring() );
+        if (ext == L".tga" || IsTGAHeader( bytes, size ))
+            return kTextureTGA;
+        return kTextureUnknown;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace Utility
+{
+    enum ETextureFormat
+    {
+        kTextureUnknown = 0,
+        kTextureDDS,
+        kTextureWIC, // png, jpg, bmp, gif, tiff
+        kTextureTGA,
+        kTextureHDR
+    };
+
+    //
+    // Picks the decoder from the leading bytes. TGA has no signature, so it is taken
+    // from the file extension in 'name' or from a plausible header
+    //
+    ETextureFormat DetectTextureFormat( const void* data, size_t size, const std::wstring& name = std::wstring() );
+}
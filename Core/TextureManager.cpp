@@ -16,10 +16,13 @@
 #include "TextureManager.h"
 #include "GraphicsCore.h"
 #include "FileUtility.h"
+#include "Archive.h"
 #include "CommandContext.h"
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "DirectXTex.h"
+#include "TextureCache.h"
+#include "TextureFormat.h"
 #include "LinearColor.h"
 
 #include <boost/algorithm/string.hpp>
@@ -79,53 +82,78 @@ void Texture::Create( size_t Width, size_t Height, DXGI_FORMAT Format, const voi
 	g_Device->CreateShaderResourceView( m_pResource.Get(), &SRVDesc, m_SRV.ReleaseAndGetAddressOf() );
 }
 
-bool Texture::CreateWICFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB )
+namespace
 {
-    // to support MMD texture
-    UINT sRGBFlag = Gamma::bSRGB ? DirectX::WIC_LOADER_DEFAULT : DirectX::WIC_LOADER_IGNORE_SRGB;
-	UINT loadFlag = sRGB ? DirectX::WIC_LOADER_FORCE_SRGB : sRGBFlag;
-    GraphicsContext& gfxContext = GraphicsContext::Begin();
-    // Load texture and generate mips at the same time
-	HRESULT hr = DirectX::CreateWICTextureFromMemoryEx(
-        Graphics::g_Device,
-        gfxContext.m_CommandList,
-		(uint8_t*)(memBuffer), bufferSize, 0, D3D11_USAGE_DEFAULT,
-		D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET,
-		0, D3D11_RESOURCE_MISC_GENERATE_MIPS, loadFlag,
-		m_pResource.GetAddressOf(), m_SRV.GetAddressOf());
-    gfxContext.Finish();
+    using namespace DirectX;
+    using Decoder = HRESULT (*)( const void*, size_t, DWORD, ScratchImage& );
+
+    HRESULT DecodeWIC( const void* memBuffer, size_t bufferSize, DWORD flags, ScratchImage& image )
+    {
+        return LoadFromWICMemory( memBuffer, bufferSize, flags, nullptr, image );
+    }
 
-	return SUCCEEDED( hr );
+    HRESULT DecodeTGA( const void* memBuffer, size_t bufferSize, DWORD, ScratchImage& image )
+    {
+        return LoadFromTGAMemory( memBuffer, bufferSize, nullptr, image );
+    }
+
+    HRESULT DecodeHDR( const void* memBuffer, size_t bufferSize, DWORD, ScratchImage& image )
+    {
+        return LoadFromHDRMemory( memBuffer, bufferSize, nullptr, image );
+    }
+
+    // Decoded mip chain from the texture cache, or decode and bake it there
+    bool DecodeCached( const void* memBuffer, size_t bufferSize, Decoder decode, ScratchImage& image )
+    {
+        // to support MMD texture
+        const DWORD flags = Gamma::bSRGB ? WIC_FLAGS_NONE : WIC_FLAGS_IGNORE_SRGB;
+        const std::wstring cachePath = TextureCache::GetCachePath( memBuffer, bufferSize, flags );
+        if (TextureCache::Load( cachePath, image ))
+            return true;
+        if (FAILED( decode( memBuffer, bufferSize, flags, image ) ) || !TextureCache::Bake( image ))
+            return false;
+        TextureCache::Store( cachePath, image );
+        return true;
+    }
+}
+
+bool Texture::CreateFromImage( const DirectX::ScratchImage& image, bool sRGB )
+{
+    HRESULT hr = DirectX::CreateShaderResourceViewEx( Graphics::g_Device, image.GetImages(),
+        image.GetImageCount(), image.GetMetadata(),
+        D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE,
+        0, 0, sRGB, m_pResource.GetAddressOf(), m_SRV.GetAddressOf() );
+    return SUCCEEDED( hr );
+}
+
+bool Texture::CreateWICFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB )
+{
+    DirectX::ScratchImage image;
+    return DecodeCached( memBuffer, bufferSize, DecodeWIC, image ) && CreateFromImage( image, sRGB );
 }
 
 bool Texture::CreateHDRFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB )
 {
-    using namespace DirectX;
-    ScratchImage image, mipChain;
-    HRESULT hr = DirectX::LoadFromHDRMemory( memBuffer, bufferSize, nullptr, image );
-    if (SUCCEEDED(hr))
-        hr = GenerateMipMaps( image.GetImages(), image.GetImageCount(), image.GetMetadata(), TEX_FILTER_DEFAULT, 0, mipChain );
-    if (SUCCEEDED(hr))
-        hr = CreateShaderResourceViewEx( Graphics::g_Device, mipChain.GetImages(),
-            mipChain.GetImageCount(), mipChain.GetMetadata(),
-            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE,
-            0, 0, sRGB, m_pResource.GetAddressOf(), m_SRV.GetAddressOf() );
-	return SUCCEEDED( hr );
+    DirectX::ScratchImage image;
+    return DecodeCached( memBuffer, bufferSize, DecodeHDR, image ) && CreateFromImage( image, sRGB );
 }
 
 bool Texture::CreateTGAFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB )
 {
-    using namespace DirectX;
-    ScratchImage image, mipChain;
-    HRESULT hr = DirectX::LoadFromTGAMemory( memBuffer, bufferSize, nullptr, image );
-    if (SUCCEEDED(hr))
-        hr = GenerateMipMaps( image.GetImages(), image.GetImageCount(), image.GetMetadata(), TEX_FILTER_DEFAULT, 0, mipChain );
-    if (SUCCEEDED(hr))
-        hr = CreateShaderResourceViewEx( Graphics::g_Device, mipChain.GetImages(),
-            mipChain.GetImageCount(), mipChain.GetMetadata(),
-            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE,
-            0, 0, sRGB, m_pResource.GetAddressOf(), m_SRV.GetAddressOf() );
-	return SUCCEEDED( hr );
+    DirectX::ScratchImage image;
+    return DecodeCached( memBuffer, bufferSize, DecodeTGA, image ) && CreateFromImage( image, sRGB );
+}
+
+bool Texture::CreateFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB, const std::wstring& name )
+{
+    switch (Utility::DetectTextureFormat( memBuffer, bufferSize, name ))
+    {
+    case Utility::kTextureDDS: return CreateDDSFromMemory( memBuffer, bufferSize, sRGB );
+    case Utility::kTextureWIC: return CreateWICFromMemory( memBuffer, bufferSize, sRGB );
+    case Utility::kTextureTGA: return CreateTGAFromMemory( memBuffer, bufferSize, sRGB );
+    case Utility::kTextureHDR: return CreateHDRFromMemory( memBuffer, bufferSize, sRGB );
+    default: return false;
+    }
 }
 
 bool Texture::CreateDDSFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB )
@@ -185,9 +213,10 @@ namespace TextureManager
 	wstring s_RootPath = L"";
 	map< wstring, unique_ptr<ManagedTexture> > s_TextureCache;
 
-	void Initialize( const std::wstring& TextureLibRoot )
+	void Initialize( const std::wstring& TextureLibRoot, const std::wstring& CacheRoot )
 	{
 		s_RootPath = TextureLibRoot;
+		TextureCache::Initialize( CacheRoot );
 	}
 
 	void Shutdown( void )
@@ -500,12 +529,7 @@ const ManagedTexture* TextureManager::LoadFromStream( const std::wstring& key, s
 
     ManagedTexture::Task task( [cbuf = std::move(buf), sRGB, ManTex, key]
     {
-        if (cbuf.size() == 0 ||
-            !(ManTex->CreateDDSFromMemory( cbuf.data(), cbuf.size(), sRGB ) ||
-                ManTex->CreateWICFromMemory( cbuf.data(), cbuf.size(), sRGB ) ||
-                ManTex->CreateTGAFromMemory( cbuf.data(), cbuf.size(), sRGB ) ||
-                ManTex->CreateHDRFromMemory( cbuf.data(), cbuf.size(), sRGB )
-                ))
+        if (cbuf.size() == 0 || !ManTex->CreateFromMemory( cbuf.data(), cbuf.size(), sRGB, key ))
             ManTex->SetToInvalidTexture();
         else
             SetName( ManTex->GetResource(), key );
@@ -530,12 +554,35 @@ const ManagedTexture* TextureManager::LoadFromMemory( const std::wstring& key, U
 
     ManagedTexture::Task task( [=]
     {
-        if (ba->size() == 0 ||
-            !(ManTex->CreateDDSFromMemory( ba->data(), ba->size(), sRGB ) ||
-                ManTex->CreateWICFromMemory( ba->data(), ba->size(), sRGB ) ||
-                ManTex->CreateTGAFromMemory( ba->data(), ba->size(), sRGB ) ||
-                ManTex->CreateHDRFromMemory( ba->data(), ba->size(), sRGB )
-                ))
+        if (ba->size() == 0 || !ManTex->CreateFromMemory( ba->data(), ba->size(), sRGB, key ))
+            ManTex->SetToInvalidTexture();
+        else
+            SetName( ManTex->GetResource(), key );
+        ManTex->SetProperty();
+    } );
+    ManTex->SetTask( std::move(task) );
+
+    return ManTex;
+}
+
+const ManagedTexture* TextureManager::LoadFromArchive( std::shared_ptr<Utility::Archive> archive, const fs::path& name, bool sRGB )
+{
+    const std::wstring key = archive->GetKeyName( name ).generic_wstring();
+	auto ManagedTex = FindOrLoadTexture( key );
+
+	ManagedTexture* ManTex = ManagedTex.first;
+	const bool RequestsLoad = ManagedTex.second;
+
+	if (!RequestsLoad)
+	{
+		ManTex->WaitForLoad();
+		return ManTex;
+	}
+
+    ManagedTexture::Task task( [=]
+    {
+        Utility::ByteView view = archive->GetView( name );
+        if (view.Empty() || !ManTex->CreateFromMemory( view.Data(), view.Size(), sRGB, key ))
             ManTex->SetToInvalidTexture();
         else
             SetName( ManTex->GetResource(), key );
@@ -563,10 +610,7 @@ const ManagedTexture* TextureManager::LoadFromMemory( const std::wstring& key, s
 
     ManagedTexture::Task task( [cbuf = std::move(buf), sRGB, ManTex, key, size]
     {
-        if (size == 0 ||
-            !(ManTex->CreateDDSFromMemory( cbuf.data(), size, sRGB ) ||
-                ManTex->CreateWICFromMemory( cbuf.data(), size, sRGB ) ||
-                ManTex->CreateTGAFromMemory( cbuf.data(), size, sRGB )))
+        if (size == 0 || !ManTex->CreateFromMemory( cbuf.data(), size, sRGB, key ))
             ManTex->SetToInvalidTexture();
         else
             SetName( ManTex->GetResource(), key );
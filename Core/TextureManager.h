@@ -22,6 +22,18 @@
 #include "TextUtility.h"
 #include "FileUtility.h"
 
+namespace boost {
+namespace filesystem {
+    class path;
+}
+}
+namespace Utility {
+    class Archive;
+}
+namespace DirectX {
+    class ScratchImage;
+}
+
 class Texture : public GpuResource, public IColorBuffer
 {
 	friend class CommandContext;
@@ -37,6 +49,10 @@ public:
 	bool CreateHDRFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB = false );
 	bool CreateTGAFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB = false );
 	bool CreateWICFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB = false );
+	// Dispatches on the detected format, 'name' only helps to tell TGA apart
+	bool CreateFromMemory( const void* memBuffer, size_t bufferSize, bool sRGB = false, const std::wstring& name = std::wstring() );
+	// Upload decoded image as is (mip chain, block compressed formats)
+	bool CreateFromImage( const DirectX::ScratchImage& image, bool sRGB = false );
 
 	virtual void Destroy() override
 	{
@@ -94,7 +110,8 @@ private:
 
 namespace TextureManager
 {
-	void Initialize( const std::wstring& TextureLibRoot );
+	// Decoded textures are kept under 'CacheRoot', empty disables the cache
+	void Initialize( const std::wstring& TextureLibRoot, const std::wstring& CacheRoot = L"TextureCache" );
 	void Shutdown(void);
 
 	const ManagedTexture* LoadFromFile( const std::wstring& fileName, bool sRGB = false );
@@ -105,6 +122,8 @@ namespace TextureManager
 	const ManagedTexture* LoadFromStream( const std::wstring& key, std::istream& stream, bool sRGB = false );
     const ManagedTexture* LoadFromMemory( const std::wstring & key, size_t size, void * data, bool sRGB );
     const ManagedTexture* LoadFromMemory( const std::wstring& key, Utility::ByteArray ba, bool sRGB );
+    // Entry is read from the archive on the texture load task
+    const ManagedTexture* LoadFromArchive( std::shared_ptr<Utility::Archive> archive, const boost::filesystem::path& name, bool sRGB );
 
 	inline const ManagedTexture* LoadFromFile( const std::string& fileName, bool sRGB = false )
 	{
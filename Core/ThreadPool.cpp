@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+
+using namespace Utility;
+
+ThreadPool::ThreadPool( uint32_t NumThreads ) : m_bExit(false)
+{
+	if (NumThreads == 0)
+		NumThreads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	m_Threads.reserve( NumThreads );
+	for (uint32_t i = 0; i < NumThreads; ++i)
+		m_Threads.emplace_back( &ThreadPool::WorkerMain, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_Mutex );
+		m_bExit = true;
+	}
+	m_Condition.notify_all();
+	for (auto& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::Push( std::function<void()>&& job )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_Mutex );
+		m_Jobs.push_back( std::move(job) );
+	}
+	m_Condition.notify_one();
+}
+
+void ThreadPool::ParallelFor( size_t Count, const std::function<void(size_t)>& Body )
+{
+	if (Count == 0)
+		return;
+
+	// Shared with the helper jobs, which may start after the loop has finished
+	struct Loop
+	{
+		const std::function<void(size_t)>* Body;
+		size_t Count;
+		std::atomic<size_t> Next;
+		std::atomic<size_t> Done;
+		std::mutex Mutex;
+		std::condition_variable Finished;
+	};
+	auto loop = std::make_shared<Loop>();
+	loop->Body = &Body;
+	loop->Count = Count;
+	loop->Next = 0;
+	loop->Done = 0;
+
+	// Body is only touched for a claimed index, and the caller waits for all of them
+	auto Run = []( Loop& loop )
+	{
+		for (size_t i = loop.Next++; i < loop.Count; i = loop.Next++)
+		{
+			(*loop.Body)( i );
+			if (++loop.Done == loop.Count)
+			{
+				std::lock_guard<std::mutex> lock( loop.Mutex );
+				loop.Finished.notify_all();
+			}
+		}
+	};
+
+	const size_t numHelpers = std::min( Count - 1, m_Threads.size() );
+	for (size_t i = 0; i < numHelpers; i++)
+		Push( [loop, Run]() { Run( *loop ); } );
+
+	Run( *loop );
+
+	std::unique_lock<std::mutex> lock( loop->Mutex );
+	loop->Finished.wait( lock, [&loop] { return loop->Done == loop->Count; } );
+}
+
+void ThreadPool::WorkerMain( void )
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock( m_Mutex );
+			m_Condition.wait( lock, [this] { return m_bExit || !m_Jobs.empty(); } );
+			// Drain queued jobs before exit, their futures may still be waited on
+			if (m_Jobs.empty())
+				return;
+			job = std::move( m_Jobs.front() );
+			m_Jobs.pop_front();
+		}
+		job();
+	}
+}
+
+ThreadPool& Utility::GetThreadPool( void )
+{
+	static ThreadPool s_Pool;
+	return s_Pool;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+namespace Utility
+{
+	//
+	// Fixed set of worker threads fed from a shared queue.
+	// Submit() returns a future of the job result.
+	// ParallelFor() splits a loop between the workers and the calling thread.
+	//
+	class ThreadPool
+	{
+	public:
+		// 0 : one worker per hardware thread
+		explicit ThreadPool( uint32_t NumThreads = 0 );
+		~ThreadPool();
+
+		template <typename Func>
+		auto Submit( Func&& func ) -> std::future<decltype(func())>;
+
+		// Runs Body(0) .. Body(Count-1) and returns when all are done. Indices are
+		// claimed one at a time, so threads that finish early take more of the
+		// remaining items. The caller works too, so it makes progress even when
+		// the workers are busy with other jobs (e.g. loading)
+		void ParallelFor( size_t Count, const std::function<void(size_t)>& Body );
+
+		uint32_t GetThreadCount( void ) const { return static_cast<uint32_t>(m_Threads.size()); }
+
+	private:
+		ThreadPool( const ThreadPool& ) = delete;
+		ThreadPool& operator=( const ThreadPool& ) = delete;
+
+		void Push( std::function<void()>&& job );
+		void WorkerMain( void );
+
+		std::vector<std::thread> m_Threads;
+		std::deque<std::function<void()>> m_Jobs;
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_bExit;
+	};
+
+	// Process wide pool for loading and other background work
+	ThreadPool& GetThreadPool( void );
+
+	template <typename Func>
+	auto ThreadPool::Submit( Func&& func ) -> std::future<decltype(func())>
+	{
+		using Result = decltype(func());
+		// std::function requires copyable target, so task is shared
+		auto task = std::make_shared<std::packaged_task<Result()>>( std::forward<Func>(func) );
+		std::future<Result> result = task->get_future();
+		Push( [task]() { (*task)(); } );
+		return result;
+	}
+}
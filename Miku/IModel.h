@@ -32,6 +32,8 @@ namespace Graphics
         virtual void Update( float deltaT ) = 0;
         virtual bool LoadModel( ArchivePtr& Archive, Path& FilePath ) = 0;
         virtual bool LoadMotion( const std::wstring& Motion ) = 0;
+        // Crossfades bone motion to another file over 'FadeFrames' from the current frame
+        virtual bool PlayMotion( const std::wstring& Motion, float FadeFrames ) = 0;
         virtual Math::BoundingBox GetBoundingBox() = 0;
     };
 }
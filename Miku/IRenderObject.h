@@ -7,11 +7,33 @@ class GraphicsContext;
 namespace Graphics
 {
     enum eObjectFilter { kOpaque = 0x1, kCutout = 0x2, kTransparent = 0x4, kOverlay = 0x10, kAll = 0xFF, kNone = 0x0 };
+
+    //
+    // How much animation work an object does in an update, picked by the scene from
+    // its size on screen. Objects without animation ignore it
+    //
+    struct AnimationLod
+    {
+        static AnimationLod Full() { return { 1, true, 0.f, true, true }; }
+
+        uint32_t Interval; // updates between evaluations, skinning is interpolated in between
+        bool bEvaluate; // object's turn to evaluate, spreads the evaluations over the interval
+        float FrameStep; // animation frames per update, to evaluate 'Interval' updates ahead
+        bool bIK;
+        bool bMorph;
+    };
+
     class IRenderObject
     {
     public:
         virtual void Draw( GraphicsContext& gfxContext, eObjectFilter Filter ) = 0;
+        // Update may run on a worker thread, concurrently with other objects, so it
+        // only touches the object's own CPU side state. GPU resources it changed
+        // are written by UpdateBuffers, called on the render thread afterwards
         virtual void Update( float deltaT ) = 0;
+        virtual void UpdateBuffers( GraphicsContext& gfxContext ) {}
+        // Applies to the following Update calls
+        virtual void SetAnimationLod( const AnimationLod& Lod ) {}
         virtual Math::BoundingBox GetBoundingBox() = 0;
     };
 }
@@ -1,37 +1,17 @@
 #include "KeyFrameAnimation.h"
 
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "Utility.h"
 
 using namespace Animation;
 using namespace Math;
 
-template <typename T>
-int32_t FindPreviousFrameIndex( const std::vector<T>& frames, const float t )
-{
-	if (frames.size() <= 0)
-		return -1;
-
-	int32_t low = 0, hi = (int32_t)frames.size();
-	while (low < hi)
-	{
-		auto mid = low + (hi - low + 1) / 2;
-		if (frames[mid].Frame >= t)
-			hi = mid - 1;
-		else
-			low = mid;
-	}
-
-	if (frames[low].Frame >= t)
-		return -1;
-	return low;
-}
-
 //
 // http://d.hatena.ne.jp/edvakf/20111016/1318716097
 //
-// TODO: apply partial cache, optimize (https://github.com/gre/bezier-easing/blob/master/src/index.js)
-//
 float Animation::Bezier( Vector4 C, float p )
 {
 	XMFLOAT4 coeff;
@@ -55,18 +35,83 @@ float Animation::Bezier( Vector4 C, float p )
 	return 3 * s*s*t*y1 + 3 * s*t*t*y2 + t*t*t;
 }
 
+BezierCurve::BezierCurve( float x1, float y1, float x2, float y2 ) : m_bLinear( x1 == y1 && x2 == y2 )
+{
+	for (int i = 0; i <= kNumSegments; i++)
+	{
+		const float t = float(i) / kNumSegments, s = 1.0f - t;
+		m_X[i] = 3*s*s*t*x1 + 3*s*t*t*x2 + t*t*t;
+		m_Y[i] = 3*s*s*t*y1 + 3*s*t*t*y2 + t*t*t;
+	}
+}
+
+const BezierCurve* BezierCurve::Get( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 )
+{
+	static std::mutex s_Mutex;
+	static std::unordered_map<uint32_t, std::unique_ptr<BezierCurve>> s_Curves;
+
+	// out of range points would make x non monotonic
+	x1 = std::min<uint8_t>( x1, 127 ), y1 = std::min<uint8_t>( y1, 127 );
+	x2 = std::min<uint8_t>( x2, 127 ), y2 = std::min<uint8_t>( y2, 127 );
+	const uint32_t key = x1 | (y1 << 8) | (x2 << 16) | (y2 << 24);
+
+	std::lock_guard<std::mutex> lock( s_Mutex );
+	auto& curve = s_Curves[key];
+	if (!curve)
+	{
+		const float scale = 1.0f / 127.0f;
+		curve.reset( new BezierCurve( x1 * scale, y1 * scale, x2 * scale, y2 * scale ) );
+	}
+	return curve.get();
+}
+
+const BezierCurve* BezierCurveCache::Get( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 )
+{
+	const uint32_t key = x1 | (y1 << 8) | (x2 << 16) | (y2 << 24);
+	auto& curve = m_Curves[key];
+	if (!curve)
+		curve = BezierCurve::Get( x1, y1, x2, y2 );
+	return curve;
+}
+
+const BezierCurve* BezierCurve::Linear()
+{
+	static const BezierCurve* s_Linear = Get( 20, 20, 107, 107 );
+	return s_Linear;
+}
+
+float BezierCurve::Evaluate( float p ) const
+{
+	if (m_bLinear)
+		return p;
+	if (p <= 0.f)
+		return 0.f;
+	if (p >= 1.f)
+		return 1.f;
+
+	// x is non decreasing for control points in [0, 1]
+	const float* next = std::upper_bound( m_X + 1, m_X + kNumSegments, p );
+	const size_t i = next - m_X - 1;
+	const float dx = m_X[i+1] - m_X[i];
+	const float a = dx > 0.f ? (p - m_X[i]) / dx : 0.f;
+	return m_Y[i] + (m_Y[i+1] - m_Y[i]) * a;
+}
+
 const BoneKeyFrame& ZeroFrame()
 {
 	static BoneKeyFrame zero;
 	zero.Frame = 0;
 	zero.Local = OrthogonalTransform( kIdentity );
 
-	// linear
 	for (uint8_t k = 0; k < 4; k++)
-		zero.BezierCoeff[k] = Vector4( 0.15748f, 0.1574f, 0.8425f, 0.8425f );
+		zero.Curve[k] = BezierCurve::Linear();
 	return zero;
 }
 
+BoneMotion::BoneMotion() : bLimitXAngle( false ), m_Cursor( 0 )
+{
+}
+
 void BoneMotion::InsertKeyFrame( const BoneKeyFrame& frame )
 {
 	m_KeyFrames.push_back( frame );
@@ -74,6 +119,7 @@ void BoneMotion::InsertKeyFrame( const BoneKeyFrame& frame )
 
 void BoneMotion::SortKeyFrame()
 {
+	m_Cursor = 0;
 	std::sort( m_KeyFrames.begin(), m_KeyFrames.end(), [](const auto& a, const auto& b) {
 		return a.Frame < b.Frame;
 	});
@@ -98,7 +144,7 @@ void BoneMotion::Interpolate( float t, OrthogonalTransform& local )
 	else
 	{
 		// VMD provide 0 frame. So, below zero check code is not nesseary.
-		int32_t prev = FindPreviousFrameIndex( m_KeyFrames, t );
+		int32_t prev = FindPreviousFrameIndex( m_KeyFrames, t, m_Cursor );
 		auto& a = (prev < 0) ? ZeroFrame() : m_KeyFrames[prev];
 		auto& b = m_KeyFrames[prev + 1];
 
@@ -108,7 +154,7 @@ void BoneMotion::Interpolate( float t, OrthogonalTransform& local )
 
 		float c[kInterpR+1];
 		for (uint8_t k = kInterpX; k <= kInterpR; k++)
-			c[k] = Bezier( a.BezierCoeff[k], p );
+			c[k] = a.Curve[k]->Evaluate( p );
 
 		local.SetTranslation( Lerp( a.Local.GetTranslation(), b.Local.GetTranslation(), Vector3( c[kInterpX], c[kInterpY], c[kInterpZ] ) ) );
 		local.SetRotation( Slerp( a.Local.GetRotation(), b.Local.GetRotation(), c[kInterpR] ) );
@@ -120,8 +166,6 @@ void MorphMotion::Interpolate( float t )
 	if (m_KeyFrames.size() == 0)
 		return;
 
-	m_WeightPre = m_Weight;
-
 	auto& first = m_KeyFrames.front();
 	auto& last = m_KeyFrames.back();
 
@@ -131,7 +175,7 @@ void MorphMotion::Interpolate( float t )
 		m_Weight = last.Weight;
 	else
 	{
-		auto prev = FindPreviousFrameIndex( m_KeyFrames, t );
+		auto prev = FindPreviousFrameIndex( m_KeyFrames, t, m_Cursor );
 		auto &a = m_KeyFrames[prev], &b = m_KeyFrames[prev+1];
 		float p = 1.0f;
 		if (b.Frame - a.Frame > 0)
@@ -140,7 +184,7 @@ void MorphMotion::Interpolate( float t )
 	}
 }
 
-MorphMotion::MorphMotion() : m_Weight( 0.f ), m_WeightPre( 0.f )
+MorphMotion::MorphMotion() : m_Weight( 0.f ), m_Cursor( 0 )
 {
 }
 
@@ -151,10 +195,15 @@ void MorphMotion::InsertKeyFrame( const MorphKeyFrame& frame )
 
 void MorphMotion::SortKeyFrame()
 {
+	m_Cursor = 0;
 	std::sort( m_KeyFrames.begin(), m_KeyFrames.end(),
 		[]( auto& a, auto& b ) { return a.Frame < b.Frame; } );
 }
 
+CameraMotion::CameraMotion() : m_Cursor( 0 )
+{
+}
+
 void CameraMotion::InsertKeyFrame( const CameraKeyFrame& frame )
 {
 	m_KeyFrames.push_back( frame );
@@ -162,6 +211,7 @@ void CameraMotion::InsertKeyFrame( const CameraKeyFrame& frame )
 
 void CameraMotion::SortKeyFrame()
 {
+	m_Cursor = 0;
 	std::sort( m_KeyFrames.begin(), m_KeyFrames.end(), [](const auto& a, const auto& b) {
 		return a.Frame < b.Frame;
 	});
@@ -187,7 +237,7 @@ CameraFrame CameraMotion::Interpolate( float t )
 	else
 	{
 		// VMD provide 0 frame. So, below zero check code is not nesseary.
-		int32_t prev = FindPreviousFrameIndex( m_KeyFrames, t );
+		int32_t prev = FindPreviousFrameIndex( m_KeyFrames, t, m_Cursor );
 		ASSERT( prev >= 0 );
 		auto& a = m_KeyFrames[prev];
 		auto& b = m_KeyFrames[prev + 1];
@@ -200,7 +250,7 @@ CameraFrame CameraMotion::Interpolate( float t )
 
 		float c[kInterpA+1];
 		for (uint8_t k = kInterpX; k <= kInterpA; k++)
-			c[k] = Bezier( a.BezierCoeff[k], p );
+			c[k] = a.Curve[k]->Evaluate( p );
 
 		Data.Position = Lerp( a.Data.Position, b.Data.Position, Vector3( c[kInterpX], c[kInterpY], c[kInterpZ] ) );
 		Data.Rotation = Slerp( a.Data.Rotation, b.Data.Rotation, c[kInterpR] );
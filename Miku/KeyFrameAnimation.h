@@ -2,6 +2,8 @@
 
 #include <DirectXMath.h>
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include "VectorMath.h"
 
 namespace Animation
@@ -13,24 +15,110 @@ namespace Animation
 		kInterpX = 0, kInterpY, kInterpZ, kInterpR, kInterpD, kInterpA
 	};
 
+	// Reference evaluation by bisection on the cubic, C = (x1, y1, x2, y2)
 	float Bezier( Vector4 C, float p );
 
+	//
+	// Easing curve of one channel, sampled once at load time. Samples are spaced evenly
+	// in the curve parameter, so steep curves keep their precision, and evaluation is
+	// a search over the sampled x plus lerp. Curves are interned by control points
+	// (VMD stores them as bytes in 0..127), so all keys share a handful of tables.
+	//
+	class BezierCurve
+	{
+	public:
+		static const BezierCurve* Get( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 );
+		static const BezierCurve* Linear();
+
+		float Evaluate( float p ) const;
+
+	private:
+		enum { kNumSegments = 256 };
+
+		BezierCurve( float x1, float y1, float x2, float y2 );
+
+		bool m_bLinear;
+		float m_X[kNumSegments+1];
+		float m_Y[kNumSegments+1];
+	};
+
+	//
+	// Curves of one file. Keys repeat a few sets of points, so a file goes to the locked
+	// table of BezierCurve::Get once per distinct set instead of once per key channel
+	//
+	class BezierCurveCache
+	{
+	public:
+		const BezierCurve* Get( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 );
+
+	private:
+		std::unordered_map<uint32_t, const BezierCurve*> m_Curves;
+	};
+
+	// Index of the last key before t, -1 if none. Keys are sorted by Frame
+	template <typename T>
+	int32_t FindPreviousFrameIndex( const std::vector<T>& frames, const float t )
+	{
+		if (frames.size() <= 0)
+			return -1;
+
+		int32_t low = 0, hi = (int32_t)frames.size() - 1;
+		while (low < hi)
+		{
+			auto mid = low + (hi - low + 1) / 2;
+			if (frames[mid].Frame >= t)
+				hi = mid - 1;
+			else
+				low = mid;
+		}
+
+		if (frames[low].Frame >= t)
+			return -1;
+		return low;
+	}
+
+	//
+	// Playback moves forward a frame at a time, so the previous result ('cursor') is
+	// almost always the answer or a few keys before it. Seeks and rewinds fall back
+	// to binary search
+	//
+	template <typename T>
+	int32_t FindPreviousFrameIndex( const std::vector<T>& frames, const float t, int32_t& cursor )
+	{
+		const int32_t kMaxStep = 4;
+		const int32_t size = (int32_t)frames.size();
+		if (cursor >= 0 && cursor < size && frames[cursor].Frame < t)
+		{
+			for (int32_t step = 0; step <= kMaxStep; step++, cursor++)
+			{
+				if (cursor + 1 == size || frames[cursor + 1].Frame >= t)
+					return cursor;
+			}
+		}
+		return cursor = FindPreviousFrameIndex( frames, t );
+	}
+
 	struct BoneKeyFrame
 	{
 		int Frame;
 		OrthogonalTransform Local;
-		Vector4 BezierCoeff[kInterpR+1];
+		const BezierCurve* Curve[kInterpR+1];
 	};
 
 	class BoneMotion
 	{
 	public:
+		std::wstring m_Name;
 		bool bLimitXAngle;
 		std::vector<BoneKeyFrame> m_KeyFrames;
 
+		BoneMotion();
 		void InsertKeyFrame( const BoneKeyFrame& frame );
 		void SortKeyFrame();
 		void Interpolate( float t, OrthogonalTransform& local );
+
+	private:
+		int32_t m_Cursor; // key found by the last Interpolate
 	};
 
 	struct MorphKeyFrame
@@ -44,15 +132,16 @@ namespace Animation
 	public:
 		std::wstring m_Name;
 		std::vector<MorphKeyFrame> m_KeyFrames;
-		std::vector<uint32_t> m_MorphIndices;
-		std::vector<Vector3> m_MorphVertices;
 
 		MorphMotion();
 		void InsertKeyFrame( const MorphKeyFrame& frame );
 		void SortKeyFrame();
 
-		float m_Weight, m_WeightPre;
+		float m_Weight;
 		void Interpolate( float t );
+
+	private:
+		int32_t m_Cursor; // key found by the last Interpolate
 	};
 
 	struct CameraFrame
@@ -70,7 +159,7 @@ namespace Animation
 	{
 		int Frame;
 		CameraFrame Data;
-		Vector4 BezierCoeff[kInterpA+1];
+		const BezierCurve* Curve[kInterpA+1];
 	};
 
 	class CameraMotion
@@ -78,8 +167,12 @@ namespace Animation
 	public:
 		std::vector<CameraKeyFrame> m_KeyFrames;
 
+		CameraMotion();
 		void InsertKeyFrame( const CameraKeyFrame& frame );
 		void SortKeyFrame();
 		CameraFrame Interpolate( float t );
+
+	private:
+		int32_t m_Cursor; // key found by the last Interpolate
 	};
 }
\ No newline at end of file
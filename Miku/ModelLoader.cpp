@@ -2,6 +2,7 @@
 
 #include <boost/algorithm/string.hpp>
 #include "Archive.h"
+#include "ThreadPool.h"
 #include "Pmd/Model.h"
 #include "Pmx/Model.h"
 
@@ -24,6 +25,21 @@ std::shared_ptr<IModel> ModelLoader::Load()
     return model;
 }
 
+std::future<std::shared_ptr<IModel>> ModelLoader::LoadAsync() const
+{
+    ModelLoader loader( *this );
+    return GetThreadPool().Submit( [loader]() mutable { return loader.Load(); } );
+}
+
+std::vector<std::future<std::shared_ptr<IModel>>> ModelLoader::LoadAsync( const std::vector<ModelLoader>& Loaders )
+{
+    std::vector<std::future<std::shared_ptr<IModel>>> models;
+    models.reserve( Loaders.size() );
+    for (auto& loader : Loaders)
+        models.push_back( loader.LoadAsync() );
+    return models;
+}
+
 const std::wstring PMDExtension( L".pmd" ), PMXExtension( L".pmx" );
 
 std::wstring GetExtension( const Path& FilePath )
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <future>
 #include "IModel.h"
 #include "Math/Vector.h"
 
@@ -14,6 +16,11 @@ namespace Graphics {
         ModelLoader( const std::wstring& Model, const std::wstring& Motion = L"", const Vector3& Position = Vector3(kZero) );
         std::shared_ptr<IModel> Load();
 
+        // Load() on the shared worker pool; archive read, parse, texture
+        // and motion loading of each model run off the calling thread
+        std::future<std::shared_ptr<IModel>> LoadAsync() const;
+        static std::vector<std::future<std::shared_ptr<IModel>>> LoadAsync( const std::vector<ModelLoader>& Loaders );
+
     protected:
 
         std::shared_ptr<IModel> LoadModel( const std::wstring& Model );
@@ -16,11 +16,11 @@ void Motion::LoadMotion( const std::wstring& path )
 	using namespace Animation;
 	
 	Utility::ByteArray ba = Utility::ReadFileSync( path );
-	Utility::ByteStream bs(ba);
 
 	Vmd::VMD vmd;
-	vmd.Fill( bs, m_bRightHand );
+	vmd.Fill( ba->data(), ba->size(), m_bRightHand );
 
+	BezierCurveCache curves;
 	for (auto& frame : vmd.CameraFrames)
 	{
 		CameraKeyFrame key;
@@ -34,11 +34,10 @@ void Motion::LoadMotion( const std::wstring& path )
 		//
 		// http://harigane.at.webry.info/201103/article_1.html
 		// 
-		auto interp = reinterpret_cast<const char*>(&frame.Interpolation[0]);
-		float scale = 1.0f / 127.0f;
+		auto interp = reinterpret_cast<const uint8_t*>(&frame.Interpolation[0]);
 
 		for (auto i = 0; i < 6; i++)
-			key.BezierCoeff[i] = Vector4( interp[i], interp[i+2], interp[i+1], interp[i+3] ) * scale;
+			key.Curve[i] = curves.Get( interp[i], interp[i+2], interp[i+1], interp[i+3] );
 
 		m_CameraMotion.InsertKeyFrame( key );
 	}
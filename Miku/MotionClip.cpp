@@ -0,0 +1,550 @@
+#include "MotionClip.h"
+#include "Vmd.h"
+#include "FileUtility.h"
+#include "NameTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+using namespace Animation;
+using namespace DirectX;
+
+namespace {
+	struct BoneNames
+	{
+		std::mutex Mutex;
+		Utility::NameTable Table;
+	};
+
+	BoneNames& GetBoneNames( void )
+	{
+		static BoneNames s_BoneNames;
+		return s_BoneNames;
+	}
+}
+
+uint32_t Animation::InternBoneName( const std::wstring& name )
+{
+	BoneNames& names = GetBoneNames();
+	std::lock_guard<std::mutex> lock( names.Mutex );
+	return names.Table.Intern( name );
+}
+
+uint32_t Animation::FindBoneName( const std::wstring& name )
+{
+	BoneNames& names = GetBoneNames();
+	std::lock_guard<std::mutex> lock( names.Mutex );
+	return names.Table.Find( name );
+}
+
+const float MotionClip::kTranslationTolerance = 0.001f;
+const float MotionClip::kRotationTolerance = 0.001f;
+
+namespace {
+	//
+	// Index of the last key before t (t is inside the key range). Same playback cursor
+	// scheme as the keyframe motions: walk forward from the previous result, otherwise
+	// binary search
+	//
+	int32_t FindPreviousKey( const int32_t* frames, int32_t count, float t, int32_t& cursor )
+	{
+		const int32_t kMaxStep = 4;
+		if (cursor >= 0 && cursor < count && frames[cursor] < t)
+		{
+			for (int32_t step = 0; step <= kMaxStep; step++, cursor++)
+			{
+				if (cursor + 1 == count || frames[cursor + 1] >= t)
+					return cursor;
+			}
+		}
+		const int32_t* next = std::lower_bound( frames, frames + count, t,
+			[]( int32_t frame, float value ) { return frame < value; } );
+		cursor = static_cast<int32_t>(next - frames) - 1;
+		return cursor;
+	}
+
+	//
+	// Slerp of four quaternions given in SoA form (q[0] holds x of all four, ...).
+	// Follows XMQuaternionSlerp: shortest arc, and plain lerp for nearly equal rotations
+	//
+	void SlerpSoA( const XMVECTOR a[4], const XMVECTOR b[4], XMVECTOR t, XMVECTOR result[4] )
+	{
+		const XMVECTOR kOneMinusEpsilon = XMVectorReplicate( 1.0f - 0.00001f );
+
+		XMVECTOR cosom = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		const XMVECTOR sign = XMVectorSelect( g_XMOne, g_XMNegativeOne, XMVectorLess( cosom, g_XMZero ) );
+		cosom = XMVectorMin( XMVectorAbs( cosom ), g_XMOne );
+
+		const XMVECTOR omega = XMVectorACos( cosom );
+		const XMVECTOR sinom = XMVectorSin( omega );
+		XMVECTOR s0 = XMVectorSin( (g_XMOne - t) * omega ) / sinom;
+		XMVECTOR s1 = XMVectorSin( t * omega ) / sinom;
+
+		// Division above is not used (may be NaN) in these lanes
+		const XMVECTOR bLinear = XMVectorGreaterOrEqual( cosom, kOneMinusEpsilon );
+		s0 = XMVectorSelect( s0, g_XMOne - t, bLinear );
+		s1 = XMVectorSelect( s1, t, bLinear ) * sign;
+
+		for (int k = 0; k < 4; k++)
+			result[k] = a[k] * s0 + b[k] * s1;
+	}
+
+	// Components other than the largest one of a unit quaternion are within +-1/sqrt(2)
+	const float kRotationRange = 0.70710678f;
+	const float kRotationSteps = 32767.f;
+
+	void PackRotation( Quaternion rotation, uint16_t packed[3] )
+	{
+		XMFLOAT4 q;
+		XMStoreFloat4( &q, Normalize( rotation ) );
+		const float v[4] = { q.x, q.y, q.z, q.w };
+
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (std::fabs( v[i] ) > std::fabs( v[largest] ))
+				largest = i;
+
+		// q and -q are the same rotation, keep the dropped component positive
+		const float sign = v[largest] < 0.f ? -1.f : 1.f;
+		for (int i = 0, n = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			const float c = std::min( std::max( v[i] * sign / kRotationRange, -1.f ), 1.f );
+			packed[n++] = static_cast<uint16_t>(std::lround( (c * 0.5f + 0.5f) * kRotationSteps ));
+		}
+		packed[0] |= static_cast<uint16_t>((largest & 1) << 15);
+		packed[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+	}
+
+	void UnpackRotation( const uint16_t packed[3], float q[4] )
+	{
+		const int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+		float sum = 0.f;
+		for (int i = 0, n = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			const float c = ((packed[n++] & 0x7FFF) / kRotationSteps * 2.f - 1.f) * kRotationRange;
+			q[i] = c;
+			sum += c * c;
+		}
+		q[largest] = std::sqrt( std::max( 1.f - sum, 0.f ) );
+	}
+
+	// Transform between two keys, as BoneMotion::Interpolate evaluates it
+	void InterpolateKeys( const BoneKeyFrame& a, const BoneKeyFrame& b, float t, Vector3& translation, Quaternion& rotation )
+	{
+		float p = 1.f;
+		if (b.Frame - a.Frame > 0)
+			p = (t - a.Frame) / (b.Frame - a.Frame);
+
+		float c[kInterpR+1];
+		for (uint8_t k = kInterpX; k <= kInterpR; k++)
+			c[k] = a.Curve[k]->Evaluate( p );
+
+		translation = Lerp( a.Local.GetTranslation(), b.Local.GetTranslation(), Vector3( c[kInterpX], c[kInterpY], c[kInterpZ] ) );
+		rotation = Slerp( a.Local.GetRotation(), b.Local.GetRotation(), c[kInterpR] );
+	}
+
+	bool IsNear( Vector3 t0, Quaternion r0, Vector3 t1, Quaternion r1 )
+	{
+		if (float(Length( t0 - t1 )) > MotionClip::kTranslationTolerance)
+			return false;
+		// |q0 - q1| is about half of the angle between them, and keeps precision near zero
+		const float d0 = XMVectorGetX( XMVector4Length( XMVectorSubtract( r0, r1 ) ) );
+		const float d1 = XMVectorGetX( XMVector4Length( XMVectorAdd( r0, r1 ) ) );
+		return 2.f * std::min( d0, d1 ) <= MotionClip::kRotationTolerance;
+	}
+
+	//
+	// Whether the segment keys[first] -> keys[last] reproduces the keys between them.
+	// Checked at each inner key and halfway through each original segment
+	//
+	bool IsReducible( const std::vector<BoneKeyFrame>& keys, size_t first, size_t last )
+	{
+		const BoneKeyFrame& a = keys[first];
+		const BoneKeyFrame& b = keys[last];
+		Vector3 translation;
+		Quaternion rotation;
+		for (size_t j = first; j < last; j++)
+		{
+			const BoneKeyFrame& k0 = keys[j];
+			const BoneKeyFrame& k1 = keys[j + 1];
+			if (k0.Frame == k1.Frame)
+				return false;
+			if (j > first)
+			{
+				InterpolateKeys( a, b, float(k0.Frame), translation, rotation );
+				if (!IsNear( translation, rotation, k0.Local.GetTranslation(), k0.Local.GetRotation() ))
+					return false;
+			}
+			const float mid = (k0.Frame + k1.Frame) * 0.5f;
+			Vector3 expectedTranslation;
+			Quaternion expectedRotation;
+			InterpolateKeys( k0, k1, mid, expectedTranslation, expectedRotation );
+			InterpolateKeys( a, b, mid, translation, rotation );
+			if (!IsNear( translation, rotation, expectedTranslation, expectedRotation ))
+				return false;
+		}
+		return true;
+	}
+
+	// Indices of the keys to keep. Greedy: extend each segment while it stays within tolerance
+	void ReduceKeys( const std::vector<BoneKeyFrame>& keys, std::vector<size_t>& kept )
+	{
+		// Bounds build time on long runs of redundant keys
+		const size_t kMaxSpan = 32;
+
+		kept.clear();
+		if (keys.empty())
+			return;
+		kept.push_back( 0 );
+		size_t start = 0;
+		for (size_t end = 2; end < keys.size(); end++)
+		{
+			if (end - start > kMaxSpan || !IsReducible( keys, start, end ))
+			{
+				start = end - 1;
+				kept.push_back( start );
+			}
+		}
+		if (keys.size() > 1)
+			kept.push_back( keys.size() - 1 );
+	}
+}
+
+MotionClipPtr MotionClip::Load( const std::wstring& path, bool bRightHand )
+{
+	// The clip goes away with the last model using it, its entry on the next load
+	struct Entry
+	{
+		std::mutex Mutex;
+		std::weak_ptr<const MotionClip> Clip;
+	};
+	static std::mutex s_Mutex;
+	static std::map<std::wstring, std::shared_ptr<Entry>> s_Entries;
+
+	std::shared_ptr<Entry> entry;
+	{
+		std::lock_guard<std::mutex> lock( s_Mutex );
+		// Drop entries of clips gone. Held only by the map, no load is on them, and
+		// new holders come through s_Mutex
+		for (auto it = s_Entries.begin(); it != s_Entries.end();)
+		{
+			if (it->second.use_count() == 1 && it->second->Clip.expired())
+				it = s_Entries.erase( it );
+			else
+				++it;
+		}
+		auto& slot = s_Entries[path + (bRightHand ? L"|RH" : L"|LH")];
+		if (!slot)
+			slot = std::make_shared<Entry>();
+		entry = slot;
+	}
+
+	// Models loading the same file at once wait for the first one to parse it
+	std::lock_guard<std::mutex> lock( entry->Mutex );
+	MotionClipPtr clip = entry->Clip.lock();
+	if (clip)
+		return clip;
+
+	Utility::ByteArray ba = Utility::ReadFileSync( path );
+	Vmd::VMD vmd;
+	vmd.Fill( ba->data(), ba->size(), bRightHand );
+	if (!vmd.IsValid())
+		return nullptr;
+
+	auto built = std::make_shared<MotionClip>();
+	built->Build( vmd );
+	entry->Clip = built;
+	return built;
+}
+
+void MotionClip::Build( const Vmd::VMD& vmd, bool bReduceKeys )
+{
+	BezierCurveCache curves;
+	std::vector<BoneMotion> motions( vmd.BoneTracks.size() );
+	for (size_t t = 0; t < vmd.BoneTracks.size(); t++)
+	{
+		auto& track = vmd.BoneTracks[t];
+		auto& motion = motions[t];
+		motion.m_Name = track.Name;
+		motion.m_KeyFrames.reserve( track.Count );
+		for (uint32_t k = 0; k < track.Count; k++)
+		{
+			auto& frame = vmd.BoneKeys[track.Offset + k];
+
+			BoneKeyFrame key;
+			key.Frame = frame.Frame;
+			key.Local.SetTranslation( Vector3( frame.Offset ) );
+			key.Local.SetRotation( Quaternion( frame.Rotation ) );
+
+			//
+			// http://harigane.at.webry.info/201103/article_1.html
+			//
+			// X_x1, Y_x1, Z_x1, R_x1,
+			// X_y1, Y_y1, Z_y1, R_y1,
+			// X_x2, Y_x2, Z_x2, R_x2,
+			// X_y2, Y_y2, Z_y2, R_y2,
+			//
+			// ... (duplicated values)
+			//
+			auto interp = reinterpret_cast<const uint8_t*>(&frame.Interpolation[0]);
+
+			for (auto i = 0; i < 4; i++)
+				key.Curve[i] = curves.Get( interp[i], interp[i+4], interp[i+8], interp[i+12] );
+
+			motion.InsertKeyFrame( key );
+		}
+		motion.SortKeyFrame();
+	}
+	Build( motions, bReduceKeys );
+
+	m_MorphMotions.resize( vmd.FaceTracks.size() );
+	for (size_t t = 0; t < vmd.FaceTracks.size(); t++)
+	{
+		auto& track = vmd.FaceTracks[t];
+		auto& motion = m_MorphMotions[t];
+		motion.m_Name = track.Name;
+		motion.m_KeyFrames.reserve( track.Count );
+		for (uint32_t i = 0; i < track.Count; i++)
+		{
+			auto& frame = vmd.FaceKeys[track.Offset + i];
+			MorphKeyFrame key;
+			key.Frame = frame.Frame;
+			key.Weight = frame.Weight;
+			motion.InsertKeyFrame( key );
+		}
+		motion.SortKeyFrame();
+	}
+
+	for (auto& frame : vmd.CameraFrames)
+	{
+		CameraKeyFrame keyFrame;
+		keyFrame.Frame = frame.Frame;
+		keyFrame.Data.bPerspective = frame.TurnOffPerspective == 0;
+		keyFrame.Data.Distance = frame.Distance;
+		keyFrame.Data.FovY = frame.ViewAngle / XM_PI;
+		keyFrame.Data.Rotation = Quaternion( frame.Rotation.y, frame.Rotation.x, frame.Rotation.z );
+		keyFrame.Data.Position = frame.Position;
+
+		//
+		// http://harigane.at.webry.info/201103/article_1.html
+		//
+		auto interp = reinterpret_cast<const uint8_t*>(&frame.Interpolation[0]);
+
+		for (auto i = 0; i < 6; i++)
+			keyFrame.Curve[i] = curves.Get( interp[i], interp[i+2], interp[i+1], interp[i+3] );
+
+		m_CameraMotion.InsertKeyFrame( keyFrame );
+	}
+}
+
+void MotionClip::Clear( void )
+{
+	m_Tracks.clear();
+	m_TrackNames.clear();
+	m_TrackIds.clear();
+	m_Frame.clear();
+	m_Translation.clear();
+	m_Rotation.clear();
+	m_CurveSet.clear();
+	m_CurveSets.clear();
+	m_MorphMotions.clear();
+	m_CameraMotion = CameraMotion();
+}
+
+size_t MotionClip::GetMemorySize( void ) const
+{
+	size_t nameSize = 0;
+	for (auto& name : m_TrackNames)
+		nameSize += name.capacity() * sizeof(wchar_t);
+	return m_Tracks.size() * (sizeof(Track) + sizeof(uint32_t)) + nameSize
+		+ m_Frame.size() * (sizeof(int32_t) + sizeof(PackedTranslation) + sizeof(PackedRotation) + sizeof(uint32_t))
+		+ m_CurveSets.size() * sizeof(CurveSet);
+}
+
+void MotionClip::Build( const std::vector<BoneMotion>& motions, bool bReduceKeys )
+{
+	Clear();
+
+	std::map<CurveSet, uint32_t> curveSetIndex;
+	std::vector<size_t> kept;
+
+	m_Tracks.reserve( motions.size() );
+	m_TrackNames.reserve( motions.size() );
+	m_TrackIds.reserve( motions.size() );
+	for (auto& motion : motions)
+	{
+		m_TrackNames.push_back( motion.m_Name );
+		m_TrackIds.push_back( InternBoneName( motion.m_Name ) );
+		auto& keys = motion.m_KeyFrames;
+		if (bReduceKeys)
+		{
+			ReduceKeys( keys, kept );
+		}
+		else
+		{
+			kept.resize( keys.size() );
+			for (size_t i = 0; i < keys.size(); i++)
+				kept[i] = i;
+		}
+
+		Track track = { static_cast<uint32_t>(m_Frame.size()), static_cast<uint32_t>(kept.size()) };
+
+		// Quantization range of the translation
+		XMVECTOR minimum = g_XMZero, maximum = g_XMZero;
+		for (size_t i = 0; i < kept.size(); i++)
+		{
+			const XMVECTOR translation = keys[kept[i]].Local.GetTranslation();
+			minimum = i == 0 ? translation : XMVectorMin( minimum, translation );
+			maximum = i == 0 ? translation : XMVectorMax( maximum, translation );
+		}
+		const XMVECTOR center = (minimum + maximum) * 0.5f;
+		const XMVECTOR scale = (maximum - minimum) * (0.5f / 32767.f);
+		const XMVECTOR invScale = XMVectorSelect( XMVectorReciprocal( scale ), g_XMZero, XMVectorEqual( scale, g_XMZero ) );
+		XMStoreFloat3( &track.Center, center );
+		XMStoreFloat3( &track.Scale, scale );
+		m_Tracks.push_back( track );
+
+		for (size_t i : kept)
+		{
+			auto& key = keys[i];
+			m_Frame.push_back( key.Frame );
+
+			XMFLOAT3 quantized;
+			XMStoreFloat3( &quantized, XMVectorRound( (XMVECTOR(key.Local.GetTranslation()) - center) * invScale ) );
+			PackedTranslation translation = { { static_cast<int16_t>(quantized.x), static_cast<int16_t>(quantized.y), static_cast<int16_t>(quantized.z) } };
+			m_Translation.push_back( translation );
+
+			PackedRotation rotation;
+			PackRotation( key.Local.GetRotation(), rotation.Value );
+			m_Rotation.push_back( rotation );
+
+			CurveSet curves;
+			std::copy( key.Curve, key.Curve + kInterpR + 1, curves.begin() );
+			auto it = curveSetIndex.find( curves );
+			if (it == curveSetIndex.end())
+			{
+				it = curveSetIndex.emplace( curves, static_cast<uint32_t>(m_CurveSets.size()) ).first;
+				m_CurveSets.push_back( curves );
+			}
+			m_CurveSet.push_back( it->second );
+		}
+	}
+}
+
+void MotionClip::Locate( const Track& track, float t, int32_t& cursor, uint32_t& a, uint32_t& b, float& p ) const
+{
+	const int32_t* frames = m_Frame.data() + track.Offset;
+	const int32_t count = static_cast<int32_t>(track.Count);
+
+	p = 0.f;
+	if (t <= frames[0])
+	{
+		a = b = track.Offset;
+	}
+	else if (t >= frames[count - 1])
+	{
+		a = b = track.Offset + count - 1;
+	}
+	else
+	{
+		const int32_t prev = FindPreviousKey( frames, count, t, cursor );
+		a = track.Offset + prev;
+		b = a + 1;
+		if (frames[prev + 1] - frames[prev] > 0)
+			p = (t - frames[prev]) / (frames[prev + 1] - frames[prev]);
+	}
+}
+
+void MotionClip::Sample( float t, const TrackBinding* bindings, int32_t* cursors, OrthogonalTransform* pose ) const
+{
+	if (m_Frame.empty())
+		return;
+
+	const size_t numTracks = m_Tracks.size();
+	for (size_t base = 0; base < numTracks; base += 4)
+	{
+		// Decoded keys, one component of four tracks per row
+		XMFLOAT4A ta[3] = {}, tb[3] = {};
+		XMFLOAT4A qa[4] = {}, qb[4] = {};
+		XMVECTORF32 c[kInterpR+1] = {};
+		bool bActive[4] = {};
+
+		for (size_t lane = 0; lane < 4 && base + lane < numTracks; lane++)
+		{
+			const Track& track = m_Tracks[base + lane];
+			const TrackBinding& binding = bindings[base + lane];
+			if (track.Count == 0 || binding.Bone == TrackBinding::kUnbound)
+				continue;
+			uint32_t a, b;
+			float p;
+			Locate( track, t, cursors[base + lane], a, b, p );
+
+			const CurveSet& curves = m_CurveSets[m_CurveSet[a]];
+			for (uint8_t k = kInterpX; k <= kInterpR; k++)
+				c[k].f[lane] = curves[k]->Evaluate( p );
+
+			const float center[3] = { binding.Rest.x + track.Center.x, binding.Rest.y + track.Center.y, binding.Rest.z + track.Center.z };
+			const float scale[3] = { track.Scale.x, track.Scale.y, track.Scale.z };
+			for (int k = 0; k < 3; k++)
+			{
+				(&ta[k].x)[lane] = center[k] + m_Translation[a].Value[k] * scale[k];
+				(&tb[k].x)[lane] = center[k] + m_Translation[b].Value[k] * scale[k];
+			}
+
+			float q[4];
+			UnpackRotation( m_Rotation[a].Value, q );
+			for (int k = 0; k < 4; k++)
+				(&qa[k].x)[lane] = q[k];
+			UnpackRotation( m_Rotation[b].Value, q );
+			for (int k = 0; k < 4; k++)
+				(&qb[k].x)[lane] = q[k];
+
+			bActive[lane] = true;
+		}
+
+		XMVECTOR T[4], QA[4], QB[4], Q[4];
+		for (int k = 0; k < 3; k++)
+		{
+			const XMVECTOR a = XMLoadFloat4A( &ta[k] ), b = XMLoadFloat4A( &tb[k] );
+			T[k] = a + (b - a) * c[k];
+		}
+		T[3] = g_XMZero;
+		for (int k = 0; k < 4; k++)
+		{
+			QA[k] = XMLoadFloat4A( &qa[k] );
+			QB[k] = XMLoadFloat4A( &qb[k] );
+		}
+		SlerpSoA( QA, QB, c[kInterpR], Q );
+
+		// Back to one transform per track
+		const XMMATRIX translation = XMMatrixTranspose( XMMATRIX( T[0], T[1], T[2], T[3] ) );
+		const XMMATRIX rotation = XMMatrixTranspose( XMMATRIX( Q[0], Q[1], Q[2], Q[3] ) );
+		for (size_t lane = 0; lane < 4; lane++)
+		{
+			if (!bActive[lane])
+				continue;
+			OrthogonalTransform& local = pose[bindings[base + lane].Bone];
+			local.SetTranslation( Vector3( translation.r[lane] ) );
+			local.SetRotation( Quaternion( rotation.r[lane] ) );
+		}
+	}
+}
+
+void MotionBinding::Reset( void )
+{
+	m_Clip.reset();
+	m_Tracks.clear();
+	m_Cursors.clear();
+}
+
+void MotionBinding::Sample( float t, OrthogonalTransform* pose )
+{
+	if (!Empty())
+		m_Clip->Sample( t, m_Tracks.data(), m_Cursors.data(), pose );
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include "KeyFrameAnimation.h"
+
+namespace Vmd
+{
+	class VMD;
+}
+
+namespace Animation
+{
+	class MotionClip;
+	using MotionClipPtr = std::shared_ptr<const MotionClip>;
+
+	//
+	// Ids of bone names, one table for the tracks of every clip and the bones of every
+	// model, so a model binds a clip comparing ids. Ids stay valid for the whole run.
+	// Both lock, they are meant for load time
+	//
+	uint32_t InternBoneName( const std::wstring& name );
+	// Utility::NameTable::kInvalid when no clip or model has the name
+	uint32_t FindBoneName( const std::wstring& name );
+
+	// Where a track of a clip lands on a model
+	struct TrackBinding
+	{
+		enum { kUnbound = -1 };
+
+		int32_t Bone; // kUnbound when the model has no bone of the track's name
+		XMFLOAT3 Rest; // keyed translation is an offset from the bone's rest translation
+	};
+
+	//
+	// Bone motion compiled for sampling. Keys of every track are stored as structure of
+	// arrays (frame, translation, rotation and easing curves in separate arrays),
+	// and Sample evaluates four tracks per step: keys are decoded and easing curves
+	// looked up per lane, then translation lerp and rotation slerp run on SSE
+	// registers holding one component of four bones each.
+	// The build targets AVX2, but lanes stay 4 wide: the slerp rests on DirectXMath's
+	// XMVectorACos and XMVectorSin, which have no 8 wide form, and the per lane part
+	// (key search, curve lookup, decode, scatter to the pose) is most of the work.
+	//
+	// Keys are stored compressed, 20 bytes each instead of ~100 of BoneKeyFrame:
+	//  - rotation as smallest three, 15 bits per component
+	//  - translation offset as int16 relative to the center of the track's range
+	//  - index into a palette of the distinct easing curve sets of the clip
+	// Keys the neighbouring keys reproduce within kTranslationTolerance and
+	// kRotationTolerance are dropped at build.
+	//
+	// A clip does not depend on the model playing it: tracks are named after the
+	// VMD bone tracks and hold translation offsets from the rest pose. Load shares
+	// one immutable clip between all models playing the same file, each model keeps
+	// only a MotionBinding (target bone and playback cursor per track).
+	//
+	class MotionClip
+	{
+	public:
+		static const float kTranslationTolerance; // model units
+		static const float kRotationTolerance; // radian
+
+		// Parsed once per file and handedness, and kept while any model holds it.
+		// nullptr when the file can not be read
+		static MotionClipPtr Load( const std::wstring& path, bool bRightHand );
+
+		// Track i is compiled from motions[i], and named after it
+		void Build( const std::vector<BoneMotion>& motions, bool bReduceKeys = true );
+		void Build( const Vmd::VMD& vmd, bool bReduceKeys = true );
+		void Clear( void );
+
+		bool Empty( void ) const { return m_Tracks.empty(); }
+		size_t GetTrackCount( void ) const { return m_Tracks.size(); }
+		const std::wstring& GetTrackName( size_t i ) const { return m_TrackNames[i]; }
+		// Id of the track's name, see InternBoneName
+		uint32_t GetTrackId( size_t i ) const { return m_TrackIds[i]; }
+		size_t GetKeyCount( void ) const { return m_Frame.size(); }
+		size_t GetMemorySize( void ) const;
+
+		// Face and camera keys of the source file, as loaded
+		const std::vector<MorphMotion>& GetMorphMotions( void ) const { return m_MorphMotions; }
+		const CameraMotion& GetCameraMotion( void ) const { return m_CameraMotion; }
+
+		// Writes local transform of the bone of every bound track that has keys.
+		// 'bindings' and 'cursors' hold one entry per track; cursors are kept by
+		// the caller between frames to speed up key search
+		void Sample( float t, const TrackBinding* bindings, int32_t* cursors, OrthogonalTransform* pose ) const;
+
+	private:
+		struct Track
+		{
+			uint32_t Offset;
+			uint32_t Count;
+			XMFLOAT3 Center;
+			XMFLOAT3 Scale; // translation = Center + quantized * Scale
+		};
+
+		// Two top bits of Value[0], Value[1] hold index of the dropped (largest) component
+		struct PackedRotation
+		{
+			uint16_t Value[3];
+		};
+
+		struct PackedTranslation
+		{
+			int16_t Value[3];
+		};
+
+		using CurveSet = std::array<const BezierCurve*, kInterpR+1>;
+
+		void Locate( const Track& track, float t, int32_t& cursor, uint32_t& a, uint32_t& b, float& p ) const;
+
+		std::vector<Track> m_Tracks;
+		std::vector<std::wstring> m_TrackNames;
+		std::vector<uint32_t> m_TrackIds;
+		std::vector<int32_t> m_Frame;
+		std::vector<PackedTranslation> m_Translation;
+		std::vector<PackedRotation> m_Rotation;
+		std::vector<uint32_t> m_CurveSet; // index into m_CurveSets
+		std::vector<CurveSet> m_CurveSets;
+
+		std::vector<MorphMotion> m_MorphMotions;
+		CameraMotion m_CameraMotion;
+	};
+
+	//
+	// Per model state of a shared clip
+	//
+	class MotionBinding
+	{
+	public:
+		// 'findBone' maps the id of a track's name (InternBoneName) to the bone index,
+		// or TrackBinding::kUnbound
+		template <typename FindBone>
+		void Bind( MotionClipPtr clip, const std::vector<OrthogonalTransform>& restPose, FindBone findBone );
+		void Reset( void );
+
+		bool Empty( void ) const { return !m_Clip || m_Clip->Empty(); }
+		const MotionClipPtr& GetClip( void ) const { return m_Clip; }
+		const std::vector<TrackBinding>& GetTracks( void ) const { return m_Tracks; }
+
+		void Sample( float t, OrthogonalTransform* pose );
+
+	private:
+		MotionClipPtr m_Clip;
+		std::vector<TrackBinding> m_Tracks;
+		std::vector<int32_t> m_Cursors; // playback cursor per track
+	};
+
+	template <typename FindBone>
+	void MotionBinding::Bind( MotionClipPtr clip, const std::vector<OrthogonalTransform>& restPose, FindBone findBone )
+	{
+		m_Clip = std::move( clip );
+		const size_t numTracks = m_Clip ? m_Clip->GetTrackCount() : 0;
+		m_Tracks.resize( numTracks );
+		m_Cursors.assign( numTracks, 0 );
+		for (size_t i = 0; i < numTracks; i++)
+		{
+			TrackBinding& binding = m_Tracks[i];
+			binding.Bone = findBone( m_Clip->GetTrackId( i ) );
+			binding.Rest = XMFLOAT3( 0.f, 0.f, 0.f );
+			if (binding.Bone >= 0 && size_t(binding.Bone) < restPose.size())
+				XMStoreFloat3( &binding.Rest, restPose[binding.Bone].GetTranslation() );
+			else
+				binding.Bone = TrackBinding::kUnbound;
+		}
+	}
+}
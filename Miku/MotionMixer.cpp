@@ -0,0 +1,156 @@
+#include "MotionMixer.h"
+
+#include <algorithm>
+
+using namespace Animation;
+
+PosePool& PosePool::GetThreadPool( void )
+{
+	static thread_local PosePool s_Pool;
+	return s_Pool;
+}
+
+OrthogonalTransform* PosePool::Acquire( size_t numBones )
+{
+	if (m_Used == m_Poses.size())
+		m_Poses.emplace_back();
+	auto& pose = m_Poses[m_Used++];
+	if (pose.size() < numBones)
+		pose.resize( numBones );
+	return pose.data();
+}
+
+void PosePool::Release( void )
+{
+	ASSERT( m_Used > 0 );
+	m_Used--;
+}
+
+MotionMixer::MotionMixer() : m_NextId( 0 ), m_Time( 0.f )
+{
+	m_Layers.reserve( kMaxLayers );
+}
+
+void MotionMixer::Clear( void )
+{
+	m_Layers.clear();
+	m_Time = 0.f;
+}
+
+MotionMixer::Layer* MotionMixer::Find( uint32_t id )
+{
+	auto it = std::find_if( m_Layers.begin(), m_Layers.end(), [id]( const Layer& layer ) { return layer.Id == id; } );
+	return it == m_Layers.end() ? nullptr : &*it;
+}
+
+uint32_t MotionMixer::AddLayer( MotionBinding&& binding, EBlendMode mode, float weight, float startFrame )
+{
+	if (m_Layers.size() >= kMaxLayers || binding.Empty())
+		return kInvalidLayer;
+
+	Layer layer;
+	layer.Id = m_NextId++;
+	layer.Mode = mode;
+	layer.Weight = weight;
+	layer.Start = startFrame;
+	layer.FadeStart = 0.f;
+	layer.FadeDuration = 0.f;
+	layer.Binding = std::move( binding );
+	m_Layers.push_back( std::move( layer ) );
+	return m_Layers.back().Id;
+}
+
+void MotionMixer::RemoveLayer( uint32_t id )
+{
+	m_Layers.erase( std::remove_if( m_Layers.begin(), m_Layers.end(),
+		[id]( const Layer& layer ) { return layer.Id == id; } ), m_Layers.end() );
+}
+
+void MotionMixer::SetWeight( uint32_t id, float weight )
+{
+	if (Layer* layer = Find( id ))
+		layer->Weight = weight;
+}
+
+void MotionMixer::SetMask( uint32_t id, const std::vector<float>& mask )
+{
+	if (Layer* layer = Find( id ))
+		layer->Mask = mask;
+}
+
+void MotionMixer::CrossFade( uint32_t id, float duration )
+{
+	if (Layer* layer = Find( id ))
+	{
+		layer->FadeStart = m_Time;
+		layer->FadeDuration = std::max( duration, 0.f );
+	}
+}
+
+void MotionMixer::Evaluate( float t, std::vector<OrthogonalTransform>& pose )
+{
+	m_Time = t;
+
+	// A finished fade of an override layer hides everything below it
+	for (size_t i = 0; i < m_Layers.size(); i++)
+	{
+		Layer& layer = m_Layers[i];
+		if (layer.FadeDuration <= 0.f || t < layer.FadeStart + layer.FadeDuration)
+			continue;
+		layer.FadeDuration = 0.f;
+		if (layer.Mode == kBlendOverride && layer.Mask.empty())
+		{
+			m_Layers.erase( m_Layers.begin(), m_Layers.begin() + i );
+			i = 0;
+		}
+	}
+
+	const size_t numBones = pose.size();
+	PosePool& pool = PosePool::GetThreadPool();
+	for (auto& layer : m_Layers)
+	{
+		float weight = layer.Weight;
+		if (layer.FadeDuration > 0.f)
+			weight *= std::min( std::max( (t - layer.FadeStart) / layer.FadeDuration, 0.f ), 1.f );
+		if (weight <= 0.f)
+			continue;
+
+		const float localTime = t - layer.Start;
+		if (layer.Mode == kBlendOverride && weight >= 1.f && layer.Mask.empty())
+		{
+			// Fully replaces the bones it animates
+			layer.Binding.Sample( localTime, pose.data() );
+			continue;
+		}
+
+		OrthogonalTransform* sample = pool.Acquire( numBones );
+		layer.Binding.Sample( localTime, sample );
+		for (auto& track : layer.Binding.GetTracks())
+		{
+			const int32_t bone = track.Bone;
+			if (bone == TrackBinding::kUnbound)
+				continue;
+			float w = weight;
+			if (!layer.Mask.empty())
+				w *= size_t(bone) < layer.Mask.size() ? layer.Mask[bone] : 0.f;
+			if (w <= 0.f)
+				continue;
+
+			OrthogonalTransform& local = pose[bone];
+			const OrthogonalTransform& target = sample[bone];
+			if (layer.Mode == kBlendOverride)
+			{
+				local.SetTranslation( Lerp( local.GetTranslation(), target.GetTranslation(), Vector3( Scalar( w ) ) ) );
+				local.SetRotation( Slerp( local.GetRotation(), target.GetRotation(), w ) );
+			}
+			else
+			{
+				// Rest rotation of a bone is identity, rest translation is kept in the binding
+				const Vector3 offset = target.GetTranslation() - Vector3( track.Rest );
+				local.SetTranslation( local.GetTranslation() + offset * Scalar( w ) );
+				local.SetRotation( local.GetRotation() * Slerp( Quaternion( kIdentity ), target.GetRotation(), w ) );
+			}
+		}
+		pool.Release();
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include "MotionClip.h"
+
+namespace Animation
+{
+	enum EBlendMode : uint8_t
+	{
+		kBlendOverride = 0, // lerp / slerp from the pose below toward the layer
+		kBlendAdditive, // layer's offset from rest applied on top of the pose below
+	};
+
+	//
+	// Scratch poses handed out in stack order. Buffers grow to the largest skeleton
+	// seen and are reused afterwards, so steady state blending does not allocate.
+	// One pool per thread is shared by all mixers updated on it.
+	//
+	class PosePool
+	{
+	public:
+		PosePool() : m_Used(0) {}
+
+		static PosePool& GetThreadPool( void );
+
+		OrthogonalTransform* Acquire( size_t numBones );
+		void Release( void );
+
+	private:
+		std::vector<std::vector<OrthogonalTransform>> m_Poses;
+		size_t m_Used;
+	};
+
+	//
+	// Stack of motion layers played by one model. Layers are evaluated bottom up:
+	// each samples its clip into a scratch pose and blends onto the result below by
+	// its weight times the per bone mask. Switching dances pushes the new clip and
+	// crossfades to it; the layers below are dropped once it is fully in.
+	//
+	class MotionMixer
+	{
+	public:
+		enum { kMaxLayers = 8 };
+		static const uint32_t kInvalidLayer = ~0u;
+
+		MotionMixer();
+
+		void Clear( void );
+		bool Empty( void ) const { return m_Layers.empty(); }
+		size_t GetLayerCount( void ) const { return m_Layers.size(); }
+		// Frame of the last Evaluate
+		float GetTime( void ) const { return m_Time; }
+
+		// Pushes a layer on top, its clip plays from frame 0 at 'startFrame'.
+		// Returns the layer id, kInvalidLayer when the stack is full
+		uint32_t AddLayer( MotionBinding&& binding, EBlendMode mode, float weight, float startFrame );
+		void RemoveLayer( uint32_t id );
+		void SetWeight( uint32_t id, float weight );
+		// Weight per bone index, multiplied with the layer weight. Empty mask is 1 for all bones
+		void SetMask( uint32_t id, const std::vector<float>& mask );
+		// Fades the layer in over 'duration' frames starting at the last evaluated frame
+		void CrossFade( uint32_t id, float duration );
+
+		// Blends the layers onto 'pose', which holds the base (rest) pose on input.
+		// Bones no layer animates are left as they are
+		void Evaluate( float t, std::vector<OrthogonalTransform>& pose );
+
+	private:
+		struct Layer
+		{
+			uint32_t Id;
+			EBlendMode Mode;
+			float Weight;
+			float Start; // frame the clip's frame 0 plays at
+			float FadeStart;
+			float FadeDuration; // 0 when not fading
+			MotionBinding Binding;
+			std::vector<float> Mask;
+		};
+
+		Layer* Find( uint32_t id );
+
+		std::vector<Layer> m_Layers;
+		uint32_t m_NextId;
+		float m_Time;
+	};
+}
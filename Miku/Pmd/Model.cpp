@@ -150,10 +150,7 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
             bExist = archive->IsExist( unicode );
         }
         if (bExist)
-        {
-            auto ia = archive->GetFile( name );
-            texture = TextureManager::LoadFromMemory( archive->GetKeyName(name).generic_wstring(), ia, bSRGB );
-        }
+            texture = TextureManager::LoadFromArchive( archive, name, bSRGB );
         else
         {
             // If not, try default provided texture in MMD (toon01.bmp)
@@ -184,7 +181,6 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 		attributes[i].Bone_weight = pmd.m_Vertices[i].Bone_weight;
 		attributes[i].Edge_flat = pmd.m_Vertices[i].Edge_flat;
 	}
-	m_VertexMorphedPos = m_VertexPos;
 
 	m_Name = pmd.m_Header.Name;
     m_Indices = pmd.m_Indices;
@@ -280,7 +276,19 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
         m_Bones[i].Position = headPos;
 		m_Bones[i].Translate = headPos - parentPos;
 
-		m_BoneIndex[boneData.Name] = i;
+        //
+        // In PMD Model minIK, maxIK is not manually given.
+        // But, bone name that contains 'knee'('ひざ') has constraint
+        // that can move only in x axis and outer angle (just like human knee)
+        // If this constraint is not given, knee goes forward just like
+        // the following vmd motion. http://www.nicovideo.jp/watch/sm18737664
+        //
+        m_Bones[i].bLimitXAngle = std::wstring::npos != m_Bones[i].Name.find( L"ひざ" );
+
+		const uint32_t nameId = Animation::InternBoneName( boneData.Name );
+		if (nameId >= m_BoneIndex.size())
+			m_BoneIndex.resize( nameId + 1, NameTable::kInvalid );
+		m_BoneIndex[nameId] = i;
 	}
 
     m_Skinning.resize( numBones );
@@ -290,24 +298,47 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 
 	m_IKs = pmd.m_IKs;
 
+	//
+	// Base face holds the rest position of the face vertices, the others hold offsets
+	// indexed into the base face's vertex list
+	//
+	std::vector<XMFLOAT3> basePos = m_VertexPos;
+	if (pmd.m_Faces.size() > 0)
+	{
+		for (auto& vert : pmd.m_Faces[kMorphBase].FaceVertices)
+		{
+			if (vert.Index < basePos.size())
+				basePos[vert.Index] = vert.Position;
+		}
+	}
+	m_Morph.SetBase( basePos );
+
 	m_MorphMotions.resize( pmd.m_Faces.size() );
+	std::vector<uint32_t> indices;
+	std::vector<XMFLOAT3> offsets;
 	for ( auto i = 0; i < pmd.m_Faces.size(); i++ )
 	{
 		auto& morph = pmd.m_Faces[i];
-		m_MorphIndex[morph.Name] = i;
-        auto numVertices = morph.FaceVertices.size();
+		const uint32_t nameId = m_MorphNames.Intern( morph.Name );
+		m_MorphIndex.resize( m_MorphNames.Size() );
+		m_MorphIndex[nameId] = i;
 
-        auto& motion = m_MorphMotions[i];
-        motion.m_MorphVertices.reserve( numVertices );
-        motion.m_MorphVertices.reserve( numVertices );
-		for (auto& vert : morph.FaceVertices)
-        {
-			motion.m_MorphIndices.push_back( vert.Index );
-			motion.m_MorphVertices.push_back( vert.Position );
-        }
+		indices.clear();
+		offsets.clear();
+		if (i != kMorphBase)
+		{
+			auto& baseVertices = pmd.m_Faces[kMorphBase].FaceVertices;
+			for (auto& vert : morph.FaceVertices)
+			{
+				if (vert.Index >= baseVertices.size())
+					continue;
+				indices.push_back( baseVertices[vert.Index].Index );
+				offsets.push_back( vert.Position );
+			}
+		}
+		// Base face is added empty to keep morph indices aligned with m_MorphMotions
+		m_Morph.AddMorph( indices, offsets );
 	}
-    if (m_MorphMotions.size() > 0)
-        m_MorphDelta.resize( m_MorphMotions[kMorphBase].m_MorphIndices.size() );
 
     SetVisualizeSkeleton();
     SetBoundingBox();
@@ -318,60 +349,51 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 
 bool Model::LoadMotion( const std::wstring& motionPath )
 {
-	using namespace std;
 	using namespace Animation;
 
-	Utility::ByteArray ba = Utility::ReadFileSync( motionPath );
-	Utility::ByteStream bs(ba);
-
-	Vmd::VMD vmd;
-	vmd.Fill( bs, m_bRightHand );
-	if (!vmd.IsValid())
+	// Shared with every other model playing the same file
+	MotionClipPtr clip = MotionClip::Load( motionPath, m_bRightHand );
+	if (!clip)
         return false;
 
-    LoadBoneMotion( vmd.BoneFrames );
+    LoadBoneMotion( clip );
+    m_Motion.Clear();
+    m_Motion.AddLayer( BindMotion( clip ), kBlendOverride, 1.f, 0.f );
 
-	for (auto& frame : vmd.FaceFrames)
+	for (auto& source : clip->GetMorphMotions())
 	{
-		MorphKeyFrame key;
-		key.Frame = frame.Frame;
-		key.Weight = frame.Weight;
-		key.Weight = frame.Weight;
+        const uint32_t morphIndex = FindMorph( source.m_Name );
+        WARN_ONCE_IF(morphIndex == NameTable::kInvalid, L"Can't find target morph on model: " + m_ModelPath);
+        if (morphIndex == NameTable::kInvalid)
+            continue;
 
-        WARN_ONCE_IF(m_MorphIndex.count(frame.FaceName) <= 0, L"Can't find target morph on model: " + m_ModelPath);
-        if (m_MorphIndex.count(frame.FaceName) > 0)
-        {
-            auto& motion = m_MorphMotions[m_MorphIndex[frame.FaceName]];
-            motion.m_Name = frame.FaceName;
-            motion.InsertKeyFrame( key );
-        }
+        auto& motion = m_MorphMotions[morphIndex];
+        motion.m_Name = source.m_Name;
+        motion.m_KeyFrames.insert( motion.m_KeyFrames.end(), source.m_KeyFrames.begin(), source.m_KeyFrames.end() );
 	}
 
 	for (auto& face : m_MorphMotions )
 		face.SortKeyFrame();
 
-	for (auto& frame : vmd.CameraFrames)
-	{
-		CameraKeyFrame keyFrame;
-		keyFrame.Frame = frame.Frame;
-		keyFrame.Data.bPerspective = frame.TurnOffPerspective == 0;
-		keyFrame.Data.Distance = frame.Distance;
-		keyFrame.Data.FovY = frame.ViewAngle / XM_PI;
-		keyFrame.Data.Rotation = Quaternion( frame.Rotation.y, frame.Rotation.x, frame.Rotation.z );
-		keyFrame.Data.Position = frame.Position;
+	for (auto& keyFrame : clip->GetCameraMotion().m_KeyFrames)
+		m_CameraMotion.InsertKeyFrame( keyFrame );
+    return true;
+}
 
-		//
-		// http://harigane.at.webry.info/201103/article_1.html
-		//
-		auto interp = reinterpret_cast<const char*>(&frame.Interpolation[0]);
-		float scale = 1.0f / 127.0f;
+uint32_t Model::FindBone( const std::wstring& name ) const
+{
+    return FindBone( Animation::FindBoneName( name ) );
+}
 
-		for (auto i = 0; i < 6; i++)
-			keyFrame.BezierCoeff[i] = Vector4( interp[i], interp[i+2], interp[i+1], interp[i+3] ) * scale;
+uint32_t Model::FindBone( uint32_t nameId ) const
+{
+    return nameId < m_BoneIndex.size() ? m_BoneIndex[nameId] : NameTable::kInvalid;
+}
 
-		m_CameraMotion.InsertKeyFrame( keyFrame );
-	}
-    return true;
+uint32_t Model::FindMorph( const std::wstring& name ) const
+{
+    const uint32_t id = m_MorphNames.Find( name );
+    return id == NameTable::kInvalid ? id : m_MorphIndex[id];
 }
 
 void Model::SetBoneNum( size_t numBones )
@@ -381,40 +403,22 @@ void Model::SetBoneNum( size_t numBones )
 	m_Bones.resize( numBones );
 }
 
-void Model::LoadBoneMotion( const std::vector<Vmd::BoneFrame>& frames )
+void Model::LoadBoneMotion( const Animation::MotionClipPtr& clip )
 {
-    if (frames.size() <= 0)
+    if (clip->Empty())
         return;
 
     int32_t numBones = static_cast<int32_t>(m_Bones.size());
 
-    m_BoneMotions.resize( numBones );
     m_Pose.resize( numBones );
     m_LocalPose.resize( numBones );
     m_toRoot.resize( numBones );
     m_Skinning.resize( numBones );
     m_SkinningDual.resize( numBones );
 
-    for (auto i = 0; i < numBones; i++)
-    {
-        auto& bone = m_Bones[i];
-        auto& meshBone = m_BoneMotions[i];
-
-        meshBone.bLimitXAngle = false;
-
-        //
-        // In PMD Model minIK, maxIK is not manually given.
-        // But, bone name that contains 'knee'('ひざ') has constraint
-        // that can move only in x axis and outer angle (just like human knee)
-        // If this constraint is not given, knee goes forward just like
-        // the following vmd motion. http://www.nicovideo.jp/watch/sm18737664
-        //
-        if (std::string::npos != bone.Name.find( L"ひざ" ))
-            meshBone.bLimitXAngle = true;
-    }
-
     for (auto i = 0; i < m_Bones.size(); i++)
         m_LocalPose[i].SetTranslation( m_Bones[i].Translate );
+    m_LocalPoseDefault = m_LocalPose;
 
     std::vector<OrthogonalTransform> RestPose( numBones );
     for (auto i = 0; i < numBones; i++)
@@ -429,40 +433,40 @@ void Model::LoadBoneMotion( const std::vector<Vmd::BoneFrame>& frames )
 
     for (auto i = 0; i < numBones; i++)
         m_toRoot[i] = ~RestPose[i];
+}
 
-	for (auto& frame : frames)
-	{
-		if ( m_BoneIndex.count( frame.BoneName ) == 0)
-			continue;
-
-		Vector3 BoneTranslate(m_Bones[m_BoneIndex[frame.BoneName]].Translate);
+bool Model::PlayMotion( const std::wstring& motionPath, float fadeFrames )
+{
+	using namespace Animation;
 
-		Animation::BoneKeyFrame key;
-		key.Frame = frame.Frame;
-		key.Local.SetTranslation( Vector3(frame.Offset) + BoneTranslate );
-		key.Local.SetRotation( Quaternion( frame.Rotation ) );
+	if (m_Motion.Empty())
+		return LoadMotion( motionPath );
 
-		//
-		// http://harigane.at.webry.info/201103/article_1.html
-		//
-		// X_x1, Y_x1, Z_x1, R_x1,
-		// X_y1, Y_y1, Z_y1, R_y1,
-		// X_x2, Y_x2, Z_x2, R_x2,
-		// X_y2, Y_y2, Z_y2, R_y2,
-		//
-		// ... (duplicated values)
-		//
-		auto interp = reinterpret_cast<const char*>(&frame.Interpolation[0]);
-		float scale = 1.0f / 127.0f;
-
-		for (auto i = 0; i < 4; i++)
-			key.BezierCoeff[i] = Vector4( interp[i], interp[i+4], interp[i+8], interp[i+12] ) * scale;
+	MotionClipPtr clip = MotionClip::Load( motionPath, m_bRightHand );
+	if (!clip)
+        return false;
 
-		m_BoneMotions[m_BoneIndex[frame.BoneName]].InsertKeyFrame( key );
-	}
+	// New dance starts from its first frame, layers below go away once the fade is over
+	const uint32_t layer = m_Motion.AddLayer( BindMotion( clip ), kBlendOverride, 1.f, m_Motion.GetTime() );
+	if (layer == MotionMixer::kInvalidLayer)
+		return false;
+	m_Motion.CrossFade( layer, fadeFrames );
+    return true;
+}
 
-	for (auto& bone : m_BoneMotions )
-		bone.SortKeyFrame();
+Animation::MotionBinding Model::BindMotion( const Animation::MotionClipPtr& clip ) const
+{
+	// m_LocalPose holds the animated pose once playing
+	std::vector<OrthogonalTransform> restPose( m_Bones.size() );
+	for (auto i = 0; i < m_Bones.size(); i++)
+		restPose[i].SetTranslation( m_Bones[i].Translate );
+
+	Animation::MotionBinding binding;
+	binding.Bind( clip, restPose, [this]( uint32_t nameId ) {
+		const uint32_t boneIndex = FindBone( nameId );
+		return boneIndex == NameTable::kInvalid ? int32_t(Animation::TrackBinding::kUnbound) : static_cast<int32_t>(boneIndex);
+	});
+	return binding;
 }
 
 void Model::SetVisualizeSkeleton()
@@ -498,7 +502,7 @@ void Model::Clear()
 
 void Model::UpdateChildPose( int32_t idx )
 {
-	auto numBone = m_BoneMotions.size();
+	auto numBone = m_Bones.size();
 	auto parentIndex = m_BoneParent[idx];
 
 	if (parentIndex < numBone)
@@ -510,11 +514,12 @@ void Model::UpdateChildPose( int32_t idx )
 
 void Model::Update( float kFrameTime )
 {
-	if (m_BoneMotions.size() > 0)
+	if (!m_Motion.Empty())
 	{
-		size_t numBones = m_BoneMotions.size();
-		for (auto i = 0; i < numBones; i++)
-			m_BoneMotions[i].Interpolate( kFrameTime, m_LocalPose[i] );
+		size_t numBones = m_Bones.size();
+		// Layers blend onto the rest pose, not last frame's (IK solved) pose
+		m_LocalPose = m_LocalPoseDefault;
+		m_Motion.Evaluate( kFrameTime, m_LocalPose );
 
 		for (auto i = 0; i < numBones; i++)
 		{
@@ -541,39 +546,26 @@ void Model::Update( float kFrameTime )
 		//
 		// http://blog.goo.ne.jp/torisu_tetosuki/e/8553151c445d261e122a3a31b0f91110
 		//
-        auto elemByte = sizeof( decltype(m_MorphDelta)::value_type );
-        memset( m_MorphDelta.data(), 0, elemByte*m_MorphDelta.size() );
-
-		bool bUpdate = false;
 		for (auto i = kMorphBase+1; i < m_MorphMotions.size(); i++)
 		{
 			auto& motion = m_MorphMotions[i];
 			motion.Interpolate( kFrameTime );
-			if (std::fabsf( motion.m_WeightPre - motion.m_Weight ) < 0.1e-2)
-				continue;
-			bUpdate = true;
-			auto weight = motion.m_Weight;
-			for (auto k = 0; k < motion.m_MorphVertices.size(); k++)
-			{
-                auto idx = motion.m_MorphIndices[k];
-				m_MorphDelta[idx] += weight * motion.m_MorphVertices[k];
-			}
+			m_Morph.SetWeight( i, motion.m_Weight );
 		}
-		if (bUpdate)
-		{
-            auto& baseFace = m_MorphMotions[kMorphBase];
-			for (auto i = 0; i < m_MorphDelta.size(); i++)
-                m_MorphDelta[i] += baseFace.m_MorphVertices[i];
-
-			for (auto i = 0; i < m_MorphDelta.size(); i++)
-				XMStoreFloat3( &m_VertexMorphedPos[baseFace.m_MorphIndices[i]], m_MorphDelta[i]);
+		// Only the morphs whose weight moved touch their vertices
+		m_Morph.Apply();
+	}
+}
 
-			m_PositionBuffer.Create( m_Name + L"_PosBuf",
-				static_cast<uint32_t>(m_VertexMorphedPos.size()),
-				sizeof( XMFLOAT3 ),
-				m_VertexMorphedPos.data() );
-		}
+void Model::UpdateBuffers( GraphicsContext& gfxContext )
+{
+	const auto& positions = m_Morph.GetPositions();
+	for (auto& range : m_Morph.GetDirtyRanges())
+	{
+		gfxContext.UpdateBuffer( m_PositionBuffer, range.Begin * sizeof( XMFLOAT3 ),
+			&positions[range.Begin], (range.End - range.Begin) * sizeof( XMFLOAT3 ) );
 	}
+	m_Morph.ClearDirty();
 }
 
 //
@@ -631,7 +623,7 @@ void Model::UpdateIK(const IK& ik)
 			auto rotFinish = rotBase * rotNext;
 
 			// Constraint IK, restrict rotation angle
-			if (m_BoneMotions[childIndex].bLimitXAngle)
+			if (m_Bones[childIndex].bLimitXAngle)
 			{
 #ifndef EXPERIMENT_IK
 				// c = cos(theta / 2)
@@ -741,14 +733,14 @@ void Model::DrawBoundingSphere()
 
 BoundingSphere Model::GetBoundingSphere()
 {
-	if (m_BoneMotions.size() > 0)
+	if (!m_Motion.Empty())
         return m_ModelTransform * m_Skinning[m_RootBoneIndex] * m_BoundingSphere;
     return m_ModelTransform * m_BoundingSphere;
 }
 
 BoundingBox Model::GetBoundingBox()
 {
-	if (m_BoneMotions.size() > 0)
+	if (!m_Motion.Empty())
         return m_ModelTransform * m_Skinning[m_RootBoneIndex] * m_BoundingBox;
     return m_ModelTransform * m_BoundingBox;
 }
@@ -8,6 +8,9 @@
 #include "Pmd.h"
 #include "IModel.h"
 #include "KeyFrameAnimation.h"
+#include "MotionMixer.h"
+#include "VertexMorph.h"
+#include "NameTable.h"
 #include "Math/BoundingSphere.h"
 #include "Math/BoundingBox.h"
 
@@ -65,6 +68,7 @@ namespace Pmd {
         uint32_t ChildBoneIndex;
 		Vector3 Position;
 		Vector3 Translate;
+        bool bLimitXAngle; // knee
 	};
 
 	class Model : public IModel
@@ -81,18 +85,26 @@ namespace Pmd {
         BoundingBox GetBoundingBox() override;
         bool LoadModel( ArchivePtr& Archive, Path& FilePath ) override;
 		bool LoadMotion( const std::wstring& motion ) override;
+		bool PlayMotion( const std::wstring& motion, float fadeFrames ) override;
         void SetModel( const std::wstring& model );
         void SetMotion( const std::wstring& model );
         void SetPosition( Vector3 postion );
         void SetBoundingSphere( void );
         void SetBoundingBox( void );
 		void Update( float kFrameTime ) override;
+		void UpdateBuffers( GraphicsContext& gfxContext ) override;
+
+        // Bone or morph index, NameTable::kInvalid when the model has no such name
+        uint32_t FindBone( const std::wstring& name ) const;
+        uint32_t FindBone( uint32_t nameId ) const; // id of Animation::InternBoneName
+        uint32_t FindMorph( const std::wstring& name ) const;
 
 	private:
 
 		void DrawBone( void );
 		void DrawBoundingSphere( void );
-        void LoadBoneMotion( const std::vector<Vmd::BoneFrame>& frames );
+        void LoadBoneMotion( const Animation::MotionClipPtr& clip );
+        Animation::MotionBinding BindMotion( const Animation::MotionClipPtr& clip ) const;
 		void SetBoneNum( size_t numBones );
         void SetVisualizeSkeleton();
 		void UpdateChildPose( int32_t idx );
@@ -107,21 +119,22 @@ namespace Pmd {
 		std::vector<IK> m_IKs;
 		std::vector<OrthogonalTransform> m_toRoot; // inverse inital pose ( inverse Rest)
 		std::vector<OrthogonalTransform> m_LocalPose; // offset matrix
+		std::vector<OrthogonalTransform> m_LocalPoseDefault; // rest pose, input of m_Motion
 		std::vector<OrthogonalTransform> m_Pose; // cumulative transfrom matrix from root
 		std::vector<OrthogonalTransform> m_Skinning; // final skinning transform
 		std::vector<DualQuaternion> m_SkinningDual; // final skinning transform
 		std::vector<int32_t> m_BoneParent; // parent index
 		std::vector<std::vector<int32_t>> m_BoneChild; // child indices
-		std::map<std::wstring, uint32_t> m_BoneIndex;
-		std::map<std::wstring, uint32_t> m_MorphIndex;
-        std::vector<Vector3> m_MorphDelta; // tempolar space to store morphed position delta
-		std::vector<Animation::BoneMotion> m_BoneMotions;
+		std::vector<uint32_t> m_BoneIndex; // bone index by Animation::InternBoneName id, kInvalid if none
+		NameTable m_MorphNames;
+		std::vector<uint32_t> m_MorphIndex; // morph index by name id
+		Animation::MotionMixer m_Motion; // layers of shared bone motion bound to this model's bones
         enum { kMorphBase = 0 };
 		std::vector<Animation::MorphMotion> m_MorphMotions;
+		Animation::VertexMorph m_Morph; // vertex offsets of m_MorphMotions[i] are morph i
 		Animation::CameraMotion m_CameraMotion;
 
 		std::vector<XMFLOAT3> m_VertexPos; // original vertex position
-		std::vector<XMFLOAT3> m_VertexMorphedPos; // temporal vertex positions which affected by face animation
         std::vector<uint16_t> m_Indices;
 
 		VertexBuffer m_AttributeBuffer;
@@ -1,7 +1,6 @@
 ﻿#include "pch.h"
 
-#include <codecvt>
-#include <locale>
+#include <algorithm>
 
 #include "Pmx.h"
 #include "Encoding.h"
@@ -11,27 +10,28 @@
 namespace Pmx
 {
 	using Utility::bufferstream;
+	using Utility::ByteReader;
 	using Utility::sjis_to_utf;
 
-    std::wstring ReadText( bufferstream& is, bool bUtf16 )
+    std::wstring ReadText( ByteReader& is, bool bUtf16 )
     {
         uint32_t len = 0;
         Read( is, len );
-        std::vector<char> buf(len);
-        Read( is, buf );
+        // text is decoded straight from the source buffer
+        const char* buf = is.Skip( len );
+        if (buf == nullptr)
+            return std::wstring();
         if (bUtf16)
         {
-            return std::wstring( (wchar_t*)buf.data(), (wchar_t*)(buf.data() + len) );
+            return std::wstring( (const wchar_t*)buf, len / sizeof(wchar_t) );
         }
         else
         {
-            std::string str( buf.data(), buf.data() + len );
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8conv;
-            return utf8conv.from_bytes( str );
+            return Utility::Utf8ToUtf16( buf, len );
         }
     }
 
-    uint32_t ReadIndexUnsigned( bufferstream& is, uint8_t byteSize )
+    uint32_t ReadIndexUnsigned( ByteReader& is, uint8_t byteSize )
     {
 		uint8_t i8;
 		uint16_t i16;
@@ -52,7 +52,7 @@ namespace Pmx
         return 0;
     }
 
-    int32_t ReadIndex( bufferstream& is, uint8_t byteSize )
+    int32_t ReadIndex( ByteReader& is, uint8_t byteSize )
     {
 		int8_t i8;
 		int16_t i16;
@@ -73,18 +73,18 @@ namespace Pmx
         return 0;
     }
 
-	void Header::Fill( bufferstream& is )
+	void Header::Fill( ByteReader& is )
 	{
 		Read( is, Version );
     }
 
-    void Config::Fill( bufferstream& is )
+    void Config::Fill( ByteReader& is )
     {
         Read( is, Count );
         Read( is, Data, Count );
     }
 
-    void Description::Fill( bufferstream& is, bool bUtf16 )
+    void Description::Fill( ByteReader& is, bool bUtf16 )
     {
 		Name = ReadText( is, bUtf16 );
 		Comment = ReadText( is, bUtf16 );
@@ -92,7 +92,7 @@ namespace Pmx
 		CommentEnglish = ReadText( is, bUtf16 );
     }
 
-	void Vertex::Fill( bufferstream& is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize )
+	void Vertex::Fill( ByteReader& is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize )
 	{
 		ReadPosition( is, Pos, bRH );
 		ReadNormal( is, Normal, bRH );
@@ -119,19 +119,192 @@ namespace Pmx
         Read( is, EdgeSize );
 	}
 
-    void Bdef1Unit::Fill( bufferstream& is, uint8_t byteSize )
+    template <typename IndexType>
+    inline int32_t ReadIndex( ByteReader& is )
+    {
+        IndexType i;
+        Read( is, i );
+        return i;
+    }
+
+    //
+    // Vertex block decoder without per field branch on index size or additional UV count.
+    // Only the skinning type switch is left, as it is stored per vertex.
+    //
+    template <uint8_t NumAddUV, typename IndexType>
+    void DecodeVertices( ByteReader& is, VertexStream& vs, bool bRH )
+    {
+        const size_t count = vs.Size();
+        for (size_t i = 0; i < count; i++)
+        {
+            ReadPosition( is, vs.Pos[i], bRH );
+            ReadNormal( is, vs.Normal[i], bRH );
+            Read( is, vs.UV[i] );
+            for (uint8_t k = 0; k < NumAddUV; k++)
+                Read( is, vs.AddUV[k][i] );
+
+            uint8_t type = Read<uint8_t>( is );
+            vs.SkinningType[i] = type;
+
+            XMINT4& bone = vs.BoneIndex[i];
+            XMFLOAT4& weight = vs.Weight[i];
+            switch (type)
+            {
+            case Vertex::kBdef1:
+                bone = XMINT4( ReadIndex<IndexType>( is ), 0, 0, 0 );
+                weight = XMFLOAT4( 1.f, 0.f, 0.f, 0.f );
+                break;
+            case Vertex::kBdef2:
+            case Vertex::kSdef:
+            {
+                bone.x = ReadIndex<IndexType>( is );
+                bone.y = ReadIndex<IndexType>( is );
+                bone.z = bone.w = 0;
+                float w = Read<float>( is );
+                weight = XMFLOAT4( w, 1.f - w, 0.f, 0.f );
+                if (type == Vertex::kSdef)
+                {
+                    VertexStream::SdefParam param;
+                    Read( is, param );
+                    vs.SdefVertex.push_back( static_cast<uint32_t>(i) );
+                    vs.Sdef.push_back( param );
+                }
+                break;
+            }
+            case Vertex::kBdef4:
+            case Vertex::kQdef:
+                bone.x = ReadIndex<IndexType>( is );
+                bone.y = ReadIndex<IndexType>( is );
+                bone.z = ReadIndex<IndexType>( is );
+                bone.w = ReadIndex<IndexType>( is );
+                Read( is, weight );
+                break;
+            default:
+                is.SetFail();
+                return;
+            }
+            Read( is, vs.EdgeSize[i] );
+        }
+    }
+
+    template <uint8_t NumAddUV>
+    struct VertexDecoder
+    {
+        using Func = void (*)(ByteReader&, VertexStream&, bool);
+        static Func Get( uint8_t boneByteSize )
+        {
+            switch (boneByteSize)
+            {
+            case 1: return &DecodeVertices<NumAddUV, int8_t>;
+            case 2: return &DecodeVertices<NumAddUV, int16_t>;
+            case 4: return &DecodeVertices<NumAddUV, int32_t>;
+            }
+            return nullptr;
+        }
+    };
+
+    void VertexStream::Resize( size_t count, uint8_t numAddUV )
+    {
+        Pos.resize( count );
+        Normal.resize( count );
+        UV.resize( count );
+        for (uint8_t k = 0; k < Vertex::kMaxAddUV; k++)
+            AddUV[k].resize( k < numAddUV ? count : 0 );
+        SkinningType.resize( count );
+        BoneIndex.resize( count );
+        Weight.resize( count );
+        EdgeSize.resize( count );
+        SdefVertex.clear();
+        Sdef.clear();
+    }
+
+    void VertexStream::Clear()
+    {
+        Resize( 0, 0 );
+    }
+
+    bool VertexStream::Fill( ByteReader& is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize )
+    {
+        using Func = void (*)(ByteReader&, VertexStream&, bool);
+        Func decode = nullptr;
+        switch (numAddUV)
+        {
+        case 0: decode = VertexDecoder<0>::Get( boneByteSize ); break;
+        case 1: decode = VertexDecoder<1>::Get( boneByteSize ); break;
+        case 2: decode = VertexDecoder<2>::Get( boneByteSize ); break;
+        case 3: decode = VertexDecoder<3>::Get( boneByteSize ); break;
+        case 4: decode = VertexDecoder<4>::Get( boneByteSize ); break;
+        }
+        if (decode == nullptr)
+        {
+            is.SetFail();
+            return false;
+        }
+        decode( is, *this, bRH );
+        return !is.IsFail();
+    }
+
+    void VertexStream::GetVertex( size_t i, Vertex& vertex ) const
+    {
+        vertex.Pos = Pos[i];
+        vertex.Normal = Normal[i];
+        vertex.UV = UV[i];
+        for (uint8_t k = 0; k < Vertex::kMaxAddUV; k++)
+            vertex.AddUV[k] = AddUV[k].empty() ? XMFLOAT4( 0.f, 0.f, 0.f, 0.f ) : AddUV[k][i];
+        vertex.SkinningType = static_cast<Vertex::ESkiningType>(SkinningType[i]);
+
+        // clear union
+        vertex.sdef = {};
+
+        const XMINT4& bone = BoneIndex[i];
+        const XMFLOAT4& weight = Weight[i];
+        switch (vertex.SkinningType)
+        {
+        case Vertex::kBdef1:
+            vertex.bdef1.BoneIndex = bone.x;
+            break;
+        case Vertex::kBdef2:
+            vertex.bdef2.BoneIndex[0] = bone.x;
+            vertex.bdef2.BoneIndex[1] = bone.y;
+            vertex.bdef2.Weight = weight.x;
+            break;
+        case Vertex::kSdef:
+        {
+            vertex.sdef.BoneIndex[0] = bone.x;
+            vertex.sdef.BoneIndex[1] = bone.y;
+            vertex.sdef.Weight = weight.x;
+            auto it = std::lower_bound( SdefVertex.begin(), SdefVertex.end(), static_cast<uint32_t>(i) );
+            if (it != SdefVertex.end() && *it == i)
+            {
+                const SdefParam& param = Sdef[it - SdefVertex.begin()];
+                memcpy( vertex.sdef.C, &param.C, sizeof(vertex.sdef.C) );
+                memcpy( vertex.sdef.R0, &param.R0, sizeof(vertex.sdef.R0) );
+                memcpy( vertex.sdef.R1, &param.R1, sizeof(vertex.sdef.R1) );
+            }
+            break;
+        }
+        case Vertex::kBdef4:
+        case Vertex::kQdef:
+            memcpy( vertex.bdef4.BoneIndex, &bone, sizeof(vertex.bdef4.BoneIndex) );
+            memcpy( vertex.bdef4.Weight, &weight, sizeof(vertex.bdef4.Weight) );
+            break;
+        }
+        vertex.EdgeSize = EdgeSize[i];
+    }
+
+    void Bdef1Unit::Fill( ByteReader& is, uint8_t byteSize )
     {
         BoneIndex = ReadIndex( is, byteSize );
     }
 
-    void Bdef2Unit::Fill( bufferstream& is, uint8_t byteSize )
+    void Bdef2Unit::Fill( ByteReader& is, uint8_t byteSize )
     {
         BoneIndex[0] = ReadIndex( is, byteSize );
         BoneIndex[1] = ReadIndex( is, byteSize );
         Read( is, Weight );
     }
 
-    void Bdef4Unit::Fill( bufferstream& is, uint8_t byteSize )
+    void Bdef4Unit::Fill( ByteReader& is, uint8_t byteSize )
     {
         BoneIndex[0] = ReadIndex( is, byteSize );
         BoneIndex[1] = ReadIndex( is, byteSize );
@@ -140,7 +313,7 @@ namespace Pmx
         Read( is, Weight );
     }
 
-    void SdefUnit::Fill( bufferstream& is, uint8_t byteSize )
+    void SdefUnit::Fill( ByteReader& is, uint8_t byteSize )
     {
         BoneIndex[0] = ReadIndex( is, byteSize );
         BoneIndex[1] = ReadIndex( is, byteSize );
@@ -150,7 +323,7 @@ namespace Pmx
         Read( is, R1 );
     }
 
-    void QdefUnit::Fill( bufferstream& is, uint8_t byteSize )
+    void QdefUnit::Fill( ByteReader& is, uint8_t byteSize )
     {
         BoneIndex[0] = ReadIndex( is, byteSize );
         BoneIndex[1] = ReadIndex( is, byteSize );
@@ -159,7 +332,7 @@ namespace Pmx
         Read( is, Weight );
     }
 
-	void Material::Fill( bufferstream& is, bool bUtf16, uint8_t textureIndexByteSize )
+	void Material::Fill( ByteReader& is, bool bUtf16, uint8_t textureIndexByteSize )
 	{
         Name = ReadText( is, bUtf16 );
         NameEnglish = ReadText( is, bUtf16 );
@@ -226,7 +399,7 @@ namespace Pmx
         bIK = false;
     }
 
-    void Bone::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t boneIndexByteSize )
+    void Bone::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t boneIndexByteSize )
 	{
         Name = ReadText( is, bUtf16 );
         NameEnglish = ReadText( is, bUtf16 );
@@ -234,6 +407,7 @@ namespace Pmx
 		ParentBoneIndex = ReadIndex( is, boneIndexByteSize );
 		Read( is, MoprhHierarchy );
 		Read( is, BitFlag );
+        bTransformAfterPhysics = (BitFlag & kTransformAfterPhysics) != 0;
 
         // bone has destination
         if (BitFlag & kHasDestinationOriginIndex)
@@ -284,13 +458,12 @@ namespace Pmx
         LimitedRadian = 0.f;
     }
 
-    void IK::Fill( bufferstream& is, bool bRH, uint8_t boneIndexByteSize )
+    void IK::Fill( ByteReader& is, bool bRH, uint8_t boneIndexByteSize )
     {
         BoneIndex = ReadIndex( is, boneIndexByteSize );
         Read( is, NumIteration );
         Read( is, LimitedRadian );
-        uint32_t NumLink;
-        Read( is, NumLink );
+        uint32_t NumLink = is.ReadCount( boneIndexByteSize + 1 );
         Link.resize( NumLink );
         for (auto& l : Link)
             l.Fill( is, bRH, boneIndexByteSize );
@@ -304,7 +477,7 @@ namespace Pmx
         MaxLimit = XMFLOAT3( 0.f, 0.f, 0.f );
     }
 
-    void IkLink::Fill( bufferstream& is, bool bRH, uint8_t boneIndexByteSize )
+    void IkLink::Fill( ByteReader& is, bool bRH, uint8_t boneIndexByteSize )
     {
         BoneIndex = ReadIndex( is, boneIndexByteSize );
         Read( is, bLimit );
@@ -314,19 +487,19 @@ namespace Pmx
         }
     }
 
-    void MorphGroup::Fill( bufferstream& is, uint8_t size )
+    void MorphGroup::Fill( ByteReader& is, uint8_t size )
     {
 		Index = ReadIndex( is, size );
 		Read( is, Weight );
     }
 
-	void MorphVertex::Fill( bufferstream& is, uint8_t size, bool bRH )
+	void MorphVertex::Fill( ByteReader& is, uint8_t size, bool bRH )
 	{
 		VertexIndex = ReadIndex( is, size );
 		ReadPosition( is, Position, bRH );
 	}
 
-    void MorphMaterial::Fill( bufferstream& is, uint8_t size )
+    void MorphMaterial::Fill( ByteReader& is, uint8_t size )
     {
 		MaterialIndex = ReadIndex( is, size );
         Read( is, OffsetOperation );
@@ -341,27 +514,27 @@ namespace Pmx
         Read( is, ToonWeight );
     }
 
-    void MorphBone::Fill( bufferstream& is, uint8_t size, bool bRH )
+    void MorphBone::Fill( ByteReader& is, uint8_t size, bool bRH )
     {
 		BoneIndex = ReadIndex( is, size );
         ReadPosition( is, Translation, bRH );
         ReadRotation( is, Rotation, bRH );
     }
 
-    void MorphUV::Fill( bufferstream& is, uint8_t offset, uint8_t size )
+    void MorphUV::Fill( ByteReader& is, uint8_t offset, uint8_t size )
     {
         Offset = offset;
         VertexIndex = ReadIndex( is, size );
         Read( is, Position );
     }
 
-    void MorphFlip::Fill( bufferstream& is, uint8_t size )
+    void MorphFlip::Fill( ByteReader& is, uint8_t size )
     {
         Index = ReadIndex( is, size );
         Read( is, Value );
     }
 
-    void MorphImpulse::Fill( bufferstream& is, uint8_t size, bool bRH )
+    void MorphImpulse::Fill( ByteReader& is, uint8_t size, bool bRH )
     {
         Index = ReadIndex( is, size );
         uint8_t isLocal;
@@ -371,14 +544,13 @@ namespace Pmx
         ReadRotation( is, AngularTorque, bRH );
     }
 
-    void Morph::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t config[] )
+    void Morph::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t config[] )
     {
 		Name = ReadText( is, bUtf16 );
         NameEnglish = ReadText( is, bUtf16 );
 		Read( is, Panel );
 		Read( is, Type );
-		uint32_t MorphCount;
-		Read( is, MorphCount );
+		uint32_t MorphCount = is.ReadCount( 1 );
         switch (Type)
         {
         case MorphType::kGroup:
@@ -418,7 +590,7 @@ namespace Pmx
         }
     }
 
-    void DisplayElement::Fill( bufferstream& is, uint8_t config[] )
+    void DisplayElement::Fill( ByteReader& is, uint8_t config[] )
     {
         Read( is, Type );
         if (Type == DisplayElementType::kBone)
@@ -429,19 +601,18 @@ namespace Pmx
             ASSERT( FALSE );
     }
 
-    void DisplayFrame::Fill( bufferstream& is, bool bUtf16, uint8_t config[] )
+    void DisplayFrame::Fill( ByteReader& is, bool bUtf16, uint8_t config[] )
     {
         Name = ReadText( is, bUtf16 );
         NameEnglish = ReadText( is, bUtf16 );
         Read( is, Type );
-		uint32_t Count;
-        Read( is, Count );
+		uint32_t Count = is.ReadCount( 1 );
         ElementList.resize( Count );
         for (uint32_t i = 0; i < Count; i++)
             ElementList[i].Fill( is, config );
     }
 
-	void RigidBody::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t boneIndexSize )
+	void RigidBody::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t boneIndexSize )
 	{
         Name = ReadText( is, bUtf16 );
         NameEnglish = ReadText( is, bUtf16 );
@@ -462,7 +633,7 @@ namespace Pmx
         GroupID = uint16_t( 0x0001 << CollisionGroupID );
 	}
 
-    void Joint::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
+    void Joint::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
     {
 		Name = ReadText( is, bUtf16 );
 		NameEnglish = ReadText( is, bUtf16 );
@@ -479,19 +650,31 @@ namespace Pmx
 		Read( is, AngularStiffness );
     }
 
-    void RigidBodyAnchor::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
+    void RigidBodyAnchor::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
     {
         (is), (bRH), (bUtf16), (rigidIndexSize);
         ASSERT( FALSE );
     }
 
-    void SoftBody::Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
+    void SoftBody::Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize )
     {
         (is), (bRH), (bUtf16), (rigidIndexSize);
         ASSERT( FALSE );
     }
 
-    void PMX::Fill( bufferstream& is, bool bRightHand )
+    // Smallest encoded size of each record, used to reject corrupted counts before allocation
+    enum {
+        kMinTextSize = sizeof(uint32_t),
+        kMinVertexSize = sizeof(XMFLOAT3)*2 + sizeof(XMFLOAT2) + 1 + 1 + sizeof(float),
+        kMinMaterialSize = kMinTextSize*3 + 16 + 12 + 4 + 12 + 1 + 16 + 4 + 2 + 1 + 1 + 1 + 4,
+        kMinBoneSize = kMinTextSize*2 + 12 + 1 + 4 + 2 + 1,
+        kMinMorphSize = kMinTextSize*2 + 1 + 1 + 4,
+        kMinFrameSize = kMinTextSize*2 + 1 + 4,
+        kMinRigidBodySize = kMinTextSize*2 + 1 + 1 + 2 + 1 + 12*3 + 4*5 + 1,
+        kMinJointSize = kMinTextSize*2 + 1 + 1*2 + 12*8,
+    };
+
+    void PMX::Fill( ByteReader& is, bool bRightHand )
 	{
         m_IsValid = false;
 
@@ -509,12 +692,22 @@ namespace Pmx
 
         m_Description.Fill( is, isUtf16());
 
-		uint32_t NumVertex = ReadUint( is );
-		m_Vertices.resize( NumVertex );
-		for (uint32_t i = 0; i < NumVertex; i++)
-			m_Vertices[i].Fill( is, bRightHand, GetNumAddUV(), GetByteSize(kBoneIndex) );
+		uint32_t NumVertex = is.ReadCount( kMinVertexSize );
+		m_VertexStream.Resize( NumVertex, GetNumAddUV() );
+		if (!m_VertexStream.Fill( is, bRightHand, GetNumAddUV(), GetByteSize( kBoneIndex ) ))
+		{
+			std::cerr << "invalid pmx vertex." << std::endl;
+			return;
+		}
+		m_Vertices.clear();
+		if (m_bVertexList)
+		{
+			m_Vertices.resize( NumVertex );
+			for (uint32_t i = 0; i < NumVertex; i++)
+				m_VertexStream.GetVertex( i, m_Vertices[i] );
+		}
 
-		uint32_t NumIndices = ReadUint( is );
+		uint32_t NumIndices = is.ReadCount( GetByteSize( kVertIndex ) );
 		m_Indices.resize( NumIndices );
         for (auto& i : m_Indices)
             i = ReadIndexUnsigned( is, GetByteSize( kVertIndex ));
@@ -524,54 +717,70 @@ namespace Pmx
 				std::swap( m_Indices[i], m_Indices[i + 1] );
 		}
 
-        uint32_t NumTexture = ReadUint( is );
+        uint32_t NumTexture = is.ReadCount( sizeof(uint32_t) );
         m_Textures.resize( NumTexture );
         for (auto& t : m_Textures)
             t = ReadText( is, isUtf16() );
 
-		uint32_t NumMaterial = ReadUint( is );
+		uint32_t NumMaterial = is.ReadCount( kMinMaterialSize );
 		m_Materials.resize( NumMaterial );
 		for (uint32_t i = 0; i < NumMaterial; i++)
 			m_Materials[i].Fill( is, isUtf16(), GetByteSize( kTexIndex ) );
 
-		uint32_t NumBones = ReadUint( is );
+		uint32_t NumBones = is.ReadCount( kMinBoneSize );
 		m_Bones.resize( NumBones );
 		for (uint32_t i = 0; i < NumBones; i++)
 			m_Bones[i].Fill( is, bRightHand, isUtf16(), GetByteSize( kBoneIndex ) );
 
-		uint32_t NumMorphs = ReadUint( is );
+		uint32_t NumMorphs = is.ReadCount( kMinMorphSize );
         m_Morphs.resize( NumMorphs );
         for (uint32_t i = 0; i < NumMorphs; i++)
             m_Morphs[i].Fill( is, bRightHand, isUtf16(), m_Config.Data );
 
-		uint32_t NumFrames = ReadUint( is );
+		uint32_t NumFrames = is.ReadCount( kMinFrameSize );
         m_Frames.resize( NumFrames );
         for (uint32_t i = 0; i < NumFrames; i++)
             m_Frames[i].Fill( is, isUtf16(), m_Config.Data );
 
-        uint32_t NumRigidBody;
-        Read( is, NumRigidBody );
+        uint32_t NumRigidBody = is.ReadCount( kMinRigidBodySize );
         m_RigidBodies.resize( NumRigidBody );
         for (uint32_t i = 0; i < NumRigidBody; i++)
             m_RigidBodies[i].Fill( is, bRightHand, isUtf16(), GetByteSize( kBoneIndex ) );
 
-        uint32_t NumJoint;
-        Read( is, NumJoint );
+        uint32_t NumJoint = is.ReadCount( kMinJointSize );
         m_Joints.resize( NumJoint );
         for (uint32_t i = 0; i < NumJoint; i++)
             m_Joints[i].Fill( is, bRightHand, isUtf16(), GetByteSize( kRigidBodyIndex ) );
 
-        if (is.peek() != ios::traits_type::eof())
+        if (!is.IsEnd())
         {
             ASSERT( m_Header.Version >= 2.1f );
             // Version >= 2.1f
-            uint32_t NumSoftBody;
-            Read( is, NumSoftBody );
+            uint32_t NumSoftBody = is.ReadCount( 1 );
             m_SoftBodies.resize( NumSoftBody );
             for (uint32_t i = 0; i < NumJoint; i++)
                 m_SoftBodies[i].Fill( is, bRightHand, isUtf16(), GetByteSize( kRigidBodyIndex ) );
+        }
+        if (is.IsFail())
+        {
+            std::cerr << "truncated pmx file." << std::endl;
+            return;
         }
 		m_IsValid = true;
 	}
+
+    void PMX::Fill( const void* data, size_t size, bool bRightHand )
+    {
+        ByteReader reader( data, size );
+        Fill( reader, bRightHand );
+    }
+
+    void PMX::Fill( bufferstream& is, bool bRightHand )
+    {
+        Utility::FileContainer storage;
+        ByteReader reader = Utility::MakeReader( is, storage );
+        Fill( reader, bRightHand );
+        Utility::Consume( is, reader );
+    }
 }
 
@@ -24,6 +24,7 @@ namespace Pmx
     using DirectX::XMFLOAT2;
     using DirectX::XMFLOAT3;
     using DirectX::XMFLOAT4;
+    using DirectX::XMINT4;
     using namespace Utility;
     using namespace std;
 
@@ -52,7 +53,7 @@ namespace Pmx
     struct Header
     {
         float Version; // (2.0/2.1)
-        void Fill( bufferstream& is );
+        void Fill( ByteReader& is );
     };
 
     struct Config
@@ -60,7 +61,7 @@ namespace Pmx
         uint8_t Count;
         enum { kMaxConfig = 8 };
         uint8_t Data[kMaxConfig];
-        void Fill( bufferstream& is );
+        void Fill( ByteReader& is );
     };
 
     struct Description
@@ -70,24 +71,24 @@ namespace Pmx
         wstring NameEnglish;
         wstring CommentEnglish;
 
-        void Fill( bufferstream& is, bool bUtf16 );
+        void Fill( ByteReader& is, bool bUtf16 );
     };
 
     struct Bdef1Unit {
         int32_t BoneIndex;
-        void Fill( bufferstream& is, uint8_t byteSize );
+        void Fill( ByteReader& is, uint8_t byteSize );
     };
 
     struct Bdef2Unit {
         int32_t BoneIndex[2];
         float Weight;
-        void Fill( bufferstream& is, uint8_t byteSize );
+        void Fill( ByteReader& is, uint8_t byteSize );
     };
 
     struct Bdef4Unit {
         int32_t BoneIndex[4];
         float Weight[4];
-        void Fill( bufferstream& is, uint8_t byteSize );
+        void Fill( ByteReader& is, uint8_t byteSize );
     };
 
     struct SdefUnit {
@@ -96,13 +97,13 @@ namespace Pmx
         float C[3];
         float R0[3];
         float R1[3];
-        void Fill( bufferstream& is, uint8_t byteSize );
+        void Fill( ByteReader& is, uint8_t byteSize );
     };
 
     struct QdefUnit {
         int32_t BoneIndex[4];
         float Weight[4];
-        void Fill( bufferstream& is, uint8_t byteSize );
+        void Fill( ByteReader& is, uint8_t byteSize );
     };
 
     struct Vertex
@@ -126,7 +127,41 @@ namespace Pmx
         };
         float EdgeSize;
 
-        void Fill( bufferstream & is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize );
+        void Fill( ByteReader& is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize );
+    };
+
+    //
+    // Vertex section decoded as structure of arrays.
+    // Bone indices and weights are expanded to 4 entries for every skinning type
+    // (unused entries are bone 0 with weight 0), SDEF parameters are kept aside.
+    //
+    struct VertexStream
+    {
+        struct SdefParam
+        {
+            XMFLOAT3 C;
+            XMFLOAT3 R0;
+            XMFLOAT3 R1;
+        };
+
+        vector<XMFLOAT3> Pos;
+        vector<XMFLOAT3> Normal;
+        vector<XMFLOAT2> UV;
+        vector<XMFLOAT4> AddUV[Vertex::kMaxAddUV];
+        vector<uint8_t> SkinningType; // (Vertex::ESkiningType)
+        vector<XMINT4> BoneIndex;
+        vector<XMFLOAT4> Weight;
+        vector<float> EdgeSize;
+        vector<uint32_t> SdefVertex; // vertex index of each 'Sdef' entry
+        vector<SdefParam> Sdef;
+
+        size_t Size() const { return Pos.size(); }
+        void Resize( size_t count, uint8_t numAddUV );
+        void Clear();
+
+        // Decode whole vertex block. Decoder is picked once by (numAddUV, boneByteSize)
+        bool Fill( ByteReader& is, bool bRH, uint8_t numAddUV, uint8_t boneByteSize );
+        void GetVertex( size_t i, Vertex& vertex ) const;
     };
 
 	enum EMaterialFlag : uint8_t {
@@ -169,7 +204,7 @@ namespace Pmx
         wstring Comment;
         uint32_t NumVertex;
 
-        void Fill( bufferstream & is, bool bUtf16, uint8_t textureByteSize );
+        void Fill( ByteReader& is, bool bUtf16, uint8_t textureByteSize );
     };
 
     struct IkLink
@@ -181,7 +216,7 @@ namespace Pmx
         XMFLOAT3 MaxLimit;
 
         IkLink();
-        void Fill( bufferstream& is, bool bRH, uint8_t boneIndexByteSize );
+        void Fill( ByteReader& is, bool bRH, uint8_t boneIndexByteSize );
     };
 
     struct IK
@@ -192,7 +227,7 @@ namespace Pmx
         std::vector<IkLink> Link;
 
         IK();
-        void Fill( bufferstream& is, bool bRH, uint8_t boneIndexByteSize );
+        void Fill( ByteReader& is, bool bRH, uint8_t boneIndexByteSize );
     };
 
     struct Bone
@@ -203,6 +238,7 @@ namespace Pmx
         int32_t ParentBoneIndex;
         uint32_t MoprhHierarchy; // deform, layer index
         uint16_t BitFlag;
+        bool bTransformAfterPhysics = false;
 
         // Link to
         int32_t DestinationOriginIndex; // if BitFlag & kHasDestinationOriginIndex, given by bone index
@@ -227,7 +263,7 @@ namespace Pmx
         IK Ik;
 
         Bone();
-        void Fill( bufferstream & is, bool bRH, bool bUtf16, uint8_t boneIndexByteSize );
+        void Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t boneIndexByteSize );
     };
 
 	enum class MorphCategory : uint8_t
@@ -258,7 +294,7 @@ namespace Pmx
     {
         uint32_t Index;
         float Weight;
-        void Fill( bufferstream& is, uint8_t size );
+        void Fill( ByteReader& is, uint8_t size );
     };
 
     struct MorphVertex
@@ -266,7 +302,7 @@ namespace Pmx
         uint32_t VertexIndex;
         XMFLOAT3 Position;
 
-        void Fill( bufferstream& is, uint8_t size, bool bRH );
+        void Fill( ByteReader& is, uint8_t size, bool bRH );
     };
 
     struct MorphMaterial
@@ -283,7 +319,7 @@ namespace Pmx
         XMFLOAT4 SphereWeight;
         XMFLOAT4 ToonWeight;
 
-        void Fill( bufferstream& is, uint8_t size );
+        void Fill( ByteReader& is, uint8_t size );
     };
 
     struct MorphBone
@@ -292,7 +328,7 @@ namespace Pmx
         XMFLOAT3 Translation;
         XMFLOAT4 Rotation;
 
-        void Fill( bufferstream& is, uint8_t size, bool bRH );
+        void Fill( ByteReader& is, uint8_t size, bool bRH );
     };
 
     struct MorphUV
@@ -301,7 +337,7 @@ namespace Pmx
         XMFLOAT4 Position;
         uint8_t Offset;
 
-        void Fill( bufferstream& is, uint8_t offset, uint8_t size );
+        void Fill( ByteReader& is, uint8_t offset, uint8_t size );
     };
 
     struct MorphFlip
@@ -309,7 +345,7 @@ namespace Pmx
         uint32_t Index;
         float Value;
 
-        void Fill( bufferstream& is, uint8_t size );
+        void Fill( ByteReader& is, uint8_t size );
     };
 
     struct MorphImpulse
@@ -319,7 +355,7 @@ namespace Pmx
         XMFLOAT3 Velocity;
         XMFLOAT3 AngularTorque;
 
-        void Fill( bufferstream& is, uint8_t size, bool bRH );
+        void Fill( ByteReader& is, uint8_t size, bool bRH );
     };
 
     //
@@ -342,7 +378,7 @@ namespace Pmx
         vector<MorphFlip> FlipList;
         vector<MorphImpulse> ImpulseList;
 
-        void Fill( bufferstream& is, bool bUtf16, bool bRH, uint8_t config[] );
+        void Fill( ByteReader& is, bool bUtf16, bool bRH, uint8_t config[] );
     };
 
     enum class DisplayElementType  : uint8_t
@@ -356,7 +392,7 @@ namespace Pmx
         DisplayElementType Type;
         uint32_t Index;
 
-        void Fill( bufferstream& is, uint8_t config[] );
+        void Fill( ByteReader& is, uint8_t config[] );
     };
 
     struct DisplayFrame
@@ -366,7 +402,7 @@ namespace Pmx
         uint8_t Type;
         vector<DisplayElement> ElementList;
 
-        void Fill( bufferstream& is, bool bUtf16, uint8_t config[] );
+        void Fill( ByteReader& is, bool bUtf16, uint8_t config[] );
     };
 
     enum class RigidBodyShape : uint8_t
@@ -402,7 +438,7 @@ namespace Pmx
         RigidBodyType RigidType;
 
         uint16_t GroupID;
-        void Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t boneIndexSize );
+        void Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t boneIndexSize );
     };
 
 	enum class JointType : uint8_t
@@ -431,7 +467,7 @@ namespace Pmx
         XMFLOAT3 LinearStiffness; // SpringMoveCoefficient (spring move)
         XMFLOAT3 AngularStiffness; // SpringRotationCoefficient (spring rotation)
 
-        void Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize );
+        void Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize );
     };
 
 	enum kSoftBodyFlag : uint8_t
@@ -448,7 +484,7 @@ namespace Pmx
 		int32_t RelatedVertex;
 		bool bNear;
 
-        void Fill( bufferstream& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize );
+        void Fill( ByteReader& is, bool bRH, bool bUtf16, uint8_t rigidIndexSize );
 	};
 
     struct SoftBody
@@ -493,7 +529,7 @@ namespace Pmx
         std::vector<RigidBodyAnchor> Anchors;
         std::vector<int32_t> PinVertices;
 
-        void Fill( bufferstream& is, bool bUtf16, bool bRH, uint8_t rigidIndexSize );
+        void Fill( ByteReader& is, bool bUtf16, bool bRH, uint8_t rigidIndexSize );
     };
 
     // Polygon Model eXtended
@@ -506,16 +542,21 @@ namespace Pmx
 
         // PMX model is defined in left handed coordinate
         // 'bRightHand' flag convert model to right handed coordinate
+        void Fill( ByteReader& is, bool bRightHand );
+        void Fill( const void* data, size_t size, bool bRightHand );
         void Fill( bufferstream& is, bool bRightHand );
 
         bool IsValid( void ) const { return m_IsValid; }
         bool m_IsValid = false;
+        // When cleared only m_VertexStream is filled and m_Vertices is left empty
+        bool m_bVertexList = true;
 
         MagicBuf m_Magic;
         Header m_Header;
         Config m_Config;
         Description m_Description;
         vector<Vertex> m_Vertices;
+        VertexStream m_VertexStream;
         vector<uint32_t> m_Indices;
         vector<wstring> m_Textures;
         vector<Material> m_Materials;
@@ -0,0 +1,70 @@
+#include "BoneSchedule.h"
+
+#include <algorithm>
+#include "Utility.h"
+
+using namespace Graphics::Pmx;
+
+void BoneSchedule::Clear( void )
+{
+    m_TransformOrder.clear();
+    m_TransformTasks.clear();
+    m_TransformLevels.clear();
+    m_PoseSpine.clear();
+    m_PoseTasks.clear();
+}
+
+void BoneSchedule::Build( const std::vector<uint32_t>& subtreeEnd, const std::vector<int32_t>& inherentAfter, uint32_t grain )
+{
+    Clear();
+    const uint32_t numBones = static_cast<uint32_t>(subtreeEnd.size());
+    const uint32_t numInherents = static_cast<uint32_t>(inherentAfter.size());
+    grain = std::max( grain, 1u );
+
+    // An entry goes one level after the one it reads, which comes earlier in the list
+    std::vector<uint32_t> level( numInherents, 0 );
+    uint32_t numLevels = numInherents > 0 ? 1 : 0;
+    for (uint32_t e = 0; e < numInherents; e++)
+    {
+        const int32_t after = inherentAfter[e];
+        ASSERT( after < int32_t(e) );
+        if (after >= 0)
+            level[e] = level[after] + 1;
+        numLevels = std::max( numLevels, level[e] + 1 );
+    }
+
+    std::vector<uint32_t> levelBegin( numLevels + 1, 0 );
+    for (uint32_t e = 0; e < numInherents; e++)
+        levelBegin[level[e] + 1]++;
+    for (uint32_t l = 0; l < numLevels; l++)
+        levelBegin[l + 1] += levelBegin[l];
+    m_TransformOrder.resize( numInherents );
+    std::vector<uint32_t> next( levelBegin.begin(), levelBegin.end() - 1 );
+    for (uint32_t e = 0; e < numInherents; e++)
+        m_TransformOrder[next[level[e]]++] = e;
+
+    for (uint32_t l = 0; l < numLevels; l++)
+    {
+        m_TransformLevels.push_back( static_cast<uint32_t>(m_TransformTasks.size()) );
+        for (uint32_t k = levelBegin[l]; k < levelBegin[l + 1]; k += grain)
+            m_TransformTasks.push_back( { k, std::min( k + grain, levelBegin[l + 1] ) } );
+    }
+    m_TransformLevels.push_back( static_cast<uint32_t>(m_TransformTasks.size()) );
+
+    // Small subtrees are skipped whole, so the spine is every bone above them.
+    // Neighboring subtrees (siblings) share a task while they fit in 'grain'
+    for (uint32_t i = 0; i < numBones;)
+    {
+        const uint32_t end = subtreeEnd[i];
+        if (end - i > grain)
+        {
+            m_PoseSpine.push_back( i++ );
+            continue;
+        }
+        if (!m_PoseTasks.empty() && m_PoseTasks.back().End == i && end - m_PoseTasks.back().Begin <= grain)
+            m_PoseTasks.back().End = end;
+        else
+            m_PoseTasks.push_back( { i, end } );
+        i = end;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+namespace Pmx {
+
+    //
+    // Skeleton update of a model split into tasks that can run at the same time,
+    // giving the same result as the serial loops over the bones.
+    //
+    // PerformTransform goes over the inherent bones of the model (Model::m_Inherents),
+    // an entry reading the local pose its source entry rewrites: entries run level by
+    // level, a level only reading levels before it. UpdatePose reads the parent: bones
+    // with big subtrees (the spine) go first in order, then the subtrees hanging off
+    // them, of at most 'grain' bones each, are independent tasks.
+    //
+    class BoneSchedule
+    {
+    public:
+        struct Range
+        {
+            uint32_t Begin;
+            uint32_t End;
+        };
+
+        void Clear( void );
+        // 'subtreeEnd' as baked (parents first, each subtree contiguous). 'inherentAfter'
+        // is, per inherent entry, the earlier entry it reads, -1 for none
+        void Build( const std::vector<uint32_t>& subtreeEnd, const std::vector<int32_t>& inherentAfter, uint32_t grain );
+
+        // Tasks of level l are [Levels[l], Levels[l + 1]), each a range of TransformOrder,
+        // which holds inherent entries
+        const std::vector<uint32_t>& GetTransformOrder( void ) const { return m_TransformOrder; }
+        const std::vector<Range>& GetTransformTasks( void ) const { return m_TransformTasks; }
+        const std::vector<uint32_t>& GetTransformLevels( void ) const { return m_TransformLevels; }
+
+        // Bones updated in order before the tasks
+        const std::vector<uint32_t>& GetPoseSpine( void ) const { return m_PoseSpine; }
+        // Bone ranges, each of whole subtrees
+        const std::vector<Range>& GetPoseTasks( void ) const { return m_PoseTasks; }
+
+    private:
+        std::vector<uint32_t> m_TransformOrder;
+        std::vector<Range> m_TransformTasks;
+        std::vector<uint32_t> m_TransformLevels;
+        std::vector<uint32_t> m_PoseSpine;
+        std::vector<Range> m_PoseTasks;
+    };
+} // namespace Pmx
+} // namespace Graphics
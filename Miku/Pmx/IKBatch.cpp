@@ -0,0 +1,394 @@
+#include "IKBatch.h"
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+using namespace DirectX;
+using namespace Graphics;
+using namespace Graphics::Pmx;
+
+namespace
+{
+    using VectorLanes = IKBatch::VectorLanes;
+    using QuaternionLanes = IKBatch::QuaternionLanes;
+    using TransformLanes = IKBatch::TransformLanes;
+
+    // Lane masks are all ones or all zeros, the sign bits tell them apart
+    bool Any( FXMVECTOR mask )
+    {
+        return _mm_movemask_ps( mask ) != 0;
+    }
+
+    VectorLanes Add( const VectorLanes& a, const VectorLanes& b )
+    {
+        return { XMVectorAdd( a.X, b.X ), XMVectorAdd( a.Y, b.Y ), XMVectorAdd( a.Z, b.Z ) };
+    }
+
+    VectorLanes Subtract( const VectorLanes& a, const VectorLanes& b )
+    {
+        return { XMVectorSubtract( a.X, b.X ), XMVectorSubtract( a.Y, b.Y ), XMVectorSubtract( a.Z, b.Z ) };
+    }
+
+    VectorLanes Scale( const VectorLanes& v, FXMVECTOR s )
+    {
+        return { XMVectorMultiply( v.X, s ), XMVectorMultiply( v.Y, s ), XMVectorMultiply( v.Z, s ) };
+    }
+
+    XMVECTOR Dot( const VectorLanes& a, const VectorLanes& b )
+    {
+        return XMVectorMultiplyAdd( a.Z, b.Z, XMVectorMultiplyAdd( a.Y, b.Y, XMVectorMultiply( a.X, b.X ) ) );
+    }
+
+    VectorLanes Cross( const VectorLanes& a, const VectorLanes& b )
+    {
+        return {
+            XMVectorSubtract( XMVectorMultiply( a.Y, b.Z ), XMVectorMultiply( a.Z, b.Y ) ),
+            XMVectorSubtract( XMVectorMultiply( a.Z, b.X ), XMVectorMultiply( a.X, b.Z ) ),
+            XMVectorSubtract( XMVectorMultiply( a.X, b.Y ), XMVectorMultiply( a.Y, b.X ) ) };
+    }
+
+    XMVECTOR Length( const VectorLanes& v )
+    {
+        return XMVectorSqrt( Dot( v, v ) );
+    }
+
+    VectorLanes Normalize( const VectorLanes& v )
+    {
+        const XMVECTOR length = Length( v );
+        return { XMVectorDivide( v.X, length ), XMVectorDivide( v.Y, length ), XMVectorDivide( v.Z, length ) };
+    }
+
+    VectorLanes Select( const VectorLanes& a, const VectorLanes& b, FXMVECTOR mask )
+    {
+        return { XMVectorSelect( a.X, b.X, mask ), XMVectorSelect( a.Y, b.Y, mask ), XMVectorSelect( a.Z, b.Z, mask ) };
+    }
+
+    QuaternionLanes Select( const QuaternionLanes& a, const QuaternionLanes& b, FXMVECTOR mask )
+    {
+        return { XMVectorSelect( a.X, b.X, mask ), XMVectorSelect( a.Y, b.Y, mask ),
+            XMVectorSelect( a.Z, b.Z, mask ), XMVectorSelect( a.W, b.W, mask ) };
+    }
+
+    TransformLanes Select( const TransformLanes& a, const TransformLanes& b, FXMVECTOR mask )
+    {
+        return { Select( a.Rotation, b.Rotation, mask ), Select( a.Translation, b.Translation, mask ) };
+    }
+
+    QuaternionLanes Conjugate( const QuaternionLanes& q )
+    {
+        return { XMVectorNegate( q.X ), XMVectorNegate( q.Y ), XMVectorNegate( q.Z ), q.W };
+    }
+
+    // a * b as Math::Quaternion does: b, then a
+    QuaternionLanes Multiply( const QuaternionLanes& a, const QuaternionLanes& b )
+    {
+        QuaternionLanes q;
+        q.X = XMVectorMultiply( a.W, b.X );
+        q.X = XMVectorMultiplyAdd( a.X, b.W, q.X );
+        q.X = XMVectorMultiplyAdd( a.Y, b.Z, q.X );
+        q.X = XMVectorNegativeMultiplySubtract( a.Z, b.Y, q.X );
+        q.Y = XMVectorMultiply( a.W, b.Y );
+        q.Y = XMVectorNegativeMultiplySubtract( a.X, b.Z, q.Y );
+        q.Y = XMVectorMultiplyAdd( a.Y, b.W, q.Y );
+        q.Y = XMVectorMultiplyAdd( a.Z, b.X, q.Y );
+        q.Z = XMVectorMultiply( a.W, b.Z );
+        q.Z = XMVectorMultiplyAdd( a.X, b.Y, q.Z );
+        q.Z = XMVectorNegativeMultiplySubtract( a.Y, b.X, q.Z );
+        q.Z = XMVectorMultiplyAdd( a.Z, b.W, q.Z );
+        q.W = XMVectorMultiply( a.W, b.W );
+        q.W = XMVectorNegativeMultiplySubtract( a.X, b.X, q.W );
+        q.W = XMVectorNegativeMultiplySubtract( a.Y, b.Y, q.W );
+        q.W = XMVectorNegativeMultiplySubtract( a.Z, b.Z, q.W );
+        return q;
+    }
+
+    VectorLanes Rotate( const QuaternionLanes& q, const VectorLanes& v )
+    {
+        const VectorLanes u = { q.X, q.Y, q.Z };
+        const VectorLanes t = Scale( Cross( u, v ), XMVectorReplicate( 2.f ) );
+        return Add( Add( v, Scale( t, q.W ) ), Cross( u, t ) );
+    }
+
+    TransformLanes Multiply( const TransformLanes& a, const TransformLanes& b )
+    {
+        return { Multiply( a.Rotation, b.Rotation ), Add( Rotate( a.Rotation, b.Translation ), a.Translation ) };
+    }
+
+    // As Math::Quaternion::Euler, (roll, pitch, yaw)
+    VectorLanes Euler( const QuaternionLanes& q )
+    {
+        const XMVECTOR one = XMVectorReplicate( 1.f ), two = XMVectorReplicate( 2.f );
+        const XMVECTOR ysqr = XMVectorMultiply( q.Y, q.Y );
+        const XMVECTOR t0 = XMVectorMultiply( two, XMVectorMultiplyAdd( q.W, q.X, XMVectorMultiply( q.Y, q.Z ) ) );
+        const XMVECTOR t1 = XMVectorNegativeMultiplySubtract( two, XMVectorMultiplyAdd( q.X, q.X, ysqr ), one );
+        XMVECTOR t2 = XMVectorMultiply( two, XMVectorSubtract( XMVectorMultiply( q.W, q.Y ), XMVectorMultiply( q.Z, q.X ) ) );
+        t2 = XMVectorClamp( t2, XMVectorNegate( one ), one );
+        const XMVECTOR t3 = XMVectorMultiply( two, XMVectorMultiplyAdd( q.W, q.Z, XMVectorMultiply( q.X, q.Y ) ) );
+        const XMVECTOR t4 = XMVectorNegativeMultiplySubtract( two, XMVectorMultiplyAdd( q.Z, q.Z, ysqr ), one );
+        return { XMVectorATan2( t0, t1 ), XMVectorASin( t2 ), XMVectorATan2( t3, t4 ) };
+    }
+
+    // As XMQuaternionRotationRollPitchYaw( pitch = X, yaw = Y, roll = Z )
+    QuaternionLanes RollPitchYaw( const VectorLanes& angles )
+    {
+        const XMVECTOR half = XMVectorReplicate( 0.5f );
+        XMVECTOR sp, cp, sy, cy, sr, cr;
+        XMVectorSinCos( &sp, &cp, XMVectorMultiply( angles.X, half ) );
+        XMVectorSinCos( &sy, &cy, XMVectorMultiply( angles.Y, half ) );
+        XMVectorSinCos( &sr, &cr, XMVectorMultiply( angles.Z, half ) );
+        const XMVECTOR cycr = XMVectorMultiply( cy, cr ), sysr = XMVectorMultiply( sy, sr );
+        const XMVECTOR sycr = XMVectorMultiply( sy, cr ), cysr = XMVectorMultiply( cy, sr );
+        QuaternionLanes q;
+        q.X = XMVectorMultiplyAdd( sp, cycr, XMVectorMultiply( cp, sysr ) );
+        q.Y = XMVectorNegativeMultiplySubtract( sp, cysr, XMVectorMultiply( cp, sycr ) );
+        q.Z = XMVectorNegativeMultiplySubtract( sp, sycr, XMVectorMultiply( cp, cysr ) );
+        q.W = XMVectorMultiplyAdd( cp, cycr, XMVectorMultiply( sp, sysr ) );
+        return q;
+    }
+
+    // One float each, so lanes of a block can be written from different threads
+    void SetLane( XMVECTOR& v, uint32_t lane, float value )
+    {
+        reinterpret_cast<float*>(&v)[lane] = value;
+    }
+
+    float GetLane( const XMVECTOR& v, uint32_t lane )
+    {
+        return reinterpret_cast<const float*>(&v)[lane];
+    }
+
+    void SetLane( VectorLanes& v, uint32_t lane, Vector3 value )
+    {
+        SetLane( v.X, lane, value.GetX() );
+        SetLane( v.Y, lane, value.GetY() );
+        SetLane( v.Z, lane, value.GetZ() );
+    }
+
+    void SetLane( TransformLanes& v, uint32_t lane, const OrthogonalTransform& value )
+    {
+        const Quaternion rotation = value.GetRotation();
+        SetLane( v.Rotation.X, lane, rotation.GetX() );
+        SetLane( v.Rotation.Y, lane, rotation.GetY() );
+        SetLane( v.Rotation.Z, lane, rotation.GetZ() );
+        SetLane( v.Rotation.W, lane, rotation.GetW() );
+        SetLane( v.Translation, lane, value.GetTranslation() );
+    }
+
+    TransformLanes IdentityLanes()
+    {
+        const XMVECTOR zero = XMVectorZero(), one = XMVectorReplicate( 1.f );
+        return { { zero, zero, zero, one }, { zero, zero, zero } };
+    }
+}
+
+void IKBatch::Clear( void )
+{
+    for (auto& group : m_Groups)
+        group.NumLanes = 0;
+}
+
+bool IKBatch::IsSameShape( const IKChain& a, const IKChain& b )
+{
+    return a.Parent == b.Parent && a.bDirect == b.bDirect
+        && a.LinkEntry == b.LinkEntry && a.TargetEntry == b.TargetEntry;
+}
+
+IKLane IKBatch::Reserve( const IKAttr& ik )
+{
+    uint32_t g = 0;
+    while (g < m_Groups.size() && !IsSameShape( m_Groups[g].Shape, ik.Chain ))
+        g++;
+    if (g == m_Groups.size())
+    {
+        m_Groups.emplace_back();
+        Group& group = m_Groups.back();
+        group.Shape = ik.Chain;
+        group.NumLanes = 0;
+        const size_t numEntries = group.Shape.Parent.size();
+        group.EntryEnd.assign( numEntries, 0 );
+        for (size_t f = numEntries; f-- > 0;)
+        {
+            const int32_t parent = group.Shape.Parent[f];
+            group.EntryEnd[f] = std::max( group.EntryEnd[f], uint32_t(f + 1) );
+            if (parent >= 0)
+                group.EntryEnd[parent] = std::max( group.EntryEnd[parent], group.EntryEnd[f] );
+        }
+    }
+
+    Group& group = m_Groups[g];
+    const uint32_t index = group.NumLanes++;
+    const uint32_t block = index / kLanes;
+    if (index % kLanes == 0)
+    {
+        if (block >= group.NumIteration.size())
+        {
+            const size_t numBlocks = block + 1;
+            const size_t numEntries = group.Shape.Parent.size();
+            const size_t numLinks = group.Shape.LinkEntry.size();
+            const VectorLanes zero = { XMVectorZero(), XMVectorZero(), XMVectorZero() };
+            group.Local.resize( numBlocks * numEntries, IdentityLanes() );
+            group.Offset.resize( numBlocks * numEntries, IdentityLanes() );
+            group.World.resize( numBlocks * numEntries, IdentityLanes() );
+            group.MinLimit.resize( numBlocks * numLinks, zero );
+            group.MaxLimit.resize( numBlocks * numLinks, zero );
+            group.bLimit.resize( numBlocks * numLinks, XMVectorFalseInt() );
+            group.IKPosition.resize( numBlocks, zero );
+            group.LimitedRadian.resize( numBlocks, XMVectorZero() );
+            group.NumIteration.resize( numBlocks, XMVectorZero() );
+            group.Moved.resize( numBlocks, XMVectorFalseInt() );
+        }
+        // Lanes left unset never iterate
+        group.NumIteration[block] = XMVectorZero();
+    }
+    return { g, index };
+}
+
+void IKBatch::Set( IKLane lane, const IKAttr& ik, Vector3 ikPosition, const std::vector<OrthogonalTransform>& localPose,
+    const OrthogonalTransform* world, const OrthogonalTransform* offset )
+{
+    Group& group = m_Groups[lane.Group];
+    const uint32_t block = lane.Index / kLanes, i = lane.Index % kLanes;
+    const IKChain& chain = ik.Chain;
+    const size_t numEntries = chain.Bone.size();
+    const size_t numLinks = ik.Link.size();
+    for (size_t e = 0; e < numEntries; e++)
+    {
+        SetLane( group.Local[block * numEntries + e], i, localPose[chain.Bone[e]] );
+        SetLane( group.Offset[block * numEntries + e], i, offset[e] );
+        SetLane( group.World[block * numEntries + e], i, world[e] );
+    }
+    for (size_t k = 0; k < numLinks; k++)
+    {
+        const IKChild& link = ik.Link[k];
+        SetLane( group.MinLimit[block * numLinks + k], i, Vector3( link.MinLimit ) );
+        SetLane( group.MaxLimit[block * numLinks + k], i, Vector3( link.MaxLimit ) );
+        reinterpret_cast<uint32_t*>(&group.bLimit[block * numLinks + k])[i] = link.bLimit ? ~0u : 0u;
+    }
+    SetLane( group.IKPosition[block], i, ikPosition );
+    SetLane( group.LimitedRadian[block], i, ik.LimitedRadian );
+    SetLane( group.NumIteration[block], i, float( ik.NumIteration ) );
+}
+
+void IKBatch::Solve( bool bParallel )
+{
+    m_Blocks.clear();
+    for (uint32_t g = 0; g < m_Groups.size(); g++)
+    {
+        const uint32_t numBlocks = (m_Groups[g].NumLanes + kLanes - 1) / kLanes;
+        for (uint32_t b = 0; b < numBlocks; b++)
+            m_Blocks.push_back( { g, b } );
+    }
+    if (bParallel)
+    {
+        Utility::GetThreadPool().ParallelFor( m_Blocks.size(), [this]( size_t i ) {
+            SolveBlock( m_Groups[m_Blocks[i].Group], m_Blocks[i].Index );
+        } );
+    }
+    else
+    {
+        for (auto& block : m_Blocks)
+            SolveBlock( m_Groups[block.Group], block.Index );
+    }
+}
+
+//
+// Model::SolveIK on 4 lanes. Where a lane of the scalar solve returns, its lane here
+// leaves 'active'; where it skips a link, the lane is left out of 'rotate'
+//
+void IKBatch::SolveBlock( Group& group, uint32_t block )
+{
+    const IKChain& shape = group.Shape;
+    const size_t numEntries = shape.Parent.size();
+    const size_t numLinks = shape.LinkEntry.size();
+    TransformLanes* local = &group.Local[block * numEntries];
+    const TransformLanes* offset = &group.Offset[block * numEntries];
+    TransformLanes* world = &group.World[block * numEntries];
+    const VectorLanes* minLimit = &group.MinLimit[block * numLinks];
+    const VectorLanes* maxLimit = &group.MaxLimit[block * numLinks];
+    const XMVECTOR* bLimit = &group.bLimit[block * numLinks];
+    const VectorLanes ikPosition = group.IKPosition[block];
+    const XMVECTOR limitedRadian = group.LimitedRadian[block];
+    const XMVECTOR numIteration = group.NumIteration[block];
+    const XMVECTOR epsilon = XMVectorReplicate( 0.0001f );
+
+    XMVECTOR active = XMVectorTrueInt();
+    XMVECTOR moved = XMVectorFalseInt();
+    for (float n = 0.f; ; n += 1.f)
+    {
+        active = XMVectorAndInt( active, XMVectorLess( XMVectorReplicate( n ), numIteration ) );
+        if (!Any( active ))
+            break;
+        for (size_t k = 0; k < numLinks; k++)
+        {
+            const uint32_t e = shape.LinkEntry[k];
+            const VectorLanes target = world[shape.TargetEntry].Translation;
+            active = XMVectorAndInt( active, XMVectorGreaterOrEqual( Length( Subtract( ikPosition, target ) ), epsilon ) );
+
+            // Link's local frame, translation drops out after normalize
+            const QuaternionLanes toLink = Conjugate( world[e].Rotation );
+            const VectorLanes linkPosition = world[e].Translation;
+            const VectorLanes src = Normalize( Rotate( toLink, Subtract( target, linkPosition ) ) );
+            const VectorLanes dst = Normalize( Rotate( toLink, Subtract( ikPosition, linkPosition ) ) );
+            active = XMVectorAndInt( active, XMVectorGreaterOrEqual( Length( Subtract( src, dst ) ), epsilon ) );
+            if (!Any( active ))
+                break;
+
+            const XMVECTOR angle = XMVectorMin( limitedRadian, XMVectorACos( Dot( dst, src ) ) );
+            const XMVECTOR rotate = XMVectorAndInt( active, XMVectorGreaterOrEqual( angle, epsilon ) );
+            if (!Any( rotate ))
+                continue;
+
+            const VectorLanes axis = Normalize( Cross( src, dst ) );
+            XMVECTOR s, c;
+            XMVectorSinCos( &s, &c, XMVectorMultiply( angle, XMVectorReplicate( 0.5f ) ) );
+            QuaternionLanes q0 = { XMVectorMultiply( axis.X, s ), XMVectorMultiply( axis.Y, s ), XMVectorMultiply( axis.Z, s ), c };
+
+            const XMVECTOR limit = XMVectorAndInt( rotate, bLimit[k] );
+            if (Any( limit ))
+            {
+                // due to rightHand min, max is swap needed
+                const VectorLanes euler = Euler( q0 );
+                const VectorLanes clamped = {
+                    XMVectorMin( XMVectorMax( euler.X, maxLimit[k].X ), minLimit[k].X ),
+                    XMVectorMin( XMVectorMax( euler.Y, maxLimit[k].Y ), minLimit[k].Y ),
+                    XMVectorMin( XMVectorMax( euler.Z, maxLimit[k].Z ), minLimit[k].Z ) };
+                q0 = Select( q0, RollPitchYaw( clamped ), limit );
+            }
+
+            local[e].Rotation = Select( local[e].Rotation, Multiply( q0, local[e].Rotation ), rotate );
+            moved = XMVectorOrInt( moved, rotate );
+
+            // The link and the chain entries below it
+            for (uint32_t f = e; f < group.EntryEnd[e]; f++)
+            {
+                const int32_t parent = shape.Parent[f];
+                TransformLanes next;
+                if (parent >= 0 && shape.bDirect[f])
+                    next = Multiply( world[parent], local[f] );
+                else if (parent >= 0)
+                    next = Multiply( Multiply( world[parent], offset[f] ), local[f] );
+                else
+                    next = Multiply( offset[f], local[f] );
+                world[f] = Select( world[f], next, rotate );
+            }
+        }
+    }
+    group.Moved[block] = moved;
+}
+
+bool IKBatch::Get( IKLane lane, const IKAttr& ik, std::vector<OrthogonalTransform>& localPose ) const
+{
+    const Group& group = m_Groups[lane.Group];
+    const uint32_t block = lane.Index / kLanes, i = lane.Index % kLanes;
+    if (reinterpret_cast<const uint32_t*>(&group.Moved[block])[i] == 0)
+        return false;
+
+    const size_t numEntries = ik.Chain.Bone.size();
+    for (size_t k = 0; k < ik.Link.size(); k++)
+    {
+        const QuaternionLanes& rotation = group.Local[block * numEntries + ik.Chain.LinkEntry[k]].Rotation;
+        localPose[ik.Link[k].BoneIndex].SetRotation( Quaternion(
+            GetLane( rotation.X, i ), GetLane( rotation.Y, i ), GetLane( rotation.Z, i ), GetLane( rotation.W, i ) ) );
+    }
+    return true;
+}
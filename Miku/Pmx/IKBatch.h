@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <DirectXMath.h>
+#include "Model.h"
+
+namespace Graphics {
+namespace Pmx {
+
+    //
+    // CCD IK of many models solved together. Chains of the same shape (entries and how
+    // they hang off each other, see IKChain) share a group, whatever model they come
+    // from, and a group is solved 4 chains at a time: every value is kept as one SSE
+    // register per component holding it for 4 chains, so each step of Model::SolveIK
+    // runs on 4 lanes at once. A lane that reached its target or ran out of iterations
+    // is masked off, the others go on.
+    //
+    // The build targets AVX2, but lanes stay 4 wide: a block runs until its slowest
+    // chain is done, so 8 lanes idle more, scenes rarely hold 8 chains of one shape,
+    // and the solve needs ACos, ASin, ATan2 and SinCos, which DirectXMath only has
+    // for 4 lanes.
+    //
+    // Used in rounds: Clear, Reserve a lane per chain, Set the lanes (lanes are
+    // disjoint, so from any thread), Solve, then read the rotations back with Get.
+    //
+    class IKBatch
+    {
+    public:
+        enum { kLanes = 4 };
+
+        struct VectorLanes
+        {
+            DirectX::XMVECTOR X, Y, Z;
+        };
+
+        struct QuaternionLanes
+        {
+            DirectX::XMVECTOR X, Y, Z, W;
+        };
+
+        struct TransformLanes
+        {
+            QuaternionLanes Rotation;
+            VectorLanes Translation;
+        };
+
+        // Forgets the lanes, keeps the groups and their memory for the next round
+        void Clear( void );
+        IKLane Reserve( const IKAttr& ik );
+        // State of the chain at the start of the solve: 'world' and 'offset' per chain
+        // entry as Model::BeginIK makes them, local pose per bone
+        void Set( IKLane lane, const IKAttr& ik, Vector3 ikPosition, const std::vector<OrthogonalTransform>& localPose,
+            const OrthogonalTransform* world, const OrthogonalTransform* offset );
+        void Solve( bool bParallel );
+        // Writes the solved rotations of the links to 'localPose'. Returns whether any rotated
+        bool Get( IKLane lane, const IKAttr& ik, std::vector<OrthogonalTransform>& localPose ) const;
+
+        size_t GetGroupCount( void ) const { return m_Groups.size(); }
+
+    private:
+        struct Group
+        {
+            IKChain Shape;
+            std::vector<uint32_t> EntryEnd; // entries below entry e are (e, EntryEnd[e])
+            uint32_t NumLanes;
+            // [block * entries + e]
+            std::vector<TransformLanes> Local, Offset, World;
+            // [block * links + k]
+            std::vector<VectorLanes> MinLimit, MaxLimit;
+            std::vector<DirectX::XMVECTOR> bLimit; // lane mask
+            // [block]
+            std::vector<VectorLanes> IKPosition;
+            std::vector<DirectX::XMVECTOR> LimitedRadian, NumIteration;
+            std::vector<DirectX::XMVECTOR> Moved; // lane mask, result of Solve
+        };
+
+        static bool IsSameShape( const IKChain& a, const IKChain& b );
+        static void SolveBlock( Group& group, uint32_t block );
+
+        std::vector<Group> m_Groups;
+        std::vector<IKLane> m_Blocks; // group and block of each block to solve
+    };
+} // namespace Pmx
+} // namespace Graphics
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <functional>
 #include <DirectXMath.h>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -16,12 +18,37 @@
 #include "Encoding.h"
 #include "ModelBase.h"
 #include "CommandContext.h"
+#include "EngineTuning.h"
+#include "ModelCache.h"
+#include "IKBatch.h"
+#include "ThreadPool.h"
 #include "..\Pmd\Model.h"
 
 using namespace DirectX;
 using namespace Graphics;
 using namespace Graphics::Pmx;
 
+namespace Graphics {
+namespace Pmx {
+    BoolVar s_bModelCache( "Application/Model/Model Cache", true );
+    BoolVar s_bParallelSkeleton( "Application/Animation/Parallel Skeleton", true );
+
+    // Rigs from this size update their skeleton on the thread pool, in tasks of
+    // about kBoneGrain bones
+    const size_t kParallelBones = 256;
+    const uint32_t kBoneGrain = 64;
+
+    // Runs body( 0 ) .. body( count - 1 ), on the thread pool when there is more than one
+    static void RunTasks( size_t count, const std::function<void(size_t)>& body )
+    {
+        if (count == 1)
+            body( 0 );
+        else if (count > 1)
+            Utility::GetThreadPool().ParallelFor( count, body );
+    }
+}
+}
+
 template <typename T>
 size_t GetVectorSize(const std::vector<T>& vec)
 {
@@ -40,7 +67,9 @@ bool Mesh::SetTexture( GraphicsContext& gfxContext )
     return false;
 }
 
-Model::Model( bool bRightHand ) : m_bRightHand( bRightHand ), m_ModelTransform(kIdentity)
+Model::Model( bool bRightHand ) : m_bRightHand( bRightHand ), m_ModelTransform(kIdentity),
+    m_Lod( AnimationLod::Full() ), m_LodStart( -1.f ), m_LodTarget( -1.f ),
+    m_bEvaluated( false ), m_bSkinning( false ), m_bSolveIK( false ), m_IKLane()
 {
 }
 
@@ -53,14 +82,33 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 {
     using namespace ::Pmx;
 
-	auto ba = Archive->GetFile( FilePath );
-    Utility::ByteStream bs( ba );
+    // Precompiled model is kept next to the source, so only plain files are cached
+    const bool bUseCache = s_bModelCache && Archive->GetType() == kArchiveFile;
+    const std::wstring sourcePath = Archive->GetKeyName( FilePath ).generic_wstring();
+    const std::wstring cachePath = ModelCache::GetCachePath( sourcePath );
 
-	PMX pmx;
-	pmx.Fill( bs, m_bRightHand );
-    if (!pmx.IsValid())
-        return false;
+    ModelCache cache;
+    Utility::ByteArray ba;
+    if (!bUseCache || !cache.Open( cachePath, sourcePath, m_bRightHand, ba ))
+    {
+        if (!ba)
+            ba = Archive->GetFile( FilePath );
+
+        PMX pmx;
+        pmx.m_bVertexList = false;
+        pmx.Fill( ba->data(), ba->size(), m_bRightHand );
+        if (!pmx.IsValid())
+            return false;
+
+        cache.Bake( pmx, m_bRightHand, sourcePath, ba );
+        if (bUseCache && !cache.Save( cachePath ))
+            Utility::Printf( L"Failed to write model cache '%ws'\n", cachePath.c_str() );
+    }
+    return LoadBakedModel( Archive, cache );
+}
 
+bool Model::LoadBakedModel( ArchivePtr& Archive, const ModelCache& Cache )
+{
 	//
 	// raw: decode with system default.
 	//      if system default is not shift-jis it will display with corrupted charactor.
@@ -80,10 +128,7 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
         Path name = unicode;
         bool bExist = archive->IsExist( name );
         if (bExist)
-        {
-            auto ia = archive->GetFile( name );
-            texture = TextureManager::LoadFromMemory( archive->GetKeyName(name).generic_wstring(), ia, bSRGB );
-        }
+            texture = TextureManager::LoadFromArchive( archive, name, bSRGB );
         else
         {
             // If not, try default provided texture in MMD (toon01.bmp)
@@ -93,57 +138,23 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 		return texture;
 	};
 
-	struct Attribute
-	{
-		XMFLOAT3 Normal;
-		XMFLOAT2 UV;
-        uint32_t BoneID[4] = {0, };
-        float    Weight[4] = {0.f };
-		float    EdgeSize;
-	};
-
-	std::vector<Attribute> attributes( pmx.m_Vertices.size() );
-	m_VertexPos.resize( pmx.m_Vertices.size() );
-	for (auto i = 0; i < pmx.m_Vertices.size(); i++)
-	{
-		m_VertexPos[i] = pmx.m_Vertices[i].Pos;
-		attributes[i].Normal = pmx.m_Vertices[i].Normal;
-		attributes[i].UV = pmx.m_Vertices[i].UV;
+    uint32_t numAttributes = 0, numPositions = 0, numIndices = 0, numMeshes = 0;
+    auto attributes = Cache.Get<VertexAttribute>( kSectionAttribute, numAttributes );
+    auto positions = Cache.Get<XMFLOAT3>( kSectionPosition, numPositions );
+    auto indices = Cache.Get<uint32_t>( kSectionIndex, numIndices );
+    auto meshes = Cache.Get<BakedMesh>( kSectionMesh, numMeshes );
+    if (numAttributes != numPositions)
+        return false;
 
-        ASSERT( pmx.m_Vertices[i].SkinningType != Vertex::kQdef );
+	m_VertexPos.assign( positions, positions + numPositions );
 
-        switch (pmx.m_Vertices[i].SkinningType)
-        {
-        case Vertex::kBdef1:
-            attributes[i].BoneID[0] = pmx.m_Vertices[i].bdef1.BoneIndex;
-            attributes[i].Weight[0] = 1.f;
-            break;
-        case Vertex::kSdef: // ignore rotation center, r0 and r1 treat as Bdef2
-        case Vertex::kBdef2:
-            attributes[i].BoneID[0] = pmx.m_Vertices[i].bdef2.BoneIndex[0];
-            attributes[i].BoneID[1] = pmx.m_Vertices[i].bdef2.BoneIndex[1];
-            attributes[i].Weight[0] = pmx.m_Vertices[i].bdef2.Weight;
-            attributes[i].Weight[1] = 1 - pmx.m_Vertices[i].bdef2.Weight;
-            break;
-        case Vertex::kBdef4:
-            for (int k = 0; k < 4; k++)
-            {
-                attributes[i].BoneID[k] = pmx.m_Vertices[i].bdef4.BoneIndex[k];
-                attributes[i].Weight[k] = pmx.m_Vertices[i].bdef4.Weight[k];
-            }
-            break;
-        }
-		attributes[i].EdgeSize = pmx.m_Vertices[i].EdgeSize;
-	}
-	m_VertexMorphedPos = m_VertexPos;
-
-	m_Name = pmx.m_Description.Name;
-    std::copy(pmx.m_Indices.begin(), pmx.m_Indices.end(), std::back_inserter(m_Indices));
+	m_Name = Cache.GetName();
+    m_Indices.assign( indices, indices + numIndices );
 
 	m_AttributeBuffer.Create( m_Name + L"_AttrBuf",
-		static_cast<uint32_t>(attributes.size()),
-		sizeof( Attribute ),
-		attributes.data() );
+		numAttributes,
+		sizeof( VertexAttribute ),
+		attributes );
 
 	m_PositionBuffer.Create( m_Name + L"_PosBuf",
 		static_cast<uint32_t>(m_VertexPos.size()),
@@ -151,26 +162,22 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 		m_VertexPos.data() );
 
 	m_IndexBuffer.Create( m_Name + L"_IndexBuf",
-		static_cast<uint32_t>(pmx.m_Indices.size()),
-		sizeof( pmx.m_Indices[0] ),
-		pmx.m_Indices.data() );
+		numIndices,
+		sizeof( uint32_t ),
+		indices );
 
-	uint32_t IndexOffset = 0;
-	for (auto& material : pmx.m_Materials)
+	for (uint32_t i = 0; i < numMeshes; i++)
 	{
+        const BakedMesh& baked = meshes[i];
 		Mesh mesh = {};
 
 		MaterialCB mat = {};
-		mat.Diffuse = material.Diffuse;
-		mat.SpecularPower = material.SpecularPower;
-		mat.Ambient = material.Ambient;
+		mat.Diffuse = baked.Material.Diffuse;
+		mat.SpecularPower = baked.Material.SpecularPower;
+		mat.Ambient = baked.Material.Ambient;
 
-		mesh.IndexCount = material.NumVertex;
-		mesh.IndexOffset = IndexOffset;
-		IndexOffset += material.NumVertex;
-
-        if (material.DiffuseTexureIndex >= 0)
-			mesh.Texture[kTextureDiffuse] = LoadTexture( Archive, pmx.m_Textures[material.DiffuseTexureIndex], true );
+		mesh.IndexCount = baked.IndexCount;
+		mesh.IndexOffset = baked.IndexOffset;
 
         //
         // https://learnmmd.com/http:/learnmmd.com/pmd-editor-basics-sph-and-spa-files-add-sparkle/
@@ -183,67 +190,112 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
         //    if (std::string::npos != material.SphereRaw.rfind(".spa"))
         //        sRGB = false;
         //
-        if (material.SphereTextureIndex >= 0)
-			mesh.Texture[kTextureSphere] = LoadTexture( Archive, pmx.m_Textures[material.SphereTextureIndex], true );
-
-        std::wstring ToonName;
-        if (material.bDefaultToon)
-            ToonName = std::wstring(L"toon") + std::to_wstring(material.DeafultToon) + std::wstring(L".bmp");
-        else if (material.Toon >= 0)
-            ToonName = pmx.m_Textures[material.Toon];
-        if (!ToonName.empty())
-            mesh.Texture[kTextureToon] = LoadTexture( Archive, ToonName, true );
+        for (auto k = 0; k < kTextureMax; k++)
+        {
+            if (baked.Texture[k] >= 0)
+                mesh.Texture[k] = LoadTexture( Archive, Cache.GetString( baked.Texture[k] ), true );
+        }
 
 		if (mesh.Texture[kTextureToon])
 			mat.bUseToon = TRUE;
 		if (mesh.Texture[kTextureDiffuse])
 			mat.bUseTexture = TRUE;
 		if (mesh.Texture[kTextureSphere])
-			mat.SphereOperation = material.SphereOperation;
+			mat.SphereOperation = baked.Material.SphereOperation;
 
 		mesh.Material = mat;
-		mesh.EdgeSize = material.EdgeSize;
-		mesh.EdgeColor = Color(Vector4(material.EdgeColor)).FromSRGB();
-
-        // if motion is not registered, bounding box is used to viewpoint culling
-        mesh.BoundSphere = ComputeBoundingSphereFromVertices(
-            m_VertexPos, m_Indices, mesh.IndexCount, mesh.IndexOffset );
+		mesh.EdgeSize = baked.EdgeSize;
+		mesh.EdgeColor = Color(Vector4(baked.EdgeColor)).FromSRGB();
+		m_EdgeColorDefault.push_back( baked.EdgeColor );
+        mesh.BoundSphere = BoundingSphere( Vector4( baked.BoundSphere ) );
 
 		m_Mesh.push_back(mesh);
 	}
+    m_MeshDefault = m_Mesh;
+    m_MaterialMorph.assign( m_Mesh.size(), MaterialMorph::Identity() );
 
-	size_t numBones = pmx.m_Bones.size();
-	SetBoneNum( numBones );
-    ASSERT( numBones > 0 );
-	for (auto i = 0; i < numBones; i++)
-	{
-		auto& boneData = pmx.m_Bones[i];
+    if (!LoadSkeleton( Cache ))
+        return false;
+    const size_t numBones = m_Bones.size();
 
-		m_Bones[i].Name = boneData.Name;
-		m_BoneParent[i] = boneData.ParentBoneIndex;
-		if (boneData.ParentBoneIndex >= 0)
-			m_BoneChild[boneData.ParentBoneIndex].push_back( i );
+    MorphTables morphs;
+    Cache.GetMorphs( morphs );
+    const size_t numMorphs = morphs.Morphs.size();
+    m_MorphMotions.resize( numMorphs );
+    for (size_t i = 0; i < numMorphs; i++)
+    {
+        const std::wstring name = Cache.GetString( morphs.Morphs[i].Name );
+        const uint32_t nameId = m_MorphNames.Intern( name );
+        m_MorphIndex.resize( m_MorphNames.Size() );
+        m_MorphIndex[nameId] = static_cast<uint32_t>(i);
+        m_MorphMotions[i].m_Name = name;
+    }
 
-		Vector3 origin = boneData.Position;
-		Vector3 parentOrigin = Vector3( 0.0f, 0.0f, 0.0f );
+    std::vector<XMFLOAT2> uvs;
+    if (!morphs.UVs.empty())
+    {
+        m_Attributes.assign( attributes, attributes + numAttributes );
+        uvs.resize( numAttributes );
+        for (uint32_t i = 0; i < numAttributes; i++)
+            uvs[i] = attributes[i].UV;
+    }
+    m_Morphs.Build( std::move( morphs ), m_VertexPos, uvs, numBones, m_Mesh.size() );
 
-		if( boneData.ParentBoneIndex >= 0)
-			parentOrigin = pmx.m_Bones[boneData.ParentBoneIndex].Position;
+    SetVisualizeSkeleton();
+    SetBoundingBox();
+    SetBoundingSphere();
 
-		m_Bones[i].Translate = origin - parentOrigin;
-        m_Bones[i].Position = origin;
-        m_Bones[i].DestinationIndex = boneData.DestinationOriginIndex;
-        m_Bones[i].DestinationOffset = boneData.DestinationOriginOffset;
-        m_Bones[i].bInherentRotation = boneData.bInherentRotation;
-        m_Bones[i].bInherentTranslation = boneData.bInherentTranslation;
+    return true;
+}
+
+bool Model::LoadSkeleton( const ModelCache& Cache )
+{
+    uint32_t numBones = 0;
+    auto bones = Cache.Get<BakedBone>( kSectionBone, numBones );
+	SetBoneNum( numBones );
+    ASSERT( numBones > 0 );
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		auto& boneData = bones[i];
+
+		m_Bones[i].Name = Cache.GetString( boneData.Name );
+		// Baked parent first, see SortBones
+		if (boneData.Parent >= int32_t(i) || boneData.SubtreeEnd <= i || boneData.SubtreeEnd > numBones)
+			return false;
+		m_BoneParent[i] = boneData.Parent;
+		m_BoneSubtreeEnd[i] = boneData.SubtreeEnd;
+
+		m_Bones[i].Translate = Vector3( boneData.Translate );
+        m_Bones[i].Position = Vector3( boneData.Position );
+        m_Bones[i].DestinationIndex = boneData.DestinationIndex;
+        m_Bones[i].DestinationOffset = Vector3( boneData.DestinationOffset );
+        m_Bones[i].bInherentRotation = boneData.bInherentRotation != 0;
+        m_Bones[i].bInherentTranslation = boneData.bInherentTranslation != 0;
         m_Bones[i].ParentInherentBoneIndex = boneData.ParentInherentBoneIndex;
         m_Bones[i].ParentInherentBoneCoefficent = boneData.ParentInherentBoneCoefficent;
 
-		m_BoneIndex[boneData.Name] = i;
+		const uint32_t nameId = Animation::InternBoneName( m_Bones[i].Name );
+		if (nameId >= m_BoneIndex.size())
+			m_BoneIndex.resize( nameId + 1, NameTable::kInvalid );
+		m_BoneIndex[nameId] = i;
 	}
-    localInherentOrientations.resize( numBones );
     localInherentTranslations.resize( numBones, Vector3(kZero) );
 
+    uint32_t numInherents = 0;
+    auto inherents = Cache.Get<InherentAttr>( kSectionInherent, numInherents );
+    m_Inherents.assign( inherents, inherents + numInherents );
+    // Entry each one reads, when its source is inherent and evaluated before it
+    std::vector<int32_t> entry( numBones, -1 ), inherentAfter( numInherents, -1 );
+    for (uint32_t e = 0; e < numInherents; e++)
+    {
+        const auto& inherent = m_Inherents[e];
+        if (inherent.BoneIndex >= numBones || inherent.Source >= numBones)
+            return false;
+        inherentAfter[e] = entry[inherent.Source];
+        entry[inherent.BoneIndex] = int32_t(e);
+    }
+    m_BoneSchedule.Build( m_BoneSubtreeEnd, inherentAfter, kBoneGrain );
+
     m_Pose.resize( numBones );
     m_LocalPoseDefault.resize( numBones );
     for (auto i = 0; i < m_Bones.size(); i++)
@@ -255,29 +307,36 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
     for ( auto i = 0; i < numBones; i++)
         m_SkinningDual[i] = OrthogonalTransform();
 
-    for (auto i = 0; i < numBones; i++)
+    uint32_t numIKs = 0, numLinks = 0;
+    size_t maxChain = 0;
+    auto iks = Cache.Get<BakedIK>( kSectionIK, numIKs );
+    auto links = Cache.Get<IKChild>( kSectionIKLink, numLinks );
+    for (uint32_t i = 0; i < numIKs; i++)
     {
-        if (!pmx.m_Bones[i].bIK)
-            continue;
-        auto& it = pmx.m_Bones[i].Ik;
+        auto& it = iks[i];
+        if (it.LinkOffset > numLinks || it.LinkCount > numLinks - it.LinkOffset)
+            return false;
 
         IKAttr attr;
-        attr.BoneIndex = i;
-        attr.TargetBoneIndex = it.BoneIndex;
+        attr.BoneIndex = it.BoneIndex;
+        attr.TargetBoneIndex = it.TargetBoneIndex;
         attr.LimitedRadian = it.LimitedRadian;
         attr.NumIteration = it.NumIteration;
-
-        for (auto& ik : it.Link)
+        attr.Link.assign( links + it.LinkOffset, links + it.LinkOffset + it.LinkCount );
+        auto IsBone = [numBones]( int32_t index ) { return index >= 0 && uint32_t(index) < numBones; };
+        if (!IsBone( attr.BoneIndex ) || !IsBone( attr.TargetBoneIndex ))
+            return false;
+        for (auto& link : attr.Link)
         {
-            IKChild child;
-            child.BoneIndex = ik.BoneIndex;
-            child.bLimit = ik.bLimit;
-            child.MinLimit = ik.MinLimit;
-            child.MaxLimit = ik.MaxLimit;
-            attr.Link.push_back( child );
+            if (!IsBone( link.BoneIndex ))
+                return false;
         }
+        BuildIKChain( attr );
+        maxChain = std::max( maxChain, attr.Chain.Bone.size() );
         m_IKs.push_back( attr );
     }
+    m_IKWorld.resize( maxChain );
+    m_IKOffset.resize( maxChain );
 
     std::vector<OrthogonalTransform> RestPose( numBones );
     for (auto i = 0; i < numBones; i++)
@@ -292,160 +351,91 @@ bool Model::LoadModel( ArchivePtr& Archive, Path& FilePath )
 
     for (auto i = 0; i < numBones; i++)
         m_toRoot[i] = ~RestPose[i];
-
-    /*
-
-	m_MorphMotions.resize( pmx.m_Faces.size() );
-	for ( auto i = 0; i < pmx.m_Faces.size(); i++ )
-	{
-		auto& morph = pmx.m_Faces[i];
-		m_MorphIndex[morph.Name] = i;
-        auto numVertices = morph.FaceVertices.size();
-
-        auto& motion = m_MorphMotions[i];
-        motion.m_MorphVertices.reserve( numVertices );
-        motion.m_MorphVertices.reserve( numVertices );
-		for (auto& vert : morph.FaceVertices)
-        {
-			motion.m_MorphIndices.push_back( vert.Index );
-			motion.m_MorphVertices.push_back( vert.Position );
-        }
-	}
-    if (m_MorphMotions.size() > 0)
-        m_MorphDelta.resize( m_MorphMotions[kMorphBase].m_MorphIndices.size() );
-    */
-
-    SetVisualizeSkeleton();
-    SetBoundingBox();
-    SetBoundingSphere();
-
     return true;
 }
 
 bool Model::LoadMotion( const std::wstring& motionPath )
 {
-	using namespace std;
 	using namespace Animation;
 
-	Utility::ByteArray ba = Utility::ReadFileSync( motionPath );
-	Utility::ByteStream bs(ba);
-
-	Vmd::VMD vmd;
-	vmd.Fill( bs, m_bRightHand );
-	if (!vmd.IsValid())
+	// Shared with every other model playing the same file
+	MotionClipPtr clip = MotionClip::Load( motionPath, m_bRightHand );
+	if (!clip)
         return false;
 
-    LoadBoneMotion( vmd.BoneFrames );
+    m_Motion.Clear();
+    m_Motion.AddLayer( BindMotion( clip ), kBlendOverride, 1.f, 0.f );
 
-	for (auto& frame : vmd.FaceFrames)
+	for (auto& source : clip->GetMorphMotions())
 	{
-		MorphKeyFrame key;
-		key.Frame = frame.Frame;
-		key.Weight = frame.Weight;
-		key.Weight = frame.Weight;
+        const uint32_t morphIndex = FindMorph( source.m_Name );
+        WARN_ONCE_IF(morphIndex == NameTable::kInvalid, L"Can't find target morph on model: " + m_ModelPath);
+        if (morphIndex == NameTable::kInvalid)
+            continue;
 
-        WARN_ONCE_IF(m_MorphIndex.count(frame.FaceName) <= 0, L"Can't find target morph on model: " + m_ModelPath);
-        if (m_MorphIndex.count(frame.FaceName) > 0)
-        {
-            auto& motion = m_MorphMotions[m_MorphIndex[frame.FaceName]];
-            motion.m_Name = frame.FaceName;
-            motion.InsertKeyFrame( key );
-        }
+        auto& motion = m_MorphMotions[morphIndex];
+        motion.m_Name = source.m_Name;
+        motion.m_KeyFrames.insert( motion.m_KeyFrames.end(), source.m_KeyFrames.begin(), source.m_KeyFrames.end() );
 	}
 
 	for (auto& face : m_MorphMotions )
 		face.SortKeyFrame();
 
-	for (auto& frame : vmd.CameraFrames)
-	{
-		CameraKeyFrame keyFrame;
-		keyFrame.Frame = frame.Frame;
-		keyFrame.Data.bPerspective = frame.TurnOffPerspective == 0;
-		keyFrame.Data.Distance = frame.Distance;
-		keyFrame.Data.FovY = frame.ViewAngle / XM_PI;
-		keyFrame.Data.Rotation = Quaternion( frame.Rotation.y, frame.Rotation.x, frame.Rotation.z );
-		keyFrame.Data.Position = frame.Position;
-
-		//
-		// http://harigane.at.webry.info/201103/article_1.html
-		//
-		auto interp = reinterpret_cast<const char*>(&frame.Interpolation[0]);
-		float scale = 1.0f / 127.0f;
-
-		for (auto i = 0; i < 6; i++)
-			keyFrame.BezierCoeff[i] = Vector4( interp[i], interp[i+2], interp[i+1], interp[i+3] ) * scale;
-
+	for (auto& keyFrame : clip->GetCameraMotion().m_KeyFrames)
 		m_CameraMotion.InsertKeyFrame( keyFrame );
-	}
     return true;
 }
 
-void Model::LoadBoneMotion( const std::vector<Vmd::BoneFrame>& frames )
+bool Model::PlayMotion( const std::wstring& motionPath, float fadeFrames )
 {
-    if (frames.size() <= 0)
-        return;
-
-    int32_t numBones = static_cast<int32_t>(m_Bones.size());
-
-    m_BoneMotions.resize( numBones );
-
-    for (auto i = 0; i < numBones; i++)
-    {
-        auto& bone = m_Bones[i];
-        auto& meshBone = m_BoneMotions[i];
+	using namespace Animation;
 
-        meshBone.bLimitXAngle = false;
+	if (m_Motion.Empty())
+		return LoadMotion( motionPath );
 
-        //
-        // In PMD Model minIK, maxIK is not manually given.
-        // But, bone name that contains 'knee'('ひざ') has constraint
-        // that can move only in x axis and outer angle (just like human knee)
-        // If this constraint is not given, knee goes forward just like
-        // the following vmd motion. http://www.nicovideo.jp/watch/sm18737664
-        //
-        if (std::string::npos != bone.Name.find( L"ひざ" ))
-            meshBone.bLimitXAngle = true;
-    }
-	for (auto& frame : frames)
-	{
-		if ( m_BoneIndex.count( frame.BoneName ) == 0)
-			continue;
-
-		Vector3 BoneTranslate(m_Bones[m_BoneIndex[frame.BoneName]].Translate);
+	MotionClipPtr clip = MotionClip::Load( motionPath, m_bRightHand );
+	if (!clip)
+        return false;
 
-		Animation::BoneKeyFrame key;
-		key.Frame = frame.Frame;
-		key.Local.SetTranslation( Vector3(frame.Offset) + BoneTranslate );
-		key.Local.SetRotation( Quaternion( frame.Rotation ) );
+	// New dance starts from its first frame, layers below go away once the fade is over
+	const uint32_t layer = m_Motion.AddLayer( BindMotion( clip ), kBlendOverride, 1.f, m_Motion.GetTime() );
+	if (layer == MotionMixer::kInvalidLayer)
+		return false;
+	m_Motion.CrossFade( layer, fadeFrames );
+    return true;
+}
 
-		//
-		// http://harigane.at.webry.info/201103/article_1.html
-		//
-		// X_x1, Y_x1, Z_x1, R_x1,
-		// X_y1, Y_y1, Z_y1, R_y1,
-		// X_x2, Y_x2, Z_x2, R_x2,
-		// X_y2, Y_y2, Z_y2, R_y2,
-		//
-		// ... (duplicated values)
-		//
-		auto interp = reinterpret_cast<const char*>(&frame.Interpolation[0]);
-		float scale = 1.0f / 127.0f;
+Animation::MotionBinding Model::BindMotion( const Animation::MotionClipPtr& clip ) const
+{
+	Animation::MotionBinding binding;
+	binding.Bind( clip, m_LocalPoseDefault, [this]( uint32_t nameId ) {
+		const uint32_t boneIndex = FindBone( nameId );
+		return boneIndex == NameTable::kInvalid ? int32_t(Animation::TrackBinding::kUnbound) : static_cast<int32_t>(boneIndex);
+	});
+	return binding;
+}
 
-		for (auto i = 0; i < 4; i++)
-			key.BezierCoeff[i] = Vector4( interp[i], interp[i+4], interp[i+8], interp[i+12] ) * scale;
 
-		m_BoneMotions[m_BoneIndex[frame.BoneName]].InsertKeyFrame( key );
-	}
+uint32_t Model::FindBone( const std::wstring& name ) const
+{
+    return FindBone( Animation::FindBoneName( name ) );
+}
 
-	for (auto& bone : m_BoneMotions )
-		bone.SortKeyFrame();
+uint32_t Model::FindBone( uint32_t nameId ) const
+{
+    return nameId < m_BoneIndex.size() ? m_BoneIndex[nameId] : NameTable::kInvalid;
 }
 
+uint32_t Model::FindMorph( const std::wstring& name ) const
+{
+    const uint32_t id = m_MorphNames.Find( name );
+    return id == NameTable::kInvalid ? id : m_MorphIndex[id];
+}
 
 void Model::SetBoneNum( size_t numBones )
 {
 	m_BoneParent.resize( numBones );
-	m_BoneChild.resize( numBones );
+	m_BoneSubtreeEnd.resize( numBones );
 	m_Bones.resize( numBones );
 }
 
@@ -544,129 +534,358 @@ void Model::Clear()
 
 // Use code from 'MMDAI'
 // Copyright (c) 2010-2014  hkrn
-void Model::PerformTransform( uint32_t i )
-{
-    Quaternion orientation( kIdentity );
-    if (m_Bones[i].bInherentRotation) {
-        uint32_t InherentRefIndex = m_Bones[i].ParentInherentBoneIndex;
-        ASSERT( InherentRefIndex >= 0 );
-        Bone* parentBoneRef = &m_Bones[InherentRefIndex];
-        // If parent also Inherenet, then it has updated value. So, use cached one
-        if (parentBoneRef->bInherentRotation) {
-            orientation *= localInherentOrientations[InherentRefIndex];
-        }
-        else {
-            orientation *= m_LocalPose[InherentRefIndex].GetRotation();
-        }
-        if (!Near( m_Bones[i].ParentInherentBoneCoefficent, 1.f, FLT_EPSILON )) {
-            orientation = Slerp( Quaternion( kIdentity ), orientation, m_Bones[i].ParentInherentBoneCoefficent );
-        }
-        localInherentOrientations[i] = Normalize(orientation * m_LocalPose[i].GetRotation());
-    }
-    orientation *= m_LocalPose[i].GetRotation();
-    orientation = Normalize( orientation );
-    Vector3 translation( kZero );
-    if (m_Bones[i].bInherentTranslation) {
-        uint32_t InherentRefIndex = m_Bones[i].ParentInherentBoneIndex;
-        ASSERT( InherentRefIndex >= 0 );
-        Bone* parentBoneRef = &m_Bones[InherentRefIndex];
-        if (parentBoneRef) {
-            if (parentBoneRef->bInherentTranslation) {
-                translation += localInherentTranslations[InherentRefIndex];
-            }
-            else {
-                translation += m_LocalPose[InherentRefIndex].GetTranslation();
+//
+// m_Inherents are baked sources first, so an inherent source has its local pose (and
+// inherited translation) of this frame. Bones that inherit nothing are not visited
+//
+void Model::PerformTransform( const InherentAttr& inherent )
+{
+    const float coefficient = inherent.Coefficient;
+    const bool bFull = Near( coefficient, 1.f, FLT_EPSILON );
+    OrthogonalTransform& local = m_LocalPose[inherent.BoneIndex];
+    if (inherent.Flags & InherentAttr::kRotation)
+    {
+        Quaternion orientation = m_LocalPose[inherent.Source].GetRotation();
+        // Whole and reversed rotation (the common coefficients) need no Slerp
+        if (Near( coefficient, -1.f, FLT_EPSILON ))
+            orientation = ~orientation;
+        else if (!bFull)
+            orientation = Slerp( Quaternion( kIdentity ), orientation, coefficient );
+        local.SetRotation( Normalize( orientation * local.GetRotation() ) );
+    }
+    if (inherent.Flags & InherentAttr::kTranslation)
+    {
+        Vector3 translation = (inherent.Flags & InherentAttr::kSourceTranslation)
+            ? localInherentTranslations[inherent.Source] : m_LocalPose[inherent.Source].GetTranslation();
+        if (!bFull)
+            translation *= Scalar( coefficient );
+        localInherentTranslations[inherent.BoneIndex] = translation;
+        local.SetTranslation( translation + local.GetTranslation() );
+    }
+}
+
+void Model::EvaluateSkinning( float kFrameTime, bool bIK )
+{
+    BeginSkinning( kFrameTime );
+    if (bIK)
+    {
+        for (auto& ik : m_IKs)
+            UpdateIK( ik );
+    }
+    EndSkinning();
+}
+
+// Pose up to IK
+void Model::BeginSkinning( float kFrameTime )
+{
+    m_LocalPose = m_LocalPoseDefault;
+    m_Motion.Evaluate( kFrameTime, m_LocalPose );
+    // Bone morphs move the keyed pose, IK then follows them
+    m_Morphs.ApplyBones( m_LocalPose );
+    UpdatePose();
+}
+
+void Model::EndSkinning()
+{
+    PerformTransforms();
+    UpdatePose();
+    // One multiply a bone, too little to pay for the tasks
+    for (auto i = 0; i < m_Bones.size(); i++)
+        m_Skinning[i] = m_Pose[i] * m_toRoot[i];
+}
+
+//
+// The loops over the bones of a big rig run as tasks of m_BoneSchedule. Each bone is
+// computed from the same values as in the serial loop, so the result is bit identical
+//
+bool Model::IsParallelSkeleton() const
+{
+    return s_bParallelSkeleton && m_Bones.size() >= kParallelBones;
+}
+
+// 'body' on [first, last) ranges covering the bones, for loops where bones are independent
+void Model::ForEachBoneRange( const std::function<void(uint32_t, uint32_t)>& body ) const
+{
+    const uint32_t numBones = static_cast<uint32_t>(m_Bones.size());
+    if (!IsParallelSkeleton())
+    {
+        body( 0, numBones );
+        return;
+    }
+    RunTasks( (numBones + kBoneGrain - 1) / kBoneGrain, [&body, numBones]( size_t t ) {
+        const uint32_t first = static_cast<uint32_t>(t) * kBoneGrain;
+        body( first, std::min( first + kBoneGrain, numBones ) );
+    } );
+}
+
+void Model::PerformTransforms()
+{
+    if (!IsParallelSkeleton())
+    {
+        for (auto& inherent : m_Inherents)
+            PerformTransform( inherent );
+        return;
+    }
+    const auto& order = m_BoneSchedule.GetTransformOrder();
+    const auto& tasks = m_BoneSchedule.GetTransformTasks();
+    const auto& levels = m_BoneSchedule.GetTransformLevels();
+    for (size_t l = 0; l + 1 < levels.size(); l++)
+    {
+        RunTasks( levels[l + 1] - levels[l], [&, l]( size_t t ) {
+            const auto& range = tasks[levels[l] + t];
+            for (auto k = range.Begin; k < range.End; k++)
+                PerformTransform( m_Inherents[order[k]] );
+        } );
+    }
+}
+
+//
+// With m_Lod.Interval > 1 the pose is evaluated once per interval, for the frame the
+// next evaluation falls on, and the skinning shown in between moves from what was
+// on screen toward it. Returns whether the pose is evaluated in this update, and
+// for which 'frame'
+//
+bool Model::BeginMotion( float kFrameTime, float& frame )
+{
+    frame = kFrameTime;
+    if (m_Lod.Interval <= 1)
+    {
+        m_LodStart = m_LodTarget = kFrameTime;
+        m_SkinningTo.clear();
+        return true;
+    }
+
+    // Late by a whole update (interval changed, frame skipped) evaluates out of turn
+    const bool bEvaluated = m_Lod.bEvaluate || m_SkinningTo.empty() || kFrameTime > m_LodTarget + m_Lod.FrameStep;
+    if (bEvaluated)
+    {
+        // Nothing evaluated yet, m_Skinning is still the rest pose
+        if (m_LodTarget < 0.f)
+            EvaluateSkinning( kFrameTime, m_Lod.bIK );
+        m_SkinningFrom = m_Skinning;
+        m_LodStart = kFrameTime;
+        m_LodTarget = kFrameTime + m_Lod.Interval * m_Lod.FrameStep;
+        frame = m_LodTarget;
+    }
+    return bEvaluated;
+}
+
+void Model::EndMotion( float kFrameTime, bool bEvaluated )
+{
+    if (m_Lod.Interval > 1)
+    {
+        if (bEvaluated)
+            m_SkinningTo = m_Skinning;
+        float s = 1.f;
+        if (m_LodTarget > m_LodStart)
+            s = std::min( std::max( (kFrameTime - m_LodStart) / (m_LodTarget - m_LodStart), 0.f ), 1.f );
+        ForEachBoneRange( [this, s]( uint32_t first, uint32_t last ) {
+            for (auto i = first; i < last; i++)
+            {
+                const OrthogonalTransform& from = m_SkinningFrom[i];
+                const OrthogonalTransform& to = m_SkinningTo[i];
+                m_Skinning[i] = OrthogonalTransform(
+                    Slerp( from.GetRotation(), to.GetRotation(), s ),
+                    Lerp( from.GetTranslation(), to.GetTranslation(), Vector3( Scalar( s ) ) ) );
             }
-        }
-        if (!Near( m_Bones[i].ParentInherentBoneCoefficent, 1.f, FLT_EPSILON )) {
-            translation *= Scalar(m_Bones[i].ParentInherentBoneCoefficent);
-        }
-        localInherentTranslations[i] = translation;
+        } );
     }
-    translation += m_LocalPose[i].GetTranslation();
-    m_LocalPose[i].SetRotation( orientation );
-    m_LocalPose[i].SetTranslation( translation );
+    for (auto i = 0; i < m_Skinning.size(); i++)
+        m_SkinningDual[i] = m_Skinning[i];
 }
 
 void Model::Update( float kFrameTime )
 {
-	if (m_BoneMotions.size() > 0)
-	{
-        m_LocalPose = m_LocalPoseDefault;
-        const size_t numMotions = m_BoneMotions.size();
-		for (auto i = 0; i < numMotions; i++)
-			m_BoneMotions[i].Interpolate( kFrameTime, m_LocalPose[i] );
-        UpdatePose();
-		for (auto& ik : m_IKs)
+    if (BeginUpdate( kFrameTime ))
+    {
+        for (auto& ik : m_IKs)
             UpdateIK( ik );
-		const size_t numBones = m_Bones.size();
-        for (auto i = 0; i < numBones; i++)
-            PerformTransform( i );
-        UpdatePose();
-		for (auto i = 0; i < numBones; i++)
-			m_Skinning[i] = m_Pose[i] * m_toRoot[i];
-		for (auto i = 0; i < numBones; i++)
-            m_SkinningDual[i] = m_Skinning[i];
+    }
+    EndUpdate( kFrameTime );
+}
+
+//
+// Update is split around IK, so UpdateBatch can solve the IK of many models in
+// between. Returns whether the IK of m_IKs is to be solved before EndUpdate
+//
+bool Model::BeginUpdate( float kFrameTime )
+{
+    //
+    // http://blog.goo.ne.jp/torisu_tetosuki/e/8553151c445d261e122a3a31b0f91110
+    //
+    // Weights are resolved first, bone morphs act on the pose evaluated below
+    //
+    for (uint32_t i = 0; i < m_MorphMotions.size(); i++)
+    {
+        auto& motion = m_MorphMotions[i];
+        motion.Interpolate( kFrameTime );
+        m_Morphs.SetWeight( i, motion.m_Weight );
+    }
+    m_Morphs.Resolve();
+
+    m_bEvaluated = true;
+    m_bSkinning = false;
+    if (!m_Motion.Empty())
+    {
+        float frame = kFrameTime;
+        m_bEvaluated = BeginMotion( kFrameTime, frame );
+        if (m_bEvaluated)
+        {
+            BeginSkinning( frame );
+            m_bSkinning = true;
+        }
+    }
+    return m_bSkinning && m_Lod.bIK;
+}
+
+void Model::EndUpdate( float kFrameTime )
+{
+    if (!m_Motion.Empty())
+    {
+        if (m_bSkinning)
+            EndSkinning();
+        EndMotion( kFrameTime, m_bEvaluated );
+    }
+
+    if (m_MorphMotions.size() > 0 && m_bEvaluated && m_Lod.bMorph)
+	{
+		// Only the morphs whose weight moved touch their vertices
+		m_Morphs.ApplyVertices();
+		if (m_Morphs.ApplyMaterials( m_MaterialMorph ))
+			UpdateMaterials();
 	}
+}
+
+//
+// Same as Update on each model, except that the IK is solved on 'batch', chains of
+// all models together. IK runs in rounds, round r solving the r-th IK of every model,
+// as an IK moves the bones the next one starts from (e.g. leg, then toe)
+//
+void Model::UpdateBatch( const std::vector<Model*>& models, float kFrameTime, IKBatch& batch, bool bParallel )
+{
+    auto ForEach = [&models, bParallel]( const std::function<void(Model&)>& body ) {
+        if (bParallel)
+            Utility::GetThreadPool().ParallelFor( models.size(), [&]( size_t i ) { body( *models[i] ); } );
+        else
+            for (auto model : models)
+                body( *model );
+    };
 
-    if (m_MorphMotions.size() > 0)
+    ForEach( [kFrameTime]( Model& model ) { model.m_bSolveIK = model.BeginUpdate( kFrameTime ); } );
+
+    size_t numRounds = 0;
+    for (auto model : models)
+    {
+        if (model->m_bSolveIK)
+            numRounds = std::max( numRounds, model->m_IKs.size() );
+    }
+    for (size_t r = 0; r < numRounds; r++)
+    {
+        batch.Clear();
+        for (auto model : models)
+        {
+            if (model->m_bSolveIK && r < model->m_IKs.size())
+                model->m_IKLane = batch.Reserve( model->m_IKs[r] );
+        }
+        ForEach( [&batch, r]( Model& model ) {
+            if (!model.m_bSolveIK || r >= model.m_IKs.size())
+                return;
+            const IKAttr& ik = model.m_IKs[r];
+            model.BeginIK( ik );
+            batch.Set( model.m_IKLane, ik, Vector3( model.m_Pose[ik.BoneIndex].GetTranslation() ),
+                model.m_LocalPose, model.m_IKWorld.data(), model.m_IKOffset.data() );
+        } );
+        batch.Solve( bParallel );
+        ForEach( [&batch, r]( Model& model ) {
+            if (!model.m_bSolveIK || r >= model.m_IKs.size())
+                return;
+            const IKAttr& ik = model.m_IKs[r];
+            if (batch.Get( model.m_IKLane, ik, model.m_LocalPose ))
+                model.EndIK( ik );
+        } );
+    }
+
+    ForEach( [kFrameTime]( Model& model ) { model.EndUpdate( kFrameTime ); } );
+}
+
+//
+// Material morphs act on the authored values: value * Mul + Add, edge color in sRGB
+//
+void Model::UpdateMaterials()
+{
+    for (size_t i = 0; i < m_Mesh.size(); i++)
+    {
+        const MaterialMorph& morph = m_MaterialMorph[i];
+        const Mesh& rest = m_MeshDefault[i];
+        Mesh& mesh = m_Mesh[i];
+
+        auto apply3 = []( const XMFLOAT3& v, const XMFLOAT3& mul, const XMFLOAT3& add ) {
+            return XMFLOAT3( v.x * mul.x + add.x, v.y * mul.y + add.y, v.z * mul.z + add.z );
+        };
+        auto apply4 = []( const XMFLOAT4& v, const XMFLOAT4& mul, const XMFLOAT4& add ) {
+            return XMFLOAT4( v.x * mul.x + add.x, v.y * mul.y + add.y, v.z * mul.z + add.z, v.w * mul.w + add.w );
+        };
+        mesh.Material.Diffuse = apply4( rest.Material.Diffuse, morph.DiffuseMul, morph.DiffuseAdd );
+        mesh.Material.Specular = apply3( rest.Material.Specular, morph.SpecularMul, morph.SpecularAdd );
+        mesh.Material.SpecularPower = rest.Material.SpecularPower * morph.SpecularPowerMul + morph.SpecularPowerAdd;
+        mesh.Material.Ambient = apply3( rest.Material.Ambient, morph.AmbientMul, morph.AmbientAdd );
+        mesh.EdgeSize = rest.EdgeSize * morph.EdgeSizeMul + morph.EdgeSizeAdd;
+        const XMFLOAT4 edge = apply4( m_EdgeColorDefault[i], morph.EdgeColorMul, morph.EdgeColorAdd );
+        mesh.EdgeColor = Color( Vector4( edge ) ).FromSRGB();
+    }
+}
+
+void Model::UpdateBuffers( GraphicsContext& gfxContext )
+{
+	auto& positionMorph = m_Morphs.GetPositionMorph();
+	const auto& positions = positionMorph.GetPositions();
+	for (auto& range : positionMorph.GetDirtyRanges())
 	{
-		//
-		// http://blog.goo.ne.jp/torisu_tetosuki/e/8553151c445d261e122a3a31b0f91110
-		//
-        auto elemByte = sizeof( decltype(m_MorphDelta)::value_type );
-        memset( m_MorphDelta.data(), 0, elemByte*m_MorphDelta.size() );
+		gfxContext.UpdateBuffer( m_PositionBuffer, range.Begin * sizeof( XMFLOAT3 ),
+			&positions[range.Begin], (range.End - range.Begin) * sizeof( XMFLOAT3 ) );
+	}
+	positionMorph.ClearDirty();
 
-		bool bUpdate = false;
-		for (auto i = kMorphBase+1; i < m_MorphMotions.size(); i++)
-		{
-			auto& motion = m_MorphMotions[i];
-			motion.Interpolate( kFrameTime );
-			if (std::fabsf( motion.m_WeightPre - motion.m_Weight ) < 0.1e-2)
-				continue;
-			bUpdate = true;
-			auto weight = motion.m_Weight;
-			for (auto k = 0; k < motion.m_MorphVertices.size(); k++)
-			{
-                auto idx = motion.m_MorphIndices[k];
-				m_MorphDelta[idx] += weight * motion.m_MorphVertices[k];
-			}
-		}
-		if (bUpdate)
-		{
-            auto& baseFace = m_MorphMotions[kMorphBase];
-			for (auto i = 0; i < m_MorphDelta.size(); i++)
-                m_MorphDelta[i] += baseFace.m_MorphVertices[i];
-
-			for (auto i = 0; i < m_MorphDelta.size(); i++)
-				XMStoreFloat3( &m_VertexMorphedPos[baseFace.m_MorphIndices[i]], m_MorphDelta[i]);
-
-			m_PositionBuffer.Create( m_Name + L"_PosBuf",
-				static_cast<uint32_t>(m_VertexMorphedPos.size()),
-				sizeof( XMFLOAT3 ),
-				m_VertexMorphedPos.data() );
-		}
+	// UV shares the vertex with attributes that do not move, the whole attribute is rewritten
+	auto& uvMorph = m_Morphs.GetUVMorph();
+	const auto& uvs = uvMorph.GetPositions();
+	for (auto& range : uvMorph.GetDirtyRanges())
+	{
+		for (auto i = range.Begin; i < range.End; i++)
+			m_Attributes[i].UV = XMFLOAT2( uvs[i].x, uvs[i].y );
+		gfxContext.UpdateBuffer( m_AttributeBuffer, range.Begin * sizeof( VertexAttribute ),
+			&m_Attributes[range.Begin], (range.End - range.Begin) * sizeof( VertexAttribute ) );
 	}
+	uvMorph.ClearDirty();
 }
 
-void Model::UpdateChildPose( int32_t idx )
+//
+// On big rigs the spine of m_BoneSchedule goes first, then the subtrees below it as
+// independent tasks
+//
+void Model::UpdatePose()
 {
-	auto parentIndex = m_BoneParent[idx];
-	if (parentIndex >= 0)
-		m_Pose[idx] = m_Pose[parentIndex] * m_LocalPose[idx];
-    else
-		m_Pose[idx] = m_LocalPose[idx];
-	for (auto c : m_BoneChild[idx])
-		UpdateChildPose( c );
+    if (!IsParallelSkeleton())
+    {
+        UpdatePose( 0, static_cast<uint32_t>(m_Bones.size()) );
+        return;
+    }
+    for (auto i : m_BoneSchedule.GetPoseSpine())
+        UpdatePose( i, i + 1 );
+    const auto& tasks = m_BoneSchedule.GetPoseTasks();
+    RunTasks( tasks.size(), [this, &tasks]( size_t t ) { UpdatePose( tasks[t].Begin, tasks[t].End ); } );
 }
 
-void Model::UpdatePose()
+//
+// Bones are baked with parents first and each subtree as one range,
+// so [first, last) of whole subtrees updates in a single pass
+//
+void Model::UpdatePose( uint32_t first, uint32_t last )
 {
-    const size_t numBones = m_Bones.size();
-    for (auto i = 0; i < numBones; i++)
+    for (uint32_t i = first; i < last; i++)
     {
-        auto parentIndex = m_BoneParent[i];
-        if (parentIndex < numBones)
+        const int32_t parentIndex = m_BoneParent[i];
+        if (parentIndex >= 0)
             m_Pose[i] = m_Pose[parentIndex] * m_LocalPose[i];
         else
             m_Pose[i] = m_LocalPose[i];
@@ -679,16 +898,77 @@ void Model::UpdatePose()
 //
 // http://d.hatena.ne.jp/edvakf/20111102/1320268602
 //
-void Model::UpdateIK(const IKAttr& ik)
+// Iterations move only the chain (links and target) on scratch transforms: an entry's
+// world is its chain parent's world, times the offset down to its own parent (fixed
+// during the solve), times its local. Subtrees below the chain follow once at the end.
+//
+void Model::UpdateIK( const IKAttr& ik )
 {
-	auto GetPosition = [&]( int32_t index ) -> Vector3
-	{
-		return Vector3(m_Pose[index].GetTranslation());
-	};
+    BeginIK( ik );
+    if (SolveIK( ik ))
+        EndIK( ik );
+}
+
+// Chain transforms from the current pose
+void Model::BeginIK( const IKAttr& ik )
+{
+    const IKChain& chain = ik.Chain;
+    const size_t numEntries = chain.Bone.size();
+    for (size_t e = 0; e < numEntries; e++)
+    {
+        const uint32_t bone = chain.Bone[e];
+        const int32_t parent = m_BoneParent[bone];
+        m_IKWorld[e] = m_Pose[bone];
+        if (chain.Parent[e] >= 0 && !chain.bDirect[e])
+            m_IKOffset[e] = ~m_Pose[chain.Bone[chain.Parent[e]]] * m_Pose[parent];
+        else if (chain.Parent[e] < 0 && parent >= 0)
+            m_IKOffset[e] = m_Pose[parent];
+        else
+            m_IKOffset[e] = OrthogonalTransform();
+    }
+}
+
+// Subtrees below the chain follow its links
+void Model::EndIK( const IKAttr& ik )
+{
+    const IKChain& chain = ik.Chain;
+    for (size_t e = 0; e < chain.Bone.size(); e++)
+    {
+        const uint32_t bone = chain.Bone[e];
+        if (chain.Parent[e] < 0)
+            UpdatePose( bone, m_BoneSubtreeEnd[bone] );
+    }
+}
+
+// Recomputes chain entry 'e' and the entries below it
+void Model::UpdateIKChain( const IKChain& chain, size_t e )
+{
+    const uint32_t end = m_BoneSubtreeEnd[chain.Bone[e]];
+    for (size_t f = e; f < chain.Bone.size() && chain.Bone[f] < end; f++)
+    {
+        const uint32_t bone = chain.Bone[f];
+        const int32_t parent = chain.Parent[f];
+        const OrthogonalTransform& local = m_LocalPose[bone];
+        if (parent >= 0 && chain.bDirect[f])
+            m_IKWorld[f] = m_IKWorld[parent] * local;
+        else if (parent >= 0)
+            m_IKWorld[f] = m_IKWorld[parent] * m_IKOffset[f] * local;
+        else if (m_BoneParent[bone] >= 0)
+            m_IKWorld[f] = m_IKOffset[f] * local;
+        else
+            m_IKWorld[f] = local;
+    }
+}
+
+// Returns whether any link rotated
+bool Model::SolveIK( const IKAttr& ik )
+{
+    const IKChain& chain = ik.Chain;
 
 	// "effector" (Fixed, IK bone)
-	const auto ikBonePos = GetPosition( ik.BoneIndex );
+	const Vector3 ikBonePos = Vector3( m_Pose[ik.BoneIndex].GetTranslation() );
 
+    bool bMoved = false;
 	for (int n = 0; n < ik.NumIteration; n++)
 	{
 		// "effected" bone listed in order
@@ -696,17 +976,20 @@ void Model::UpdateIK(const IKAttr& ik)
 		{
             // TargetVector (link-target) is updated in each iteration
             // toward IkVector (link-ik)
-            const auto ikTargetBonePos = GetPosition( ik.TargetBoneIndex );
+            const Vector3 ikTargetBonePos = Vector3( m_IKWorld[chain.TargetEntry].GetTranslation() );
 
 			if (Length(ikBonePos - ikTargetBonePos) < 0.0001f)
-				return;
+				return bMoved;
 
-			auto linkIndex = ik.Link[k].BoneIndex;
-			auto invLinkMtx = Invert( m_Pose[linkIndex] );
+			const uint32_t entry = chain.LinkEntry[k];
+			const OrthogonalTransform& linkWorld = m_IKWorld[entry];
 
-			// transform to child bone's local coordinate.
-			auto ikTargetVec = Vector3( invLinkMtx * ikTargetBonePos );
-			auto ikBoneVec = Vector3( invLinkMtx * ikBonePos );
+			// transform to child bone's local coordinate. Only directions are used,
+			// so rotating the offsets from the link replaces inverting its transform
+			const Quaternion toLink = ~linkWorld.GetRotation();
+			const Vector3 linkPos = linkWorld.GetTranslation();
+			auto ikTargetVec = toLink * (ikTargetBonePos - linkPos);
+			auto ikBoneVec = toLink * (ikBonePos - linkPos);
 
             // IK link's coordinate, rotate target vector V_T to V_Ik
 
@@ -716,7 +999,7 @@ void Model::UpdateIK(const IKAttr& ik)
 			Vector3 dstLocal = Normalize(ikBoneVec);
 
             if (Length( srcLocal - dstLocal) < 0.0001f)
-                return;
+                return bMoved;
 
 			float rotationDotProduct = Dot(dstLocal, srcLocal);
             float rotationAngle = ACos( rotationDotProduct );
@@ -738,12 +1021,53 @@ void Model::UpdateIK(const IKAttr& ik)
                 q0 = Quaternion( euler.GetX(), euler.GetY(), euler.GetZ() );
 			}
 
-            auto& linkLocalPose = m_LocalPose[linkIndex];
+            auto& linkLocalPose = m_LocalPose[ik.Link[k].BoneIndex];
 			Quaternion qq = q0 * linkLocalPose.GetRotation();
 			linkLocalPose = OrthogonalTransform( qq, linkLocalPose.GetTranslation() );
-			UpdateChildPose( linkIndex );
+			UpdateIKChain( chain, entry );
+            bMoved = true;
         }
 	}
+    return bMoved;
+}
+
+//
+// Links and target of 'ik' sorted by bone index, which puts parents first. The nearest
+// ancestor of an entry among the entries before it is its chain parent
+//
+void Model::BuildIKChain( IKAttr& ik ) const
+{
+    IKChain& chain = ik.Chain;
+    chain.Bone.clear();
+    for (auto& link : ik.Link)
+        chain.Bone.push_back( link.BoneIndex );
+    chain.Bone.push_back( ik.TargetBoneIndex );
+    std::sort( chain.Bone.begin(), chain.Bone.end() );
+    chain.Bone.erase( std::unique( chain.Bone.begin(), chain.Bone.end() ), chain.Bone.end() );
+
+    const size_t numEntries = chain.Bone.size();
+    chain.Parent.assign( numEntries, -1 );
+    chain.bDirect.assign( numEntries, 0 );
+    for (size_t e = 0; e < numEntries; e++)
+    {
+        for (size_t f = e; f-- > 0;)
+        {
+            if (chain.Bone[e] < m_BoneSubtreeEnd[chain.Bone[f]])
+            {
+                chain.Parent[e] = static_cast<int32_t>(f);
+                chain.bDirect[e] = m_BoneParent[chain.Bone[e]] == int32_t(chain.Bone[f]);
+                break;
+            }
+        }
+    }
+
+    auto Find = [&chain]( uint32_t bone ) {
+        return static_cast<uint32_t>(std::lower_bound( chain.Bone.begin(), chain.Bone.end(), bone ) - chain.Bone.begin());
+    };
+    chain.LinkEntry.clear();
+    for (auto& link : ik.Link)
+        chain.LinkEntry.push_back( Find( link.BoneIndex ) );
+    chain.TargetEntry = Find( ik.TargetBoneIndex );
 }
 
 void Model::Draw( GraphicsContext& gfxContext, eObjectFilter Filter )
@@ -808,14 +1132,14 @@ void Model::DrawBoundingSphere()
 
 BoundingSphere Model::GetBoundingSphere()
 {
-	if (m_BoneMotions.size() > 0)
+	if (!m_Motion.Empty())
         return m_ModelTransform * m_Skinning[m_RootBoneIndex] * m_BoundingSphere;
     return m_ModelTransform * m_BoundingSphere;
 }
 
 BoundingBox Model::GetBoundingBox()
 {
-	if (m_BoneMotions.size() > 0)
+	if (!m_Motion.Empty())
         return m_ModelTransform * m_Skinning[m_RootBoneIndex] * m_BoundingBox;
     return m_ModelTransform * m_BoundingBox;
 }
\ No newline at end of file
@@ -1,20 +1,29 @@
-#pragma once
+﻿#pragma once
 
+#include <functional>
 #include "GpuBuffer.h"
 #include "Vmd.h"
 #include "Pmx.h"
 #include "IModel.h"
 #include "KeyFrameAnimation.h"
+#include "MotionMixer.h"
+#include "Morph.h"
+#include "BoneSchedule.h"
+#include "NameTable.h"
 #include "Math/BoundingSphere.h"
 #include "Math/BoundingBox.h"
 
 class ManagedTexture;
+class BoolVar;
 
 namespace Graphics {
 namespace Pmx {
 	using namespace Math;
     using namespace Utility;
 
+    // Skeleton of big rigs updated on the thread pool, see Model::IsParallelSkeleton
+    extern BoolVar s_bParallelSkeleton;
+
 	__declspec(align(16)) struct MaterialCB
 	{
 		XMFLOAT4 Diffuse;
@@ -26,6 +35,15 @@ namespace Pmx {
 		int bUseToon;
 	};
 
+	struct VertexAttribute
+	{
+		XMFLOAT3 Normal;
+		XMFLOAT2 UV;
+		uint32_t BoneID[4] = {0, };
+		float    Weight[4] = {0.f };
+		float    EdgeSize;
+	};
+
 	enum ETextureType
 	{
 		kTextureDiffuse,
@@ -69,6 +87,37 @@ namespace Pmx {
         XMFLOAT3 MaxLimit;
     };
 
+    // Bone taking rotation and/or translation of 'Source' (fuyo), as baked in evaluation
+    // order: after its source when the source is inherent too
+    struct InherentAttr
+    {
+        enum { kRotation = 0x1, kTranslation = 0x2, kSourceTranslation = 0x4 };
+
+        uint32_t BoneIndex;
+        uint32_t Source;
+        float Coefficient; // never 0, such bones take nothing and are left out
+        uint32_t Flags;
+    };
+
+    // Bones a CCD solve moves, links and target sorted parent first
+    struct IKChain
+    {
+        std::vector<uint32_t> Bone;
+        std::vector<int32_t> Parent; // nearest ancestor among the entries, -1 if none
+        std::vector<uint8_t> bDirect; // Parent is the bone's own parent
+        std::vector<uint32_t> LinkEntry; // entry of Link[k]
+        uint32_t TargetEntry;
+    };
+
+    // Slot of a chain in an IKBatch
+    struct IKLane
+    {
+        uint32_t Group;
+        uint32_t Index;
+    };
+
+    class IKBatch;
+
     struct IKAttr
     {
         int32_t BoneIndex;
@@ -76,6 +125,7 @@ namespace Pmx {
         int32_t NumIteration;
         float LimitedRadian;
         std::vector<IKChild> Link;
+        IKChain Chain;
     };
 
     class Model final : public IModel
@@ -93,6 +143,7 @@ namespace Pmx {
         void Draw( GraphicsContext& gfxContext, eObjectFilter Filter ) override;
         bool LoadModel( ArchivePtr& Archive, Path& FilePath ) override;
         bool LoadMotion( const std::wstring& FilePath ) override;
+        bool PlayMotion( const std::wstring& FilePath, float FadeFrames ) override;
 
         BoundingSphere GetBoundingSphere();
         BoundingBox GetBoundingBox() override;
@@ -103,18 +154,47 @@ namespace Pmx {
         void SetBoundingSphere( void );
         void SetBoundingBox( void );
         void Update( float kFrameTime ) override;
+        void UpdateBuffers( GraphicsContext& gfxContext ) override;
+        void SetAnimationLod( const AnimationLod& Lod ) override { m_Lod = Lod; }
+
+        // Bone or morph index, NameTable::kInvalid when the model has no such name
+        uint32_t FindBone( const std::wstring& name ) const;
+        uint32_t FindBone( uint32_t nameId ) const; // id of Animation::InternBoneName
+        uint32_t FindMorph( const std::wstring& name ) const;
+
+        static void UpdateBatch( const std::vector<Model*>& models, float kFrameTime, IKBatch& batch, bool bParallel );
+
+        // Bones, inherents and IK of a baked model, the part of loading that needs no device
+        bool LoadSkeleton( const class ModelCache& Cache );
 
     private:
 
         void DrawBone( void );
         void DrawBoundingSphere( void );
         void SetVisualizeSkeleton();
-        void LoadBoneMotion( const std::vector<Vmd::BoneFrame>& frames );
-        void PerformTransform(uint32_t i);
+        bool LoadBakedModel( ArchivePtr& Archive, const class ModelCache& Cache );
+        Animation::MotionBinding BindMotion( const Animation::MotionClipPtr& clip ) const;
+        void PerformTransform( const InherentAttr& inherent );
+        void PerformTransforms();
         void SetBoneNum( size_t numBones );
+        void BuildIKChain( IKAttr& ik ) const;
         void UpdateIK( const IKAttr& ik );
-        void UpdateChildPose( int32_t idx );
+        void BeginIK( const IKAttr& ik );
+        void EndIK( const IKAttr& ik );
+        void UpdateIKChain( const IKChain& chain, size_t e );
+        bool SolveIK( const IKAttr& ik );
+        bool BeginUpdate( float kFrameTime );
+        void EndUpdate( float kFrameTime );
+        bool BeginMotion( float kFrameTime, float& frame );
+        void EndMotion( float kFrameTime, bool bEvaluated );
+        void EvaluateSkinning( float kFrameTime, bool bIK );
+        void BeginSkinning( float kFrameTime );
+        void EndSkinning();
         void UpdatePose();
+        void UpdatePose( uint32_t first, uint32_t last );
+        bool IsParallelSkeleton() const;
+        void ForEachBoneRange( const std::function<void(uint32_t, uint32_t)>& body ) const;
+        void UpdateMaterials();
 
     public:
         bool m_bRightHand;
@@ -123,26 +203,40 @@ namespace Pmx {
         std::vector<Mesh> m_Mesh;
         std::vector<Bone> m_Bones;
         std::vector<IKAttr> m_IKs;
-        std::vector<Quaternion> localInherentOrientations;
-        std::vector<Vector3> localInherentTranslations;
+        std::vector<OrthogonalTransform> m_IKWorld; // per chain entry, scratch of UpdateIK
+        std::vector<OrthogonalTransform> m_IKOffset;
+        bool m_bEvaluated; // state of the update between BeginUpdate and EndUpdate
+        bool m_bSkinning;
+        bool m_bSolveIK; // of UpdateBatch
+        IKLane m_IKLane;
+        std::vector<InherentAttr> m_Inherents;
+        std::vector<Vector3> localInherentTranslations; // inherited part of the translation of m_Inherents
         std::vector<OrthogonalTransform> m_toRoot; // inverse inital pose (inverse Rest)
         std::vector<OrthogonalTransform> m_LocalPose; // offset matrix
         std::vector<OrthogonalTransform> m_LocalPoseDefault; // offset matrix
         std::vector<OrthogonalTransform> m_Pose; // cumulative transfrom matrix from root
         std::vector<OrthogonalTransform> m_Skinning; // final skinning transform
         std::vector<DualQuaternion> m_SkinningDual; // final skinning transform
-        std::vector<int32_t> m_BoneParent; // parent index
-        std::vector<std::vector<int32_t>> m_BoneChild; // child indices
-        std::map<std::wstring, uint32_t> m_BoneIndex;
-        std::map<std::wstring, uint32_t> m_MorphIndex;
-        std::vector<Vector3> m_MorphDelta; // tempolar space to store morphed position delta
-        std::vector<Animation::BoneMotion> m_BoneMotions;
-        enum { kMorphBase = 0 };
-        std::vector<Animation::MorphMotion> m_MorphMotions;
+        AnimationLod m_Lod;
+        float m_LodStart, m_LodTarget; // frames of m_SkinningFrom, m_SkinningTo, negative before the first evaluation
+        std::vector<OrthogonalTransform> m_SkinningFrom; // skinning interpolated from, when not evaluated every update
+        std::vector<OrthogonalTransform> m_SkinningTo;
+        std::vector<int32_t> m_BoneParent; // parent index, less than the bone's
+        std::vector<uint32_t> m_BoneSubtreeEnd; // descendants of bone i are (i, m_BoneSubtreeEnd[i])
+        BoneSchedule m_BoneSchedule; // skeleton update of big rigs on the thread pool
+        std::vector<uint32_t> m_BoneIndex; // bone index by Animation::InternBoneName id, kInvalid if none
+        NameTable m_MorphNames;
+        std::vector<uint32_t> m_MorphIndex; // morph index by name id
+        Animation::MotionMixer m_Motion; // layers of shared bone motion bound to this model's bones
+        std::vector<Animation::MorphMotion> m_MorphMotions; // keyed weight of each morph
+        MorphEvaluator m_Morphs;
+        std::vector<MaterialMorph> m_MaterialMorph; // per mesh, from m_Morphs
+        std::vector<Mesh> m_MeshDefault; // meshes as authored, material morphs apply to these
+        std::vector<XMFLOAT4> m_EdgeColorDefault; // sRGB edge color as authored
         Animation::CameraMotion m_CameraMotion;
 
         std::vector<XMFLOAT3> m_VertexPos; // original vertex position
-        std::vector<XMFLOAT3> m_VertexMorphedPos; // temporal vertex positions which affected by face animation
+        std::vector<VertexAttribute> m_Attributes; // kept only to write UV morphs back
         std::vector<uint32_t> m_Indices;
 
         VertexBuffer m_AttributeBuffer;
@@ -0,0 +1,648 @@
+#include "ModelCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <boost/filesystem.hpp>
+
+#include "Pmx.h"
+#include "Hash.h"
+#include "Utility.h"
+#include "Math/BoundingSphere.h"
+
+using namespace DirectX;
+using namespace Graphics;
+using namespace Graphics::Pmx;
+
+namespace
+{
+    const char s_Magic[4] = { 'P', 'M', 'X', 'C' };
+
+    const uint32_t s_Stride[kSectionMax] = {
+        sizeof( VertexAttribute ),
+        sizeof( XMFLOAT3 ),
+        sizeof( uint32_t ),
+        sizeof( BakedMesh ),
+        sizeof( BakedBone ),
+        sizeof( BakedIK ),
+        sizeof( IKChild ),
+        sizeof( BakedString ),
+        sizeof( wchar_t ),
+        sizeof( BakedMorph ),
+        sizeof( BakedMorphLink ),
+        sizeof( BakedMorphVertex ),
+        sizeof( BakedMorphUV ),
+        sizeof( BakedMorphBone ),
+        sizeof( BakedMorphMaterial ),
+        sizeof( InherentAttr ),
+    };
+
+    size_t AlignSection( size_t offset )
+    {
+        return (offset + 15) & ~size_t(15);
+    }
+
+    int64_t GetWriteTime( const std::wstring& path )
+    {
+        boost::system::error_code ec;
+        auto time = boost::filesystem::last_write_time( path, ec );
+        return ec ? 0 : static_cast<int64_t>(time);
+    }
+
+    // Cache files mapped by open caches, by path. Save does not replace them,
+    // and renames under the same lock, so writers of one path go one at a time
+    std::mutex s_MappedMutex;
+    std::map<std::wstring, uint32_t> s_Mapped;
+
+    uint32_t CountMapped( const std::wstring& cachePath )
+    {
+        std::lock_guard<std::mutex> lock( s_MappedMutex );
+        auto it = s_Mapped.find( cachePath );
+        return it == s_Mapped.end() ? 0 : it->second;
+    }
+}
+
+ModelCache::~ModelCache()
+{
+    Unmap();
+}
+
+std::wstring ModelCache::GetCachePath( const std::wstring& sourcePath )
+{
+    return sourcePath + L"c";
+}
+
+bool ModelCache::Open( const std::wstring& cachePath, const std::wstring& sourcePath,
+    bool bRightHand, Utility::ByteArray& source )
+{
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Image.clear();
+    if (!Map( cachePath ))
+        return false;
+
+    Header header;
+    if (m_File.Size() < sizeof( header ))
+    {
+        Unmap();
+        return false;
+    }
+    memcpy( &header, m_File.Data(), sizeof( header ) );
+    if (memcmp( header.Magic, s_Magic, sizeof( s_Magic ) ) != 0
+        || header.Version != kVersion
+        || header.bRightHand != uint32_t(bRightHand))
+    {
+        Unmap();
+        return false;
+    }
+
+    boost::system::error_code ec;
+    auto sourceSize = boost::filesystem::file_size( sourcePath, ec );
+    if (ec || sourceSize != header.SourceSize)
+    {
+        Unmap();
+        return false;
+    }
+
+    // Touched or copied source is still fine if the contents are the same
+    const int64_t sourceTime = GetWriteTime( sourcePath );
+    if (sourceTime != header.SourceTime)
+    {
+        source = Utility::ReadFileSync( sourcePath );
+        if (Utility::HashBytes( source->data(), source->size() ) != header.SourceHash)
+        {
+            Unmap();
+            return false;
+        }
+    }
+
+    if (!Validate( header, m_File.Size() ))
+    {
+        std::wcerr << L"corrupted model cache: " << cachePath << std::endl;
+        Unmap();
+        return false;
+    }
+
+    // Saved again with the new time, so the next open does not hash the source.
+    // Left for a later open while other models map the file
+    if (sourceTime != header.SourceTime && CountMapped( cachePath ) == 1)
+    {
+        m_Image.assign( m_File.Data(), m_File.Data() + m_File.Size() );
+        Unmap();
+        reinterpret_cast<Header*>(m_Image.data())->SourceTime = sourceTime;
+        if (!Save( cachePath ))
+            Utility::Printf( L"Failed to re-stamp model cache '%ws'\n", cachePath.c_str() );
+        m_Data = m_Image.data();
+        m_Size = m_Image.size();
+    }
+    else
+    {
+        m_Data = m_File.Data();
+        m_Size = m_File.Size();
+    }
+    m_NameIndex = header.NameIndex;
+    return true;
+}
+
+bool ModelCache::Map( const std::wstring& cachePath )
+{
+    std::lock_guard<std::mutex> lock( s_MappedMutex );
+    if (!m_File.Open( cachePath ))
+        return false;
+    s_Mapped[cachePath]++;
+    m_MappedPath = cachePath;
+    return true;
+}
+
+void ModelCache::Unmap( void )
+{
+    if (!m_File.IsOpen())
+        return;
+    std::lock_guard<std::mutex> lock( s_MappedMutex );
+    m_File.Close();
+    auto it = s_Mapped.find( m_MappedPath );
+    if (--it->second == 0)
+        s_Mapped.erase( it );
+    m_MappedPath.clear();
+}
+
+bool ModelCache::Validate( const Header& header, size_t size ) const
+{
+    const size_t headerSize = AlignSection( sizeof( Header ) );
+    if (header.PayloadSize != size - headerSize)
+        return false;
+
+    for (uint32_t i = 0; i < kSectionMax; i++)
+    {
+        const Section& s = header.Sections[i];
+        if (s.Stride != s_Stride[i] || (s.Offset & 15) != 0)
+            return false;
+        if (s.Offset < headerSize || s.Offset > size || s.Count > (size - s.Offset) / s.Stride)
+            return false;
+    }
+
+    auto payload = m_File.Data() + headerSize;
+    return Utility::HashBytes( payload, header.PayloadSize ) == header.PayloadHash;
+}
+
+int32_t ModelCache::AddString( const std::wstring& str )
+{
+    BakedString s = { static_cast<uint32_t>(m_Text.size()), static_cast<uint32_t>(str.size()) };
+    m_Text.insert( m_Text.end(), str.begin(), str.end() );
+    m_Strings.push_back( s );
+    return static_cast<int32_t>(m_Strings.size() - 1);
+}
+
+std::wstring ModelCache::GetString( int32_t index ) const
+{
+    uint32_t numStrings = 0, numText = 0;
+    auto strings = Get<BakedString>( kSectionString, numStrings );
+    auto text = Get<wchar_t>( kSectionText, numText );
+    if (index < 0 || uint32_t(index) >= numStrings)
+        return std::wstring();
+    const BakedString& s = strings[index];
+    if (s.Offset > numText || s.Length > numText - s.Offset)
+        return std::wstring();
+    return std::wstring( text + s.Offset, s.Length );
+}
+
+template <typename T>
+void ModelCache::AddSection( ECacheSection section, const T* data, size_t count )
+{
+    size_t offset = AlignSection( m_Image.size() );
+    m_Image.resize( offset + sizeof( T ) * count );
+    if (count > 0)
+        memcpy( m_Image.data() + offset, data, sizeof( T ) * count );
+
+    Header* header = reinterpret_cast<Header*>(m_Image.data());
+    header->Sections[section].Offset = offset;
+    header->Sections[section].Count = static_cast<uint32_t>(count);
+    header->Sections[section].Stride = sizeof( T );
+}
+
+void Graphics::Pmx::SortBones( const std::vector<::Pmx::Bone>& bones, BoneOrder& order )
+{
+    const uint32_t numBones = static_cast<uint32_t>(bones.size());
+    auto GetParent = [&]( uint32_t i ) -> int32_t {
+        const int32_t parent = bones[i].ParentBoneIndex;
+        return parent >= 0 && uint32_t(parent) < numBones && uint32_t(parent) != i ? parent : -1;
+    };
+
+    std::vector<uint32_t> sorted( numBones );
+    std::iota( sorted.begin(), sorted.end(), 0 );
+    std::sort( sorted.begin(), sorted.end(), [&]( uint32_t a, uint32_t b ) {
+        const auto& x = bones[a];
+        const auto& y = bones[b];
+        if (x.bTransformAfterPhysics != y.bTransformAfterPhysics)
+            return y.bTransformAfterPhysics;
+        if (x.MoprhHierarchy != y.MoprhHierarchy)
+            return x.MoprhHierarchy < y.MoprhHierarchy;
+        return a < b;
+    });
+
+    // Children of each bone back to back, in transform order
+    std::vector<uint32_t> childOffset( numBones + 1, 0 ), children( numBones );
+    for (uint32_t i = 0; i < numBones; i++)
+    {
+        if (GetParent( i ) >= 0)
+            childOffset[GetParent( i ) + 1]++;
+    }
+    for (uint32_t i = 0; i < numBones; i++)
+        childOffset[i + 1] += childOffset[i];
+    std::vector<uint32_t> next( childOffset.begin(), childOffset.end() - 1 );
+    for (auto i : sorted)
+    {
+        if (GetParent( i ) >= 0)
+            children[next[GetParent( i )]++] = i;
+    }
+
+    order.Source.clear();
+    order.Source.reserve( numBones );
+    order.Index.assign( numBones, -1 );
+    order.Parent.assign( numBones, -1 );
+    order.SubtreeEnd.assign( numBones, 0 );
+
+    std::vector<std::pair<uint32_t, int32_t>> stack; // source bone, sorted parent
+    auto Walk = [&]( uint32_t root ) {
+        stack.emplace_back( root, -1 );
+        while (!stack.empty())
+        {
+            const uint32_t bone = stack.back().first;
+            const int32_t parent = stack.back().second;
+            stack.pop_back();
+            // Reached again through a parent cycle
+            if (order.Index[bone] >= 0)
+                continue;
+            const int32_t index = static_cast<int32_t>(order.Source.size());
+            order.Index[bone] = index;
+            order.Parent[index] = parent;
+            order.Source.push_back( bone );
+            for (uint32_t k = childOffset[bone + 1]; k > childOffset[bone]; k--)
+                stack.emplace_back( children[k - 1], index );
+        }
+    };
+    for (auto i : sorted)
+    {
+        if (GetParent( i ) < 0)
+            Walk( i );
+    }
+    // Only bones on a parent cycle are left, the first visited becomes a root
+    for (auto i : sorted)
+    {
+        if (order.Index[i] < 0)
+            Walk( i );
+    }
+
+    for (uint32_t i = numBones; i-- > 0;)
+    {
+        order.SubtreeEnd[i] = std::max( order.SubtreeEnd[i], i + 1 );
+        if (order.Parent[i] >= 0)
+            order.SubtreeEnd[order.Parent[i]] = std::max( order.SubtreeEnd[order.Parent[i]], order.SubtreeEnd[i] );
+    }
+}
+
+void Graphics::Pmx::SortInherents( const std::vector<BakedBone>& bones, std::vector<InherentAttr>& inherents )
+{
+    const uint32_t numBones = static_cast<uint32_t>(bones.size());
+    auto IsInherent = [&]( uint32_t i ) {
+        const auto& bone = bones[i];
+        const int32_t source = bone.ParentInherentBoneIndex;
+        return (bone.bInherentRotation || bone.bInherentTranslation) && bone.ParentInherentBoneCoefficent != 0.f
+            && source >= 0 && uint32_t(source) < numBones;
+    };
+
+    inherents.clear();
+    enum { kUnvisited, kWalked, kPlaced };
+    std::vector<uint8_t> state( numBones, kUnvisited );
+    std::vector<uint32_t> walk;
+    for (uint32_t i = 0; i < numBones; i++)
+    {
+        // Up the sources until one is placed, plain or already on the walk (a cycle)
+        for (uint32_t bone = i; IsInherent( bone ) && state[bone] == kUnvisited; bone = bones[bone].ParentInherentBoneIndex)
+        {
+            state[bone] = kWalked;
+            walk.push_back( bone );
+        }
+        // then back down, sources first
+        for (; !walk.empty(); walk.pop_back())
+        {
+            const uint32_t bone = walk.back();
+            const auto& data = bones[bone];
+            InherentAttr inherent = {};
+            inherent.BoneIndex = bone;
+            inherent.Source = data.ParentInherentBoneIndex;
+            inherent.Coefficient = data.ParentInherentBoneCoefficent;
+            if (data.bInherentRotation)
+                inherent.Flags |= InherentAttr::kRotation;
+            if (data.bInherentTranslation)
+                inherent.Flags |= InherentAttr::kTranslation;
+            if (bones[inherent.Source].bInherentTranslation)
+                inherent.Flags |= InherentAttr::kSourceTranslation;
+            inherents.push_back( inherent );
+            state[bone] = kPlaced;
+        }
+    }
+}
+
+bool ModelCache::Bake( const ::Pmx::PMX& pmx, bool bRightHand, const std::wstring& sourcePath,
+    const Utility::ByteArray& source )
+{
+    using ::Pmx::Vertex;
+    using ::Pmx::VertexStream;
+
+    Unmap();
+    m_Image.clear();
+    m_Strings.clear();
+    m_Text.clear();
+    m_Data = nullptr;
+    m_Size = 0;
+
+    const size_t numBones = pmx.m_Bones.size();
+    BoneOrder order;
+    SortBones( pmx.m_Bones, order );
+    auto RemapBone = [&]( int32_t index ) {
+        return index >= 0 && size_t(index) < numBones ? order.Index[index] : index;
+    };
+
+    const VertexStream& vertices = pmx.m_VertexStream;
+    std::vector<VertexAttribute> attributes( vertices.Size() );
+    for (auto i = 0; i < vertices.Size(); i++)
+    {
+        attributes[i].Normal = vertices.Normal[i];
+        attributes[i].UV = vertices.UV[i];
+
+        ASSERT( vertices.SkinningType[i] != Vertex::kQdef );
+
+        // ignore sdef rotation center, r0 and r1 treat as Bdef2
+        static_assert(sizeof( attributes[i].BoneID ) == sizeof( XMINT4 ), "");
+        static_assert(sizeof( attributes[i].Weight ) == sizeof( XMFLOAT4 ), "");
+        memcpy( attributes[i].BoneID, &vertices.BoneIndex[i], sizeof( attributes[i].BoneID ) );
+        memcpy( attributes[i].Weight, &vertices.Weight[i], sizeof( attributes[i].Weight ) );
+        for (auto& id : attributes[i].BoneID)
+            id = static_cast<uint32_t>(RemapBone( static_cast<int32_t>(id) ));
+        attributes[i].EdgeSize = vertices.EdgeSize[i];
+    }
+
+    m_NameIndex = AddString( pmx.m_Description.Name );
+
+    std::vector<BakedMesh> meshes;
+    meshes.reserve( pmx.m_Materials.size() );
+    uint32_t IndexOffset = 0;
+    for (auto& material : pmx.m_Materials)
+    {
+        BakedMesh mesh = {};
+        mesh.Material.Diffuse = material.Diffuse;
+        mesh.Material.SpecularPower = material.SpecularPower;
+        mesh.Material.Ambient = material.Ambient;
+        mesh.Material.SphereOperation = material.SphereOperation;
+
+        mesh.IndexCount = material.NumVertex;
+        mesh.IndexOffset = IndexOffset;
+        IndexOffset += material.NumVertex;
+
+        for (auto& texture : mesh.Texture)
+            texture = -1;
+        if (material.DiffuseTexureIndex >= 0)
+            mesh.Texture[kTextureDiffuse] = AddString( pmx.m_Textures[material.DiffuseTexureIndex] );
+        if (material.SphereTextureIndex >= 0)
+            mesh.Texture[kTextureSphere] = AddString( pmx.m_Textures[material.SphereTextureIndex] );
+
+        std::wstring ToonName;
+        if (material.bDefaultToon)
+            ToonName = std::wstring(L"toon") + std::to_wstring(material.DeafultToon) + std::wstring(L".bmp");
+        else if (material.Toon >= 0)
+            ToonName = pmx.m_Textures[material.Toon];
+        if (!ToonName.empty())
+            mesh.Texture[kTextureToon] = AddString( ToonName );
+
+        mesh.EdgeSize = material.EdgeSize;
+        mesh.EdgeColor = material.EdgeColor;
+
+        // if motion is not registered, bounding box is used to viewpoint culling
+        BoundingSphere sphere = ComputeBoundingSphereFromVertices(
+            vertices.Pos, pmx.m_Indices, mesh.IndexCount, mesh.IndexOffset );
+        XMStoreFloat4( &mesh.BoundSphere, Vector4( sphere.GetCenter(), float( sphere.GetRadius() ) ) );
+
+        meshes.push_back( mesh );
+    }
+
+    std::vector<BakedBone> bones( numBones );
+    for (auto i = 0; i < numBones; i++)
+    {
+        auto& boneData = pmx.m_Bones[order.Source[i]];
+        auto& bone = bones[i];
+
+        bone.Name = AddString( boneData.Name );
+        bone.Parent = order.Parent[i];
+        bone.SubtreeEnd = order.SubtreeEnd[i];
+
+        Vector3 origin = boneData.Position;
+        Vector3 parentOrigin = Vector3( 0.0f, 0.0f, 0.0f );
+        if (bone.Parent >= 0)
+            parentOrigin = pmx.m_Bones[order.Source[bone.Parent]].Position;
+
+        bone.Position = boneData.Position;
+        XMStoreFloat3( &bone.Translate, origin - parentOrigin );
+        bone.DestinationIndex = RemapBone( boneData.DestinationOriginIndex );
+        bone.DestinationOffset = boneData.DestinationOriginOffset;
+        bone.bInherentRotation = boneData.bInherentRotation;
+        bone.bInherentTranslation = boneData.bInherentTranslation;
+        bone.ParentInherentBoneIndex = RemapBone( boneData.ParentInherentBoneIndex );
+        bone.ParentInherentBoneCoefficent = boneData.ParentInherentBoneCoefficent;
+    }
+
+    // IKs are solved in PMX order, a later chain may read the result of an earlier one
+    std::vector<BakedIK> iks;
+    std::vector<IKChild> links;
+    for (auto i = 0; i < numBones; i++)
+    {
+        auto& boneData = pmx.m_Bones[i];
+        if (!boneData.bIK)
+            continue;
+        auto& it = boneData.Ik;
+
+        BakedIK attr = {};
+        attr.BoneIndex = order.Index[i];
+        attr.TargetBoneIndex = RemapBone( it.BoneIndex );
+        attr.LimitedRadian = it.LimitedRadian;
+        attr.NumIteration = it.NumIteration;
+        attr.LinkOffset = static_cast<uint32_t>(links.size());
+        attr.LinkCount = static_cast<uint32_t>(it.Link.size());
+
+        for (auto& ik : it.Link)
+        {
+            IKChild child = {};
+            child.BoneIndex = RemapBone( ik.BoneIndex );
+            child.bLimit = ik.bLimit;
+            child.MinLimit = ik.MinLimit;
+            child.MaxLimit = ik.MaxLimit;
+            links.push_back( child );
+        }
+        iks.push_back( attr );
+    }
+
+    std::vector<InherentAttr> inherents;
+    SortInherents( bones, inherents );
+
+    MorphTables morphs;
+    BakeMorphs( pmx, morphs );
+    for (auto& bone : morphs.Bones)
+        bone.Bone = RemapBone( bone.Bone );
+
+    const size_t headerSize = AlignSection( sizeof( Header ) );
+    m_Image.assign( headerSize, 0 );
+    AddSection( kSectionAttribute, attributes.data(), attributes.size() );
+    AddSection( kSectionPosition, vertices.Pos.data(), vertices.Pos.size() );
+    AddSection( kSectionIndex, pmx.m_Indices.data(), pmx.m_Indices.size() );
+    AddSection( kSectionMesh, meshes.data(), meshes.size() );
+    AddSection( kSectionBone, bones.data(), bones.size() );
+    AddSection( kSectionIK, iks.data(), iks.size() );
+    AddSection( kSectionIKLink, links.data(), links.size() );
+    AddSection( kSectionString, m_Strings.data(), m_Strings.size() );
+    AddSection( kSectionText, m_Text.data(), m_Text.size() );
+    AddSection( kSectionMorph, morphs.Morphs.data(), morphs.Morphs.size() );
+    AddSection( kSectionMorphLink, morphs.Links.data(), morphs.Links.size() );
+    AddSection( kSectionMorphVertex, morphs.Vertices.data(), morphs.Vertices.size() );
+    AddSection( kSectionMorphUV, morphs.UVs.data(), morphs.UVs.size() );
+    AddSection( kSectionMorphBone, morphs.Bones.data(), morphs.Bones.size() );
+    AddSection( kSectionMorphMaterial, morphs.Materials.data(), morphs.Materials.size() );
+    AddSection( kSectionInherent, inherents.data(), inherents.size() );
+    m_Image.resize( AlignSection( m_Image.size() ) );
+
+    Header* header = reinterpret_cast<Header*>(m_Image.data());
+    memcpy( header->Magic, s_Magic, sizeof( s_Magic ) );
+    header->Version = kVersion;
+    header->bRightHand = bRightHand;
+    header->NameIndex = m_NameIndex;
+    header->SourceSize = source->size();
+    header->SourceTime = GetWriteTime( sourcePath );
+    header->SourceHash = Utility::HashBytes( source->data(), source->size() );
+    header->PayloadSize = m_Image.size() - headerSize;
+    header->PayloadHash = Utility::HashBytes( m_Image.data() + headerSize, header->PayloadSize );
+
+    m_Data = m_Image.data();
+    m_Size = m_Image.size();
+    return true;
+}
+
+void ModelCache::BakeMorphs( const ::Pmx::PMX& pmx, MorphTables& tables )
+{
+    using ::Pmx::MorphType;
+
+    tables = MorphTables();
+    tables.Morphs.reserve( pmx.m_Morphs.size() );
+    for (auto& source : pmx.m_Morphs)
+    {
+        BakedMorph morph = {};
+        morph.Name = AddString( source.Name );
+        morph.Type = uint8_t(source.Type);
+        switch (source.Type)
+        {
+        case MorphType::kGroup:
+        case MorphType::kFlip:
+            morph.Offset = static_cast<uint32_t>(tables.Links.size());
+            for (auto& group : source.GroupList)
+                tables.Links.push_back( { group.Index, group.Weight } );
+            for (auto& flip : source.FlipList)
+                tables.Links.push_back( { flip.Index, flip.Value } );
+            morph.Count = static_cast<uint32_t>(tables.Links.size()) - morph.Offset;
+            break;
+        case MorphType::kVertex:
+            morph.Offset = static_cast<uint32_t>(tables.Vertices.size());
+            for (auto& vertex : source.VertexList)
+                tables.Vertices.push_back( { vertex.VertexIndex, vertex.Position } );
+            morph.Count = static_cast<uint32_t>(tables.Vertices.size()) - morph.Offset;
+            break;
+        case MorphType::kTexCoord:
+            morph.Offset = static_cast<uint32_t>(tables.UVs.size());
+            for (auto& uv : source.TexCoordList)
+                tables.UVs.push_back( { uv.VertexIndex, XMFLOAT2( uv.Position.x, uv.Position.y ) } );
+            morph.Count = static_cast<uint32_t>(tables.UVs.size()) - morph.Offset;
+            break;
+        case MorphType::kBone:
+            morph.Offset = static_cast<uint32_t>(tables.Bones.size());
+            for (auto& bone : source.BoneList)
+                tables.Bones.push_back( { int32_t(bone.BoneIndex), bone.Translation, bone.Rotation } );
+            morph.Count = static_cast<uint32_t>(tables.Bones.size()) - morph.Offset;
+            break;
+        case MorphType::kMaterial:
+            morph.Offset = static_cast<uint32_t>(tables.Materials.size());
+            for (auto& material : source.MaterialList)
+            {
+                BakedMorphMaterial offset = {};
+                offset.Material = int32_t(material.MaterialIndex);
+                offset.Operation = material.OffsetOperation;
+                offset.Diffuse = material.Diffuse;
+                offset.Specular = material.Specular;
+                offset.SpecularPower = material.SpecularPower;
+                offset.Ambient = material.Ambient;
+                offset.EdgeSize = material.EdgeSize;
+                offset.EdgeColor = material.EdgeColor;
+                tables.Materials.push_back( offset );
+            }
+            morph.Count = static_cast<uint32_t>(tables.Materials.size()) - morph.Offset;
+            break;
+        default:
+            // Additional UVs and impulses are kept by name only
+            break;
+        }
+        tables.Morphs.push_back( morph );
+    }
+}
+
+void ModelCache::GetMorphs( MorphTables& tables ) const
+{
+    auto Copy = [this]( ECacheSection section, auto& dest ) {
+        using T = typename std::remove_reference<decltype(dest)>::type::value_type;
+        uint32_t count = 0;
+        const T* data = Get<T>( section, count );
+        dest.assign( data, data + count );
+    };
+    Copy( kSectionMorph, tables.Morphs );
+    Copy( kSectionMorphLink, tables.Links );
+    Copy( kSectionMorphVertex, tables.Vertices );
+    Copy( kSectionMorphUV, tables.UVs );
+    Copy( kSectionMorphBone, tables.Bones );
+    Copy( kSectionMorphMaterial, tables.Materials );
+}
+
+bool ModelCache::Save( const std::wstring& cachePath ) const
+{
+    if (m_Image.empty())
+        return false;
+
+    // Write aside and swap, so a reader never maps half written file. Each thread
+    // writes its own file, loaders of one model can save at the same time
+    std::wstringstream ss;
+    ss << cachePath << L"." << std::hash<std::thread::id>()( std::this_thread::get_id() ) << L".tmp";
+    const std::wstring tempPath = ss.str();
+    {
+        std::ofstream file( tempPath, std::ios::binary | std::ios::trunc );
+        if (!file.is_open())
+            return false;
+        file.write( m_Image.data(), m_Image.size() );
+        if (!file.good())
+            return false;
+    }
+    boost::system::error_code ec;
+    bool bReplaced = false;
+    {
+        std::lock_guard<std::mutex> lock( s_MappedMutex );
+        if (s_Mapped.count( cachePath ) == 0)
+        {
+            boost::filesystem::rename( tempPath, cachePath, ec );
+            bReplaced = !ec;
+        }
+    }
+    if (!bReplaced)
+    {
+        boost::filesystem::remove( tempPath, ec );
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+#include "FileUtility.h"
+#include "Model.h"
+
+namespace Pmx {
+    class PMX;
+    struct Bone;
+}
+
+namespace Graphics {
+namespace Pmx {
+
+    //
+    // ".pmxc" precompiled model
+    //
+    // Runtime data of Pmx::Model baked from PMX source (GPU ready vertex/index blobs,
+    // mesh bounds, bone, IK and morph tables). Every table is a POD array placed at 16 byte
+    // aligned offset, so a warm load maps the file and takes the section pointers as is.
+    // Bones are stored in the order of SortBones and every bone index is remapped to it.
+    //
+    // Cache is discarded when its version, handedness, checksum or source file
+    // (size and mtime, or content hash when only mtime differs) does not match.
+    //
+    enum ECacheSection
+    {
+        kSectionAttribute = 0,
+        kSectionPosition,
+        kSectionIndex,
+        kSectionMesh,
+        kSectionBone,
+        kSectionIK,
+        kSectionIKLink,
+        kSectionString,
+        kSectionText,
+        kSectionMorph,
+        kSectionMorphLink,
+        kSectionMorphVertex,
+        kSectionMorphUV,
+        kSectionMorphBone,
+        kSectionMorphMaterial,
+        kSectionInherent,
+        kSectionMax
+    };
+
+    struct BakedString
+    {
+        uint32_t Offset; // in kSectionText
+        uint32_t Length;
+    };
+
+    __declspec(align(16)) struct BakedMesh
+    {
+        MaterialCB Material; // texture flags are set after textures are resolved
+        DirectX::XMFLOAT4 BoundSphere; // center, radius
+        DirectX::XMFLOAT4 EdgeColor;
+        int32_t IndexOffset;
+        uint32_t IndexCount;
+        float EdgeSize;
+        int32_t Texture[kTextureMax]; // string index, -1 if none
+    };
+
+    struct BakedBone
+    {
+        int32_t Name; // string index
+        int32_t Parent; // less than the bone's index, -1 for roots
+        uint32_t SubtreeEnd; // descendants are the bones in (index, SubtreeEnd)
+        DirectX::XMFLOAT3 Position;
+        DirectX::XMFLOAT3 Translate;
+        int32_t DestinationIndex;
+        DirectX::XMFLOAT3 DestinationOffset;
+        int32_t ParentInherentBoneIndex;
+        float ParentInherentBoneCoefficent;
+        uint8_t bInherentRotation;
+        uint8_t bInherentTranslation;
+        uint8_t Padding[2];
+    };
+
+    struct BakedIK
+    {
+        int32_t BoneIndex;
+        int32_t TargetBoneIndex;
+        int32_t NumIteration;
+        float LimitedRadian;
+        uint32_t LinkOffset; // in kSectionIKLink
+        uint32_t LinkCount;
+    };
+
+    struct BoneOrder
+    {
+        std::vector<uint32_t> Source; // source index of each sorted bone
+        std::vector<int32_t> Index; // sorted index of each source bone
+        std::vector<int32_t> Parent; // sorted parent, -1 for roots
+        std::vector<uint32_t> SubtreeEnd;
+    };
+
+    //
+    // Depth first order of the bone hierarchy: a parent precedes its children and the
+    // descendants of a bone are the range right after it, so a pose propagates in one
+    // pass and a subtree updates as a linear loop. Roots and siblings keep PMX transform
+    // order (after physics last, then deform layer, then index); the order holds among
+    // siblings only, a child always follows its parent whatever its layer, as subtrees
+    // stay contiguous. A parent link closing a cycle is dropped
+    //
+    void SortBones( const std::vector<::Pmx::Bone>& bones, BoneOrder& order );
+
+    //
+    // Bones with inherent rotation or translation in the order they are evaluated: a bone
+    // comes after its source when the source is inherent too, so it reads the source of
+    // this frame. On a cycle of sources the first bone reads its source before that is
+    // evaluated. Bones with a source out of the model or a zero coefficient are left out
+    //
+    void SortInherents( const std::vector<BakedBone>& bones, std::vector<InherentAttr>& inherents );
+
+    class ModelCache
+    {
+    public:
+        enum { kVersion = 4 };
+
+        ~ModelCache();
+
+        static std::wstring GetCachePath( const std::wstring& sourcePath );
+
+        //
+        // Maps cache file and validates it against the source.
+        // When the source had to be read to compare its hash, it is returned
+        // through 'source' so the fallback parse does not read it again. A cache
+        // whose source only changed mtime is re-stamped on disk, unless other
+        // caches have it mapped
+        //
+        bool Open( const std::wstring& cachePath, const std::wstring& sourcePath,
+            bool bRightHand, Utility::ByteArray& source );
+
+        // Bake in memory image from parsed model
+        bool Bake( const ::Pmx::PMX& pmx, bool bRightHand, const std::wstring& sourcePath,
+            const Utility::ByteArray& source );
+        // Fails, leaving the file as is, while another cache has it mapped
+        bool Save( const std::wstring& cachePath ) const;
+
+        bool IsValid() const { return m_Data != nullptr; }
+
+        template <typename T>
+        const T* Get( ECacheSection section, uint32_t& count ) const;
+        std::wstring GetString( int32_t index ) const;
+        std::wstring GetName() const { return GetString( m_NameIndex ); }
+        // Copies out the morph sections
+        void GetMorphs( MorphTables& tables ) const;
+
+    private:
+        struct Section
+        {
+            uint64_t Offset;
+            uint32_t Count;
+            uint32_t Stride;
+        };
+
+        struct Header
+        {
+            char Magic[4];
+            uint32_t Version;
+            uint32_t bRightHand;
+            int32_t NameIndex;
+            uint64_t SourceSize;
+            int64_t SourceTime;
+            uint64_t SourceHash;
+            uint64_t PayloadSize;
+            uint64_t PayloadHash;
+            Section Sections[kSectionMax];
+        };
+
+        template <typename T>
+        void AddSection( ECacheSection section, const T* data, size_t count );
+        int32_t AddString( const std::wstring& str );
+        void BakeMorphs( const ::Pmx::PMX& pmx, MorphTables& tables );
+        bool Validate( const Header& header, size_t size ) const;
+        bool Map( const std::wstring& cachePath );
+        void Unmap( void );
+
+        Utility::MappedFile m_File;
+        std::wstring m_MappedPath;
+        Utility::FileContainer m_Image;
+        std::vector<BakedString> m_Strings;
+        std::vector<wchar_t> m_Text;
+
+        const Utility::StorageType* m_Data = nullptr;
+        size_t m_Size = 0;
+        int32_t m_NameIndex = -1;
+    };
+
+    template <typename T>
+    const T* ModelCache::Get( ECacheSection section, uint32_t& count ) const
+    {
+        const Header* header = reinterpret_cast<const Header*>(m_Data);
+        const Section& s = header->Sections[section];
+        ASSERT( s.Stride == sizeof(T) );
+        count = s.Count;
+        return reinterpret_cast<const T*>(m_Data + s.Offset);
+    }
+} // namespace Pmx
+} // namespace Graphics
@@ -0,0 +1,326 @@
+#include "Morph.h"
+
+#include <algorithm>
+#include "Pmx.h"
+
+using namespace DirectX;
+using namespace Graphics;
+using namespace Graphics::Pmx;
+
+namespace
+{
+    using ::Pmx::MorphType;
+
+    const uint32_t kInvalidLink = ~0u;
+
+    XMVECTOR Load( float v ) { return XMVectorReplicate( v ); }
+    XMVECTOR Load( const XMFLOAT3& v ) { return XMLoadFloat3( &v ); }
+    XMVECTOR Load( const XMFLOAT4& v ) { return XMLoadFloat4( &v ); }
+    void Store( float& dest, FXMVECTOR v ) { dest = XMVectorGetX( v ); }
+    void Store( XMFLOAT3& dest, FXMVECTOR v ) { XMStoreFloat3( &dest, v ); }
+    void Store( XMFLOAT4& dest, FXMVECTOR v ) { XMStoreFloat4( &dest, v ); }
+
+    // Multiply offset at weight w scales by lerp(1, value, w)
+    template <typename T>
+    void Multiply( T& mul, const T& value, float w )
+    {
+        Store( mul, XMVectorMultiply( Load( mul ), XMVectorLerp( XMVectorSplatOne(), Load( value ), w ) ) );
+    }
+
+    template <typename T>
+    void Add( T& add, const T& value, float w )
+    {
+        Store( add, XMVectorMultiplyAdd( Load( value ), XMVectorReplicate( w ), Load( add ) ) );
+    }
+
+    bool Fits( const BakedMorph& morph, size_t size )
+    {
+        return morph.Offset <= size && morph.Count <= size - morph.Offset;
+    }
+}
+
+MaterialMorph MaterialMorph::Identity()
+{
+    MaterialMorph m;
+    m.DiffuseMul = XMFLOAT4( 1.f, 1.f, 1.f, 1.f );
+    m.DiffuseAdd = XMFLOAT4( 0.f, 0.f, 0.f, 0.f );
+    m.SpecularMul = XMFLOAT3( 1.f, 1.f, 1.f );
+    m.SpecularAdd = XMFLOAT3( 0.f, 0.f, 0.f );
+    m.SpecularPowerMul = 1.f;
+    m.SpecularPowerAdd = 0.f;
+    m.AmbientMul = XMFLOAT3( 1.f, 1.f, 1.f );
+    m.AmbientAdd = XMFLOAT3( 0.f, 0.f, 0.f );
+    m.EdgeSizeMul = 1.f;
+    m.EdgeSizeAdd = 0.f;
+    m.EdgeColorMul = XMFLOAT4( 1.f, 1.f, 1.f, 1.f );
+    m.EdgeColorAdd = XMFLOAT4( 0.f, 0.f, 0.f, 0.f );
+    return m;
+}
+
+bool MorphEvaluator::IsGroup( uint8_t type )
+{
+    return type == uint8_t(MorphType::kGroup) || type == uint8_t(MorphType::kFlip);
+}
+
+void MorphEvaluator::Clear( void )
+{
+    m_Tables = MorphTables();
+    m_Keyed.clear();
+    m_Weights.clear();
+    m_GroupOrder.clear();
+    m_Slot.clear();
+    m_BoneMorphs.clear();
+    m_MaterialMorphs.clear();
+    m_MaterialApplied.clear();
+    m_Positions.Clear();
+    m_UVs.Clear();
+}
+
+void MorphEvaluator::Build( MorphTables&& tables, const std::vector<XMFLOAT3>& positions,
+    const std::vector<XMFLOAT2>& uvs, size_t numBones, size_t numMaterials )
+{
+    Clear();
+    m_Tables = std::move( tables );
+    const uint32_t numMorphs = static_cast<uint32_t>(m_Tables.Morphs.size());
+    m_Keyed.assign( numMorphs, 0.f );
+    m_Weights.assign( numMorphs, 0.f );
+    m_Slot.assign( numMorphs, 0 );
+
+    m_Positions.SetBase( positions );
+    if (!m_Tables.UVs.empty())
+    {
+        std::vector<XMFLOAT3> base( uvs.size() );
+        for (size_t i = 0; i < uvs.size(); i++)
+            base[i] = XMFLOAT3( uvs[i].x, uvs[i].y, 0.f );
+        m_UVs.SetBase( base );
+    }
+
+    // Ranges and indices are checked once here, so evaluation can index freely
+    std::vector<uint32_t> indices;
+    std::vector<XMFLOAT3> offsets;
+    for (uint32_t i = 0; i < numMorphs; i++)
+    {
+        BakedMorph& morph = m_Tables.Morphs[i];
+        indices.clear();
+        offsets.clear();
+        switch (MorphType(morph.Type))
+        {
+        case MorphType::kGroup:
+        case MorphType::kFlip:
+            if (!Fits( morph, m_Tables.Links.size() ))
+                morph.Count = 0;
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                if (m_Tables.Links[k].Morph >= numMorphs)
+                    m_Tables.Links[k].Morph = kInvalidLink;
+            }
+            break;
+        case MorphType::kVertex:
+            if (!Fits( morph, m_Tables.Vertices.size() ))
+                morph.Count = 0;
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                indices.push_back( m_Tables.Vertices[k].Vertex );
+                offsets.push_back( m_Tables.Vertices[k].Offset );
+            }
+            m_Slot[i] = m_Positions.AddMorph( indices, offsets );
+            break;
+        case MorphType::kTexCoord:
+            if (!Fits( morph, m_Tables.UVs.size() ))
+                morph.Count = 0;
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                auto& uv = m_Tables.UVs[k];
+                indices.push_back( uv.Vertex );
+                offsets.push_back( XMFLOAT3( uv.Offset.x, uv.Offset.y, 0.f ) );
+            }
+            m_Slot[i] = m_UVs.AddMorph( indices, offsets );
+            break;
+        case MorphType::kBone:
+            if (!Fits( morph, m_Tables.Bones.size() ))
+                morph.Count = 0;
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                if (m_Tables.Bones[k].Bone >= int32_t(numBones))
+                    m_Tables.Bones[k].Bone = -1;
+            }
+            m_BoneMorphs.push_back( i );
+            break;
+        case MorphType::kMaterial:
+            if (!Fits( morph, m_Tables.Materials.size() ))
+                morph.Count = 0;
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                auto& material = m_Tables.Materials[k];
+                if (material.Material < -1 || material.Material >= int32_t(numMaterials))
+                    material.Material = -2;
+            }
+            m_MaterialMorphs.push_back( i );
+            break;
+        default:
+            // Additional UVs and impulses have nothing to act on
+            morph.Count = 0;
+            break;
+        }
+    }
+    m_MaterialApplied.assign( m_MaterialMorphs.size(), 0.f );
+
+    //
+    // Groups in reverse post order of a depth first walk over their links, so a group
+    // comes before every group it drives. A link closing a cycle is dropped
+    //
+    enum { kUnvisited = 0, kVisiting, kDone };
+    std::vector<uint8_t> state( numMorphs, kUnvisited );
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // morph, next link
+    for (uint32_t root = 0; root < numMorphs; root++)
+    {
+        if (!IsGroup( m_Tables.Morphs[root].Type ) || state[root] != kUnvisited)
+            continue;
+        state[root] = kVisiting;
+        stack.emplace_back( root, 0 );
+        while (!stack.empty())
+        {
+            const uint32_t group = stack.back().first;
+            const BakedMorph& morph = m_Tables.Morphs[group];
+            if (stack.back().second == morph.Count)
+            {
+                state[group] = kDone;
+                m_GroupOrder.push_back( group );
+                stack.pop_back();
+                continue;
+            }
+            BakedMorphLink& link = m_Tables.Links[morph.Offset + stack.back().second++];
+            if (link.Morph == kInvalidLink || !IsGroup( m_Tables.Morphs[link.Morph].Type ))
+                continue;
+            if (state[link.Morph] == kVisiting)
+                link.Morph = kInvalidLink;
+            else if (state[link.Morph] == kUnvisited)
+            {
+                state[link.Morph] = kVisiting;
+                stack.emplace_back( link.Morph, 0 );
+            }
+        }
+    }
+    std::reverse( m_GroupOrder.begin(), m_GroupOrder.end() );
+}
+
+void MorphEvaluator::Resolve( void )
+{
+    std::copy( m_Keyed.begin(), m_Keyed.end(), m_Weights.begin() );
+    for (auto group : m_GroupOrder)
+    {
+        const float weight = m_Weights[group];
+        const BakedMorph& morph = m_Tables.Morphs[group];
+        if (weight == 0.f || morph.Count == 0)
+            continue;
+
+        if (morph.Type == uint8_t(MorphType::kGroup))
+        {
+            for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+            {
+                const BakedMorphLink& link = m_Tables.Links[k];
+                if (link.Morph != kInvalidLink)
+                    m_Weights[link.Morph] += weight * link.Weight;
+            }
+        }
+        else if (weight > 0.f)
+        {
+            // Flip switches to one of its morphs by weight, applied at the link's value
+            const uint32_t k = std::min( static_cast<uint32_t>(weight * morph.Count), morph.Count - 1 );
+            const BakedMorphLink& link = m_Tables.Links[morph.Offset + k];
+            if (link.Morph != kInvalidLink)
+                m_Weights[link.Morph] += link.Weight;
+        }
+    }
+}
+
+void MorphEvaluator::ApplyBones( std::vector<OrthogonalTransform>& localPose ) const
+{
+    for (auto index : m_BoneMorphs)
+    {
+        const float weight = m_Weights[index];
+        if (weight == 0.f)
+            continue;
+        const BakedMorph& morph = m_Tables.Morphs[index];
+        for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+        {
+            const BakedMorphBone& bone = m_Tables.Bones[k];
+            if (bone.Bone < 0)
+                continue;
+            OrthogonalTransform& local = localPose[bone.Bone];
+            local.SetTranslation( local.GetTranslation() + Vector3( bone.Translation ) * Scalar( weight ) );
+            local.SetRotation( local.GetRotation() * Slerp( Quaternion( kIdentity ), Quaternion( bone.Rotation ), weight ) );
+        }
+    }
+}
+
+bool MorphEvaluator::ApplyVertices( void )
+{
+    const uint32_t numMorphs = static_cast<uint32_t>(m_Tables.Morphs.size());
+    for (uint32_t i = 0; i < numMorphs; i++)
+    {
+        const uint8_t type = m_Tables.Morphs[i].Type;
+        if (type == uint8_t(MorphType::kVertex))
+            m_Positions.SetWeight( m_Slot[i], m_Weights[i] );
+        else if (type == uint8_t(MorphType::kTexCoord))
+            m_UVs.SetWeight( m_Slot[i], m_Weights[i] );
+    }
+    const bool bPosition = m_Positions.Apply();
+    const bool bUV = m_UVs.Apply();
+    return bPosition || bUV;
+}
+
+bool MorphEvaluator::ApplyMaterials( std::vector<MaterialMorph>& materials )
+{
+    bool bChanged = false;
+    for (size_t i = 0; i < m_MaterialMorphs.size(); i++)
+        bChanged |= m_Weights[m_MaterialMorphs[i]] != m_MaterialApplied[i];
+    if (!bChanged)
+        return false;
+
+    std::fill( materials.begin(), materials.end(), MaterialMorph::Identity() );
+    for (size_t i = 0; i < m_MaterialMorphs.size(); i++)
+    {
+        const float w = m_Weights[m_MaterialMorphs[i]];
+        m_MaterialApplied[i] = w;
+        if (w == 0.f)
+            continue;
+
+        const BakedMorph& morph = m_Tables.Morphs[m_MaterialMorphs[i]];
+        for (uint32_t k = morph.Offset; k < morph.Offset + morph.Count; k++)
+        {
+            const BakedMorphMaterial& offset = m_Tables.Materials[k];
+            if (offset.Material < -1)
+                continue;
+            size_t first = 0, last = materials.size();
+            if (offset.Material >= 0)
+            {
+                first = offset.Material;
+                last = std::min( first + 1, materials.size() );
+            }
+            for (size_t m = first; m < last; m++)
+            {
+                MaterialMorph& out = materials[m];
+                if (offset.Operation == BakedMorphMaterial::kMultiply)
+                {
+                    Multiply( out.DiffuseMul, offset.Diffuse, w );
+                    Multiply( out.SpecularMul, offset.Specular, w );
+                    Multiply( out.SpecularPowerMul, offset.SpecularPower, w );
+                    Multiply( out.AmbientMul, offset.Ambient, w );
+                    Multiply( out.EdgeSizeMul, offset.EdgeSize, w );
+                    Multiply( out.EdgeColorMul, offset.EdgeColor, w );
+                }
+                else
+                {
+                    Add( out.DiffuseAdd, offset.Diffuse, w );
+                    Add( out.SpecularAdd, offset.Specular, w );
+                    Add( out.SpecularPowerAdd, offset.SpecularPower, w );
+                    Add( out.AmbientAdd, offset.Ambient, w );
+                    Add( out.EdgeSizeAdd, offset.EdgeSize, w );
+                    Add( out.EdgeColorAdd, offset.EdgeColor, w );
+                }
+            }
+        }
+    }
+    return true;
+}
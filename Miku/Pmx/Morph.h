@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <DirectXMath.h>
+#include "VectorMath.h"
+#include "VertexMorph.h"
+
+namespace Graphics {
+namespace Pmx {
+    using namespace Math;
+
+    //
+    // Morph tables as baked in the model cache. A morph's entries are
+    // [Offset, Offset + Count) of the table of its type
+    //
+    struct BakedMorph
+    {
+        int32_t Name; // string index
+        uint8_t Type; // (::Pmx::MorphType)
+        uint8_t Padding[3];
+        uint32_t Offset;
+        uint32_t Count;
+    };
+
+    // Group and flip morph entry
+    struct BakedMorphLink
+    {
+        uint32_t Morph;
+        float Weight;
+    };
+
+    struct BakedMorphVertex
+    {
+        uint32_t Vertex;
+        DirectX::XMFLOAT3 Offset;
+    };
+
+    // Base UV only, additional UVs are not part of the vertex layout
+    struct BakedMorphUV
+    {
+        uint32_t Vertex;
+        DirectX::XMFLOAT2 Offset;
+    };
+
+    struct BakedMorphBone
+    {
+        int32_t Bone;
+        DirectX::XMFLOAT3 Translation;
+        DirectX::XMFLOAT4 Rotation;
+    };
+
+    struct BakedMorphMaterial
+    {
+        enum { kMultiply = 0, kAdd = 1 };
+
+        int32_t Material; // -1 for all materials
+        uint32_t Operation;
+        DirectX::XMFLOAT4 Diffuse;
+        DirectX::XMFLOAT3 Specular;
+        float SpecularPower;
+        DirectX::XMFLOAT3 Ambient;
+        float EdgeSize;
+        DirectX::XMFLOAT4 EdgeColor;
+    };
+
+    struct MorphTables
+    {
+        std::vector<BakedMorph> Morphs;
+        std::vector<BakedMorphLink> Links;
+        std::vector<BakedMorphVertex> Vertices;
+        std::vector<BakedMorphUV> UVs;
+        std::vector<BakedMorphBone> Bones;
+        std::vector<BakedMorphMaterial> Materials;
+    };
+
+    //
+    // Result of the material morphs on one material: value * Mul + Add
+    //
+    struct MaterialMorph
+    {
+        DirectX::XMFLOAT4 DiffuseMul, DiffuseAdd;
+        DirectX::XMFLOAT3 SpecularMul, SpecularAdd;
+        float SpecularPowerMul, SpecularPowerAdd;
+        DirectX::XMFLOAT3 AmbientMul, AmbientAdd;
+        float EdgeSizeMul, EdgeSizeAdd;
+        DirectX::XMFLOAT4 EdgeColorMul, EdgeColorAdd;
+
+        static MaterialMorph Identity();
+    };
+
+    //
+    // Evaluates the morphs of a PMX model from the weight keyed on each.
+    //
+    // Group and flip morphs are resolved into the weights of the morphs they drive,
+    // in an order fixed at Build that puts every group before the morphs it drives,
+    // so nested groups take one pass. Each kind is then applied where it acts:
+    // vertex and UV offsets through Animation::VertexMorph (only changed morphs touch their
+    // vertices), bone offsets on the local pose before IK, and material offsets as
+    // multiply/add factors per material. Impulse morphs need physics and are ignored.
+    //
+    // Everything is sized at Build; evaluation does not allocate.
+    //
+    class MorphEvaluator
+    {
+    public:
+        void Clear( void );
+        // Entries pointing out of the model are dropped, as are group cycles
+        void Build( MorphTables&& tables, const std::vector<DirectX::XMFLOAT3>& positions,
+            const std::vector<DirectX::XMFLOAT2>& uvs, size_t numBones, size_t numMaterials );
+
+        size_t GetMorphCount( void ) const { return m_Tables.Morphs.size(); }
+        bool HasUVMorph( void ) const { return !m_Tables.UVs.empty(); }
+        bool HasMaterialMorph( void ) const { return !m_Tables.Materials.empty(); }
+
+        // Weight of the morph itself, before groups
+        void SetWeight( uint32_t morph, float weight ) { m_Keyed[morph] = weight; }
+        // Flattens group and flip morphs into m_Weights
+        void Resolve( void );
+        float GetWeight( uint32_t morph ) const { return m_Weights[morph]; }
+
+        void ApplyBones( std::vector<OrthogonalTransform>& localPose ) const;
+        // Returns whether any vertex moved
+        bool ApplyVertices( void );
+        // Recomputes 'materials' (one per material) when a material morph weight changed.
+        // Returns whether it did
+        bool ApplyMaterials( std::vector<MaterialMorph>& materials );
+
+        Animation::VertexMorph& GetPositionMorph( void ) { return m_Positions; }
+        // UV as (u, v, 0)
+        Animation::VertexMorph& GetUVMorph( void ) { return m_UVs; }
+
+    private:
+        static bool IsGroup( uint8_t type );
+
+        MorphTables m_Tables;
+        std::vector<float> m_Keyed;
+        std::vector<float> m_Weights;
+        std::vector<uint32_t> m_GroupOrder; // group and flip morphs, each before the morphs it drives
+        std::vector<uint32_t> m_Slot; // morph index in m_Positions or m_UVs
+        std::vector<uint32_t> m_BoneMorphs;
+        std::vector<uint32_t> m_MaterialMorphs;
+        std::vector<float> m_MaterialApplied; // weight per m_MaterialMorphs entry the factors were made with
+        Animation::VertexMorph m_Positions;
+        Animation::VertexMorph m_UVs;
+    };
+} // namespace Pmx
+} // namespace Graphics
@@ -0,0 +1,153 @@
+#include "VertexMorph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+using namespace Animation;
+
+const float VertexMorph::kWeightEpsilon = 1e-3f;
+
+VertexMorph::VertexMorph() : m_AppliesSinceRebuild( 0 )
+{
+}
+
+void VertexMorph::Clear( void )
+{
+	m_Base.clear();
+	m_Positions.clear();
+	m_Morphs.clear();
+	m_Index.clear();
+	m_Offset.clear();
+	m_Ranges.clear();
+	m_Dirty.clear();
+	m_AppliesSinceRebuild = 0;
+}
+
+void VertexMorph::SetBase( const std::vector<XMFLOAT3>& positions )
+{
+	m_Base = positions;
+	m_Positions = positions;
+	for (auto& morph : m_Morphs)
+		morph.Applied = 0.f;
+	m_Dirty.clear();
+	if (!m_Positions.empty())
+		m_Dirty.push_back( { 0, static_cast<uint32_t>(m_Positions.size()) } );
+}
+
+uint32_t VertexMorph::AddMorph( const std::vector<uint32_t>& indices, const std::vector<XMFLOAT3>& offsets )
+{
+	ASSERT( indices.size() == offsets.size() );
+
+	Morph morph;
+	morph.Offset = static_cast<uint32_t>(m_Index.size());
+	morph.Count = 0;
+	morph.RangeOffset = static_cast<uint32_t>(m_Ranges.size());
+	morph.RangeCount = 0;
+	morph.Weight = 0.f;
+	morph.Applied = 0.f;
+
+	const uint32_t numVertices = static_cast<uint32_t>(m_Base.size());
+	std::vector<uint32_t> sorted;
+	sorted.reserve( indices.size() );
+	for (size_t k = 0; k < indices.size(); k++)
+	{
+		if (indices[k] >= numVertices)
+			continue;
+		m_Index.push_back( indices[k] );
+		m_Offset.push_back( offsets[k] );
+		sorted.push_back( indices[k] );
+		morph.Count++;
+	}
+
+	std::sort( sorted.begin(), sorted.end() );
+	for (auto index : sorted)
+	{
+		if (morph.RangeCount > 0 && index <= m_Ranges.back().End + kRangeGap)
+		{
+			m_Ranges.back().End = std::max( m_Ranges.back().End, index + 1 );
+			continue;
+		}
+		m_Ranges.push_back( { index, index + 1 } );
+		morph.RangeCount++;
+	}
+
+	m_Morphs.push_back( morph );
+	return static_cast<uint32_t>(m_Morphs.size() - 1);
+}
+
+// Sparse scatter add, one vertex per SSE multiply-add
+void VertexMorph::AddOffsets( const Morph& morph, float weight )
+{
+	const XMVECTOR w = XMVectorReplicate( weight );
+	const uint32_t* index = m_Index.data() + morph.Offset;
+	const XMFLOAT3* offset = m_Offset.data() + morph.Offset;
+	for (uint32_t k = 0; k < morph.Count; k++)
+	{
+		XMFLOAT3& position = m_Positions[index[k]];
+		XMStoreFloat3( &position, XMVectorMultiplyAdd( XMLoadFloat3( &offset[k] ), w, XMLoadFloat3( &position ) ) );
+	}
+}
+
+void VertexMorph::MarkDirty( const Morph& morph )
+{
+	m_Dirty.insert( m_Dirty.end(), m_Ranges.begin() + morph.RangeOffset,
+		m_Ranges.begin() + morph.RangeOffset + morph.RangeCount );
+}
+
+void VertexMorph::MergeDirty( void )
+{
+	if (m_Dirty.size() < 2)
+		return;
+	std::sort( m_Dirty.begin(), m_Dirty.end(), []( const Range& a, const Range& b ) { return a.Begin < b.Begin; } );
+	size_t last = 0;
+	for (size_t i = 1; i < m_Dirty.size(); i++)
+	{
+		if (m_Dirty[i].Begin <= m_Dirty[last].End)
+			m_Dirty[last].End = std::max( m_Dirty[last].End, m_Dirty[i].End );
+		else
+			m_Dirty[++last] = m_Dirty[i];
+	}
+	m_Dirty.resize( last + 1 );
+}
+
+bool VertexMorph::IsChanged( const Morph& morph )
+{
+	const float delta = morph.Weight - morph.Applied;
+	// Return to zero is never deferred, so a closed morph does not stay slightly open
+	return delta != 0.f && (std::fabs( delta ) >= kWeightEpsilon || morph.Weight == 0.f);
+}
+
+bool VertexMorph::Apply( void )
+{
+	if (std::none_of( m_Morphs.begin(), m_Morphs.end(), IsChanged ))
+		return false;
+
+	if (++m_AppliesSinceRebuild >= kRebuildInterval)
+	{
+		m_AppliesSinceRebuild = 0;
+		m_Positions = m_Base;
+		for (auto& morph : m_Morphs)
+		{
+			if (morph.Applied != 0.f || morph.Weight != 0.f)
+				MarkDirty( morph );
+			if (morph.Weight != 0.f)
+				AddOffsets( morph, morph.Weight );
+			morph.Applied = morph.Weight;
+		}
+		MergeDirty();
+		return true;
+	}
+
+	for (auto& morph : m_Morphs)
+	{
+		if (!IsChanged( morph ))
+			continue;
+		AddOffsets( morph, morph.Weight - morph.Applied );
+		MarkDirty( morph );
+		morph.Applied = morph.Weight;
+	}
+	MergeDirty();
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "Utility.h"
+
+namespace Animation
+{
+	//
+	// Vertex positions under weighted position morphs, kept up to date incrementally.
+	// Each morph remembers the weight its offsets were last added with, and Apply adds
+	// (weight - applied) * offset for the morphs whose weight moved, so an update costs
+	// the vertices of the changed morphs only. The vertex ranges written are collected
+	// for the next upload; a morph's ranges are found once at AddMorph.
+	//
+	class VertexMorph
+	{
+	public:
+		struct Range
+		{
+			uint32_t Begin, End; // vertex [Begin, End)
+		};
+
+		// Weight changes below this wait until they add up
+		static const float kWeightEpsilon;
+		// Gap of untouched vertices a range bridges, instead of starting a new one
+		static const uint32_t kRangeGap = 32;
+		// Incremental applies before positions are rebuilt from base, dropping accumulated rounding
+		static const uint32_t kRebuildInterval = 1024;
+
+		VertexMorph();
+
+		void Clear( void );
+		void SetBase( const std::vector<DirectX::XMFLOAT3>& positions );
+		// Offsets of vertex indices[k] by offsets[k] at weight 1. Returns the morph index
+		uint32_t AddMorph( const std::vector<uint32_t>& indices, const std::vector<DirectX::XMFLOAT3>& offsets );
+
+		size_t GetMorphCount( void ) const { return m_Morphs.size(); }
+		float GetWeight( uint32_t morph ) const { return m_Morphs[morph].Weight; }
+		void SetWeight( uint32_t morph, float weight ) { m_Morphs[morph].Weight = weight; }
+
+		// Moves the vertices of the morphs whose weight changed. Returns whether any did
+		bool Apply( void );
+
+		const std::vector<DirectX::XMFLOAT3>& GetPositions( void ) const { return m_Positions; }
+		// Vertices changed since the last ClearDirty, sorted and disjoint
+		const std::vector<Range>& GetDirtyRanges( void ) const { return m_Dirty; }
+		void ClearDirty( void ) { m_Dirty.clear(); }
+
+	private:
+		struct Morph
+		{
+			uint32_t Offset, Count; // into m_Index, m_Offset
+			uint32_t RangeOffset, RangeCount; // into m_Ranges
+			float Weight;
+			float Applied; // weight the offsets are in m_Positions with
+		};
+
+		static bool IsChanged( const Morph& morph );
+		void AddOffsets( const Morph& morph, float weight );
+		void MarkDirty( const Morph& morph );
+		void MergeDirty( void );
+
+		std::vector<DirectX::XMFLOAT3> m_Base;
+		std::vector<DirectX::XMFLOAT3> m_Positions;
+		std::vector<Morph> m_Morphs;
+		std::vector<uint32_t> m_Index; // vertex per offset, all morphs back to back
+		std::vector<DirectX::XMFLOAT3> m_Offset;
+		std::vector<Range> m_Ranges;
+		std::vector<Range> m_Dirty;
+		uint32_t m_AppliesSinceRebuild;
+	};
+}
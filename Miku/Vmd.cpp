@@ -1,31 +1,86 @@
 #include "Vmd.h"
 #include "Encoding.h"
+#include "NameTable.h"
+
+#include <algorithm>
 
 namespace Vmd
 {
 	using namespace Utility;
 
-	void BoneFrame::Fill( bufferstream& is, bool bRH )
+	namespace {
+		//
+		// Decodes a block of '{ name[15], key }' records into per name tracks.
+		// First pass interns names and counts keys, second pass decodes
+		// each key straight into its slot of the track
+		//
+		template <typename Key, typename Decoder>
+		bool FillTracks( ByteReader& is, size_t keySize, std::vector<Track>& tracks, std::vector<Key>& keys, Decoder decode )
+		{
+			const size_t recordSize = sizeof( NameFieldBuf ) + keySize;
+			const uint32_t numKeys = is.ReadCount( recordSize );
+			const StorageType* records = is.Skip( numKeys * recordSize );
+			if (is.IsFail())
+				return false;
+
+			// Track index is the id of its interned name
+			NameTable names;
+			std::vector<uint32_t> keyTrack( numKeys );
+			tracks.clear();
+			for (uint32_t i = 0; i < numKeys; i++)
+			{
+				const char* name = reinterpret_cast<const char*>(records + i * recordSize);
+				const uint32_t length = static_cast<uint32_t>(strnlen( name, sizeof( NameFieldBuf ) ));
+				const uint32_t index = names.Intern( name, length );
+				if (index == tracks.size())
+					tracks.push_back( { SjisToUtf16( name, length ), 0, 0 } );
+				tracks[index].Count++;
+				keyTrack[i] = index;
+			}
+
+			uint32_t offset = 0;
+			for (auto& track : tracks)
+			{
+				track.Offset = offset;
+				offset += track.Count;
+				track.Count = 0;
+			}
+
+			keys.resize( numKeys );
+			for (uint32_t i = 0; i < numKeys; i++)
+			{
+				Track& track = tracks[keyTrack[i]];
+				ByteReader key( records + i * recordSize + sizeof( NameFieldBuf ), keySize );
+				decode( key, keys[track.Offset + track.Count++] );
+			}
+
+			// Keep file order between keys on the same frame
+			for (auto& track : tracks)
+			{
+				auto first = keys.begin() + track.Offset;
+				std::stable_sort( first, first + track.Count, []( const Key& a, const Key& b ) {
+					return a.Frame < b.Frame;
+				});
+			}
+			return true;
+		}
+	}
+
+	void BoneKey::Fill( ByteReader& is, bool bRH )
 	{
-		NameFieldBuf buffer;
-		Read( is, buffer );
-		BoneName = sjis_to_utf( buffer );
 		Read( is, Frame );
 		ReadPosition( is, Offset, bRH );
 		ReadRotation( is, Rotation, bRH );
 		Read( is, Interpolation );
 	}
 
-	void FaceFrame::Fill( bufferstream& is )
+	void FaceKey::Fill( ByteReader& is )
 	{
-		NameFieldBuf buffer;
-		Read( is, buffer );
-		FaceName = sjis_to_utf( buffer );
 		Read( is, Frame );
 		Read( is, Weight );
 	}
 
-	void CameraFrame::Fill( bufferstream& is, bool bRH )
+	void CameraFrame::Fill( ByteReader& is, bool bRH )
 	{
 		Read( is, Frame );
 		Read( is, Distance );
@@ -36,37 +91,36 @@ namespace Vmd
 		Read( is, TurnOffPerspective );
 	}
 
-	void SelfShadowFrame::Fill( bufferstream & is)
+	void SelfShadowFrame::Fill( ByteReader& is )
 	{
 		Read( is, Frame );
 		Read( is, Mode );
-		Read( is, Distance);
+		Read( is, Distance );
 	}
 
-	void LightFrame::Fill( bufferstream & is, bool bRH )
+	void LightFrame::Fill( ByteReader& is, bool bRH )
 	{
 		Read( is, Frame );
 		Read( is, Color );
 		ReadPosition( is, Position, bRH );
 	}
 
-	void IkFrame::Fill( bufferstream & is )
+	void IkFrame::Fill( ByteReader& is )
 	{
 		Read( is, Frame );
 		Read( is, Visible );
-		int32_t numIK;
-		Read( is, numIK );
+		const uint32_t numIK = is.ReadCount( sizeof( NameBuf ) + 1 );
 		IkEnable.resize( numIK );
-		for (auto i = 0; i < numIK; i++)
+		for (uint32_t i = 0; i < numIK; i++)
 		{
 			NameBuf buffer;
 			Read( is, buffer );
-			IkEnable[i].IkName = Utility::sjis_to_utf( buffer );
+			IkEnable[i].IkName = sjis_to_utf( buffer );
 			Read( is, IkEnable[i].Enable );
 		}
 	}
 
-	void VMD::Fill( bufferstream & is, bool bRH )
+	void VMD::Fill( ByteReader& is, bool bRH )
 	{
         m_IsValid = false;
 
@@ -80,60 +134,74 @@ namespace Vmd
 		}
 		char verBuf[10];
 		Read( is, verBuf );
-		Version = std::atoi( verBuf );
+		Version = std::atoi( std::string( verBuf, strnlen( verBuf, sizeof( verBuf ) ) ).c_str() );
 
 		// Name
 		NameBuf nameBuf;
 		Read( is, nameBuf );
-		Name = Utility::sjis_to_utf( nameBuf );
+		Name = sjis_to_utf( nameBuf );
 
 		// Bone frames
-		int32_t BoneFrameNum;
-		Read( is, BoneFrameNum );
-		BoneFrames.resize( BoneFrameNum );
-		for (int i = 0; i < BoneFrameNum; i++)
-			BoneFrames[i].Fill( is, bRH );
+		const size_t kBoneKeySize = sizeof( int32_t ) + sizeof( XMFLOAT3 ) + sizeof( XMFLOAT4 ) + sizeof( BoneKey::Interpolation );
+		FillTracks( is, kBoneKeySize, BoneTracks, BoneKeys, [bRH]( ByteReader& key, BoneKey& frame ) {
+			frame.Fill( key, bRH );
+		});
 
 		// Face frames
-		int32_t FaceFrameNum;
-		Read( is, FaceFrameNum );
-		FaceFrames.resize( FaceFrameNum );
-		for (int i = 0; i < FaceFrameNum; i++)
-			FaceFrames[i].Fill( is );
+		const size_t kFaceKeySize = sizeof( uint32_t ) + sizeof( float );
+		FillTracks( is, kFaceKeySize, FaceTracks, FaceKeys, []( ByteReader& key, FaceKey& frame ) {
+			frame.Fill( key );
+		});
 
 		// camera frames
-		int32_t CameraFrameNum;
-		Read( is, CameraFrameNum );
+		const uint32_t CameraFrameNum = is.ReadCount( 61 );
 		CameraFrames.resize( CameraFrameNum );
-		for (int i = 0; i < CameraFrameNum; i++)
+		for (uint32_t i = 0; i < CameraFrameNum; i++)
 			CameraFrames[i].Fill( is, bRH );
 
 		// light frames
-		int32_t LightFrameNum;
-		Read( is, LightFrameNum );
+		const uint32_t LightFrameNum = is.ReadCount( 28 );
 		LightFrames.resize( LightFrameNum );
-		for (auto i = 0; i < LightFrameNum; i++)
+		for (uint32_t i = 0; i < LightFrameNum; i++)
 			LightFrames[i].Fill( is, bRH );
 
-		int32_t SelfShadowFrameNum;
-		Read( is, SelfShadowFrameNum );
+		const uint32_t SelfShadowFrameNum = is.ReadCount( 9 );
 		SelfShadowFrames.resize( SelfShadowFrameNum );
-		for (auto i = 0; i < SelfShadowFrameNum; i++)
+		for (uint32_t i = 0; i < SelfShadowFrameNum; i++)
 			SelfShadowFrames[i].Fill( is );
 
 		// Ik frames
-		if (is.peek() != std::ios::traits_type::eof())
+		if (!is.IsEnd())
 		{
-			int32_t IkNum;
-			Read( is, IkNum );
+			const uint32_t IkNum = is.ReadCount( 9 );
 			IKFrames.resize( IkNum );
-			for (auto i = 0; i < IkNum; i++)
+			for (uint32_t i = 0; i < IkNum; i++)
 				IKFrames[i].Fill( is );
 		}
 
-		if (is.peek() != std::ios::traits_type::eof())
+		if (is.IsFail())
+		{
+			std::cerr << "truncated vmd file." << std::endl;
+			return;
+		}
+
+		if (!is.IsEnd())
 			std::cerr << "vmd stream has unknown data." << std::endl;
 
         m_IsValid = true;
 	}
+
+	void VMD::Fill( const void* data, size_t size, bool bRH )
+	{
+		ByteReader reader( data, size );
+		Fill( reader, bRH );
+	}
+
+	void VMD::Fill( bufferstream& is, bool bRH )
+	{
+		FileContainer storage;
+		ByteReader reader = MakeReader( is, storage );
+		Fill( reader, bRH );
+		Consume( is, reader );
+	}
 }
@@ -28,23 +28,33 @@ namespace Vmd
 	using NameFieldBuf = char[15];
 	using NameBuf = char[20];
 
-	struct BoneFrame
+	//
+	// Bone and face frames are bucketed per name while decoding.
+	// Keys of a track are contiguous in the key array, in file order
+	//
+	struct BoneKey
 	{
-		std::wstring BoneName;
 		int32_t Frame;
 		XMFLOAT3 Offset; // Bone location relative offset
 		XMFLOAT4 Rotation; // Quaternion
 		char Interpolation[4][4][4];
 
-		void Fill( bufferstream& is, bool bRH );
+		void Fill( ByteReader& is, bool bRH );
 	};
 
-	struct FaceFrame
+	struct FaceKey
 	{
-		std::wstring FaceName;
-		float Weight;
 		uint32_t Frame;
-		void Fill( bufferstream& is );
+		float Weight;
+
+		void Fill( ByteReader& is );
+	};
+
+	struct Track
+	{
+		std::wstring Name;
+		uint32_t Offset; // first key
+		uint32_t Count;
 	};
 
 	struct CameraFrame
@@ -57,7 +67,7 @@ namespace Vmd
 		uint32_t ViewAngle;
 		uint8_t TurnOffPerspective; // 0:On, 1:Off
 
-		void Fill( bufferstream& is, bool bRH );
+		void Fill( ByteReader& is, bool bRH );
 	};
 
 	struct LightFrame
@@ -66,7 +76,7 @@ namespace Vmd
 		XMFLOAT3 Color;
 		XMFLOAT3 Position;
 
-		void Fill( bufferstream& is, bool bRH );
+		void Fill( ByteReader& is, bool bRH );
 	};
 
 	struct SelfShadowFrame
@@ -75,7 +85,7 @@ namespace Vmd
 		uint8_t Mode; // 00-02
 		float Distance; // 0.1 - (dist * 0.00001)
 
-		void Fill( bufferstream& is );
+		void Fill( ByteReader& is );
 	};
 
 	struct IkEnable
@@ -90,7 +100,7 @@ namespace Vmd
 		uint8_t Visible;
 		std::vector<IkEnable> IkEnable;
 
-		void Fill( bufferstream& is );
+		void Fill( ByteReader& is );
 	};
 
 	class VMD
@@ -98,14 +108,18 @@ namespace Vmd
 	public:
 		std::wstring Name;
 		int Version;
-		std::vector<BoneFrame> BoneFrames;
-		std::vector<FaceFrame> FaceFrames;
+		std::vector<Track> BoneTracks;
+		std::vector<BoneKey> BoneKeys;
+		std::vector<Track> FaceTracks;
+		std::vector<FaceKey> FaceKeys;
 		std::vector<CameraFrame> CameraFrames;
 		std::vector<LightFrame> LightFrames;
 		std::vector<SelfShadowFrame> SelfShadowFrames;
 		std::vector<IkFrame> IKFrames;
 
         VMD() : m_IsValid(false) {}
+		void Fill( ByteReader& is, bool bRH );
+		void Fill( const void* data, size_t size, bool bRH );
 		void Fill( bufferstream& is, bool bRH );
         bool IsValid() const { return m_IsValid; }
         bool m_IsValid;
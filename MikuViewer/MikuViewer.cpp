@@ -24,7 +24,9 @@
 #include "GroundPlane.h"
 #include "Shadow.h"
 #include "ModelLoader.h"
+#include "ThreadPool.h"
 #include "ModelBase.h"
+#include "Pmx/IKBatch.h"
 #include "Math/BoundingBox.h"
 #include "OrthographicCamera.h"
 
@@ -112,6 +114,7 @@ private:
     void RenderLightShadows(GraphicsContext& gfxContext);
     void RenderShadowMap(GraphicsContext& gfxContext);
     MikuCamera* SelectedCamera();
+    Graphics::AnimationLod SelectAnimationLod( Graphics::IRenderObject& Model, size_t Index, float FrameStep );
 
 	MikuCamera m_Camera;
     MikuCamera m_SecondCamera;
@@ -130,6 +133,10 @@ private:
     ShadowCamera m_SunShadow;
 
     std::vector<std::shared_ptr<Graphics::IRenderObject>> m_Models;
+    uint32_t m_UpdateCount; // offsets the turns of models updated at a reduced rate
+    Graphics::Pmx::IKBatch m_IKBatch;
+    std::vector<Graphics::Pmx::Model*> m_BatchedModels;
+    std::vector<Graphics::IRenderObject*> m_SingleModels;
 	Graphics::Motion m_Motion;
 
 	GraphicsPSO m_DepthPSO[kModelMAX];
@@ -145,6 +152,13 @@ private:
 CREATE_APPLICATION( MikuViewer )
 
 NumVar m_Frame( "Application/Animation/Frame", 0, 0, 1e5, 1 );
+BoolVar m_bParallelUpdate( "Application/Animation/Parallel Update", true );
+// IK of all PMX models solved together, see Pmx::IKBatch
+BoolVar m_bBatchIK( "Application/Animation/Batch IK", true );
+BoolVar m_bAnimationLod( "Application/Animation/LOD", true );
+// Bounding sphere height as a fraction of the screen height
+NumVar m_LodFullRateSize( "Application/Animation/LOD Full Rate Size", 0.2f, 0.f, 1.f, 0.01f );
+NumVar m_LodDetailSize( "Application/Animation/LOD IK Morph Size", 0.05f, 0.f, 1.f, 0.01f );
 
 enum { kCameraMain, kCameraVirtual };
 const char* CameraNames[] = { "CameraMain", "CameraVirtual" };
@@ -175,7 +189,7 @@ BoolVar ShowWaveTileCounts("Application/Forward+/Show Wave Tile Counts", false);
 BoolVar EnableWaveOps("Application/Forward+/Enable Wave Ops", true);
 #endif
 
-MikuViewer::MikuViewer() : m_pCameraController( nullptr ), m_pSecondCameraController( nullptr )
+MikuViewer::MikuViewer() : m_pCameraController( nullptr ), m_pSecondCameraController( nullptr ), m_UpdateCount( 0 )
 {
     float Sign = Math::g_ReverseZ ? -1.f : 1.f;
     for (auto Desc : {&RasterizerShadow, &RasterizerShadowCW, &RasterizerShadowTwoSided})
@@ -193,13 +207,6 @@ void MikuViewer::Startup( void )
     Lighting::Initialize();
     ModelBase::Initialize();
 
-    struct ModelInit
-    {
-        std::wstring Model;
-        std::wstring Motion;
-        XMFLOAT3 Position;
-    };
-
     auto modelPath = L"Models/Tda式初音ミク_デフォ服ver.pmx";
     // auto modelPath = L"Models/Tda式初音ミク_デフォ服ver_ShapeChange3.pmx";
     // auto modelPath = L"Models/onda_mod_SHIMAKAZE_v090.pmx";
@@ -208,15 +215,10 @@ void MikuViewer::Startup( void )
     // auto motionPath = L"";
     auto motionPath = L"Motions/nekomimi_lat.vmd";
     // auto motionPath = L"Motions/Viva Happy Motion (Imai).vmd";
-    ModelLoader Loader( modelPath, motionPath, XMFLOAT3( 15, 0, 0 ) );
-    auto model = Loader.Load();
-    if (model)
-        m_Models.push_back( model );
-
-    std::vector<ModelInit> list = {
+    std::vector<ModelLoader> list = {
         // { L"Models/mikudayo-3_6_.pmx", L"", XMFLOAT3( 0, 0, 0 ) },
         // { L"Models/観客_右利き_サイリウム有AL.pmx", L"", XMFLOAT3( 0, 0, 0 ) },
-        { L"Models/Tda式初音ミク_デフォ服ver.pmx", motionPath, XMFLOAT3( 15, 0, 0 ) },
+        { modelPath, motionPath, XMFLOAT3( 15, 0, 0 ) },
 #if 0
         { L"Models/Lat0.pmd", motionPath, XMFLOAT3( -10.f, 0.f, 0.f ) },
         { L"Models/Library.pmd", L"", XMFLOAT3( 0.f, 1.f, 0.f ) },
@@ -226,6 +228,14 @@ void MikuViewer::Startup( void )
 #endif
     };
 
+    // Each model with its motion is loaded on the worker pool
+    for (auto& loading : ModelLoader::LoadAsync( list ))
+    {
+        auto model = loading.get();
+        if (model)
+            m_Models.push_back( model );
+    }
+
 #ifdef _DEBUG
     m_Models.emplace_back( std::make_shared<Graphics::GroundPlane>() );
 #endif
@@ -338,6 +348,37 @@ MikuCamera* MikuViewer::SelectedCamera()
         return &m_Camera;
 }
 
+//
+// Models filling a good part of the screen animate every update; smaller ones every
+// 2nd or 4th and off screen ones every 8th update, interleaved by index so the cost
+// of a crowd spreads evenly over the frames
+//
+Graphics::AnimationLod MikuViewer::SelectAnimationLod( Graphics::IRenderObject& Model, size_t Index, float FrameStep )
+{
+    Graphics::AnimationLod Lod = Graphics::AnimationLod::Full();
+    Lod.FrameStep = FrameStep;
+    if (!m_bAnimationLod)
+        return Lod;
+
+    const MikuCamera& Camera = *SelectedCamera();
+    const BoundingBox Box = Model.GetBoundingBox();
+    const Vector3 Center = (Box.GetMin() + Box.GetMax()) * 0.5f;
+    const float Radius = Length( Box.GetMax() - Box.GetMin() ) * 0.5f;
+    const float Distance = std::max( float(Length( Center - Camera.GetPosition() )), Radius );
+    const float Size = Radius / (Distance * std::tan( Camera.GetFOV() * 0.5f ));
+    const bool bVisible = Camera.GetWorldSpaceFrustum().IntersectSphere( BoundingSphere( Center, Radius ) );
+
+    if (!bVisible)
+        Lod.Interval = 8;
+    else if (Size < m_LodFullRateSize * 0.5f)
+        Lod.Interval = 4;
+    else if (Size < m_LodFullRateSize)
+        Lod.Interval = 2;
+    Lod.bEvaluate = (m_UpdateCount + Index) % Lod.Interval == 0;
+    Lod.bIK = Lod.bMorph = bVisible && Size >= m_LodDetailSize;
+    return Lod;
+}
+
 void MikuViewer::Update( float deltaT )
 {
     using namespace Lighting;
@@ -369,11 +410,40 @@ void MikuViewer::Update( float deltaT )
 	m_MainScissor.right = (LONG)g_SceneColorBuffer.GetWidth();
 	m_MainScissor.bottom = (LONG)g_SceneColorBuffer.GetHeight();
 
-    if (!EngineProfiling::IsPaused())
-        m_Frame = m_Frame + deltaT * 30.f;
+    const float FrameStep = EngineProfiling::IsPaused() ? 0.f : deltaT * 30.f;
+    m_Frame = m_Frame + FrameStep;
 
-    for (auto& model : m_Models)
-        model->Update( m_Frame );
+    {
+        ScopedTimer _prof( L"Update Models" );
+        for (size_t i = 0; i < m_Models.size(); i++)
+            m_Models[i]->SetAnimationLod( SelectAnimationLod( *m_Models[i], i, FrameStep ) );
+        m_UpdateCount++;
+
+        m_BatchedModels.clear();
+        m_SingleModels.clear();
+        for (auto& model : m_Models)
+        {
+            auto pmx = m_bBatchIK ? dynamic_cast<Graphics::Pmx::Model*>( model.get() ) : nullptr;
+            if (pmx != nullptr)
+                m_BatchedModels.push_back( pmx );
+            else
+                m_SingleModels.push_back( model.get() );
+        }
+
+        // Models share no mutable state, so the result matches the serial loop
+        const float frame = m_Frame;
+        if (!m_BatchedModels.empty())
+            Graphics::Pmx::Model::UpdateBatch( m_BatchedModels, frame, m_IKBatch, m_bParallelUpdate );
+        if (m_bParallelUpdate)
+            Utility::GetThreadPool().ParallelFor( m_SingleModels.size(), [this, frame]( size_t i ) { m_SingleModels[i]->Update( frame ); } );
+        else
+            for (auto model : m_SingleModels)
+                model->Update( frame );
+        GraphicsContext& gfxContext = GraphicsContext::Begin( L"Update Buffers" );
+        for (auto& model : m_Models)
+            model->UpdateBuffers( gfxContext );
+        gfxContext.Finish();
+    }
 	m_Motion.Update( m_Frame );
 
     m_Motion.Animate( m_Camera );
@@ -0,0 +1,229 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Archive.h"
+
+#include <fstream>
+
+using namespace Utility;
+
+namespace {
+    const std::string kStored = "Stored entry, read in place.";
+    const std::string kDeflated = "Deflated entry, deflated entry, deflated entry.";
+    // Raw deflate of kDeflated
+    const uint8_t kDeflatedData[] = {
+        0x73, 0x49, 0x4D, 0xCB, 0x49, 0x2C, 0x49, 0x4D, 0x51, 0x48, 0xCD, 0x2B, 0x29, 0xAA, 0xD4, 0x51,
+        0x48, 0xC1, 0xCB, 0xD7, 0x03, 0x00 };
+
+    // Minimal in memory zip, local headers then central directory. CRCs are left
+    // zero, the reader does not check them
+    class ZipWriter
+    {
+    public:
+        void Add( const std::string& name, uint16_t method, const void* data, size_t size, size_t uncompressedSize )
+        {
+            Entry entry = { name, method, static_cast<uint32_t>(size), static_cast<uint32_t>(uncompressedSize),
+                static_cast<uint32_t>(m_Data.size()) };
+            Value( uint32_t(0x04034b50) );
+            Value( uint16_t(20) ); // version needed
+            Value( uint16_t(0) ); // flags
+            Value( method );
+            Value( uint32_t(0) ); // time, date
+            Value( uint32_t(0) ); // crc
+            Value( entry.CompressedSize );
+            Value( entry.UncompressedSize );
+            Value( static_cast<uint16_t>(name.size()) );
+            Value( uint16_t(0) ); // extra
+            Bytes( name.data(), name.size() );
+            Bytes( data, size );
+            m_Entries.push_back( entry );
+        }
+
+        void AddStored( const std::string& name, const std::string& text )
+        {
+            Add( name, 0, text.data(), text.size(), text.size() );
+        }
+
+        // Central directory and its end record, followed by 'comment'
+        void Finish( const std::string& comment )
+        {
+            const uint32_t centralOffset = static_cast<uint32_t>(m_Data.size());
+            for (auto& entry : m_Entries)
+            {
+                Value( uint32_t(0x02014b50) );
+                Value( uint16_t(20) ); // version made by
+                Value( uint16_t(20) ); // version needed
+                Value( uint16_t(0) ); // flags
+                Value( entry.Method );
+                Value( uint32_t(0) ); // time, date
+                Value( uint32_t(0) ); // crc
+                Value( entry.CompressedSize );
+                Value( entry.UncompressedSize );
+                Value( static_cast<uint16_t>(entry.Name.size()) );
+                Value( uint16_t(0) ); // extra
+                Value( uint16_t(0) ); // comment
+                Value( uint16_t(0) ); // disk
+                Value( uint16_t(0) ); // internal attributes
+                Value( uint32_t(0) ); // external attributes
+                Value( entry.LocalHeaderOffset );
+                Bytes( entry.Name.data(), entry.Name.size() );
+            }
+            const uint32_t centralSize = static_cast<uint32_t>(m_Data.size()) - centralOffset;
+            const uint16_t numEntries = static_cast<uint16_t>(m_Entries.size());
+
+            m_EndOffset = m_Data.size();
+            Value( uint32_t(0x06054b50) );
+            Value( uint16_t(0) ); // disk
+            Value( uint16_t(0) ); // central directory disk
+            Value( numEntries );
+            Value( numEntries );
+            Value( centralSize );
+            Value( centralOffset );
+            Value( static_cast<uint16_t>(comment.size()) );
+            Bytes( comment.data(), comment.size() );
+        }
+
+        template <typename T>
+        void Value( const T& t )
+        {
+            Bytes( &t, sizeof(T) );
+        }
+
+        void Bytes( const void* data, size_t size )
+        {
+            auto p = static_cast<const char*>(data);
+            m_Data.insert( m_Data.end(), p, p + size );
+        }
+
+        // Writes the zip to a temp file and opens it
+        std::shared_ptr<ZipArchive> Open( void )
+        {
+            m_Path = fs::temp_directory_path() / fs::unique_path( L"%%%%-%%%%-%%%%.zip" );
+            {
+                std::ofstream file( m_Path.wstring(), std::ios::binary );
+                file.write( m_Data.data(), m_Data.size() );
+            }
+            return std::make_shared<ZipArchive>( m_Path.wstring() );
+        }
+
+        ~ZipWriter()
+        {
+            boost::system::error_code ec;
+            if (!m_Path.empty())
+                fs::remove( m_Path, ec );
+        }
+
+        std::vector<char> m_Data;
+        size_t m_EndOffset = 0;
+
+    private:
+        struct Entry
+        {
+            std::string Name;
+            uint16_t Method;
+            uint32_t CompressedSize;
+            uint32_t UncompressedSize;
+            uint32_t LocalHeaderOffset;
+        };
+        std::vector<Entry> m_Entries;
+        fs::path m_Path;
+    };
+
+    // Archive of a folder as the viewer expects, the folder entry first
+    void AddModel( ZipWriter& zip )
+    {
+        zip.AddStored( "model/", "" );
+        zip.AddStored( "model/stored.txt", kStored );
+        zip.Add( "model/deflated.txt", 8, kDeflatedData, sizeof(kDeflatedData), kDeflated.size() );
+    }
+
+    std::string ToString( const ByteArray& ba )
+    {
+        return std::string( ba->data(), ba->size() );
+    }
+}
+
+TEST(ZipArchiveTest, ReadEntries)
+{
+    ZipWriter zip;
+    AddModel( zip );
+    zip.Finish( "" );
+    auto archive = zip.Open();
+
+    ASSERT_EQ( archive->GetFileList().size(), 3 );
+    EXPECT_EQ( archive->GetFileList().front(), "model/" );
+    EXPECT_TRUE( archive->IsExist( "stored.txt" ) );
+    EXPECT_TRUE( archive->IsExist( "DEFLATED.TXT" ) ); // names compare without case
+    EXPECT_FALSE( archive->IsExist( "missing.txt" ) );
+
+    EXPECT_EQ( ToString( archive->GetFile( "stored.txt" ) ), kStored );
+    EXPECT_EQ( ToString( archive->GetFile( "deflated.txt" ) ), kDeflated );
+    EXPECT_EQ( archive->GetFile( "missing.txt" ), NullFile );
+}
+
+TEST(ZipArchiveTest, EndRecordBeforeComment)
+{
+    // The end record is searched backward from the end of the file, over the comment
+    ZipWriter zip;
+    AddModel( zip );
+    zip.Finish( std::string( 1000, 'c' ) + "PK" );
+    auto archive = zip.Open();
+
+    ASSERT_EQ( archive->GetFileList().size(), 3 );
+    EXPECT_EQ( ToString( archive->GetFile( "deflated.txt" ) ), kDeflated );
+}
+
+TEST(ZipArchiveTest, StoredViewIsZeroCopy)
+{
+    ZipWriter zip;
+    AddModel( zip );
+    zip.Finish( "" );
+    auto archive = zip.Open();
+
+    // Stored entries are views into the mapping: the same bytes every time,
+    // kept alive by the view after the archive is gone
+    ByteView view = archive->GetView( "stored.txt" );
+    ByteView again = archive->GetView( "stored.txt" );
+    ASSERT_EQ( view.Size(), kStored.size() );
+    EXPECT_EQ( view.Data(), again.Data() );
+    EXPECT_NE( view.Data(), archive->GetFile( "stored.txt" )->data() );
+
+    // Deflated ones are inflated into a buffer of their own
+    ByteView deflated = archive->GetView( "deflated.txt" );
+    EXPECT_EQ( std::string( deflated.Data(), deflated.Size() ), kDeflated );
+    EXPECT_NE( deflated.Data(), archive->GetView( "deflated.txt" ).Data() );
+
+    archive.reset();
+    EXPECT_EQ( std::string( view.Data(), view.Size() ), kStored );
+}
+
+TEST(ZipArchiveTest, CorruptDirectory)
+{
+    ZipWriter zip;
+    AddModel( zip );
+    zip.Finish( "" );
+    const std::vector<char> data = zip.m_Data;
+    const size_t endOffset = zip.m_EndOffset;
+
+    // Cut inside the central directory, no end record is found
+    zip.m_Data.resize( endOffset - 10 );
+    auto archive = zip.Open();
+    EXPECT_TRUE( archive->GetFileList().empty() );
+    EXPECT_FALSE( archive->IsExist( "stored.txt" ) );
+
+    // Directory offset past the end record
+    ZipWriter offset;
+    offset.m_Data = data;
+    const uint32_t badOffset = static_cast<uint32_t>(endOffset + 4);
+    memcpy( offset.m_Data.data() + endOffset + 16, &badOffset, sizeof( badOffset ) );
+    archive = offset.Open();
+    EXPECT_TRUE( archive->GetFileList().empty() );
+
+    // Deflate stream cut short: the directory reads, the entry does not
+    ZipWriter broken;
+    broken.AddStored( "model/", "" );
+    broken.Add( "model/deflated.txt", 8, kDeflatedData, sizeof(kDeflatedData) / 2, kDeflated.size() );
+    broken.Finish( "" );
+    archive = broken.Open();
+    EXPECT_TRUE( archive->IsExist( "deflated.txt" ) );
+    EXPECT_EQ( archive->GetFile( "deflated.txt" ), NullFile );
+}
@@ -0,0 +1,43 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Encoding.h"
+
+TEST(EncodingTest, SjisToUtf16)
+{
+    // "センター" and "左ひざＩＫ" in Shift-JIS
+    const char center[] = "\x83\x5A\x83\x93\x83\x5E\x81\x5B";
+    const char knee[] = "\x8D\xB6\x82\xD0\x82\xB4\x82\x68\x82\x6A";
+
+    wchar_t buffer[16];
+    size_t length = Utility::SjisToUtf16( center, sizeof(center) - 1, buffer, 16 );
+    EXPECT_EQ( std::wstring( buffer, length ), L"センター" );
+    EXPECT_EQ( Utility::SjisToUtf16( knee, sizeof(knee) - 1 ), L"左ひざＩＫ" );
+
+    // half width katakana and truncated lead byte
+    EXPECT_EQ( Utility::SjisToUtf16( "\xB1\xB2" "a" "\x83", 4 ), L"ｱｲa\xFFFD" );
+}
+
+TEST(EncodingTest, SjisNameField)
+{
+    char field[15] = "center";
+    EXPECT_EQ( Utility::sjis_to_utf( field ), L"center" );
+
+    // field without terminator ends at its size
+    memset( field, 'a', sizeof(field) );
+    EXPECT_EQ( Utility::sjis_to_utf( field ), std::wstring( 15, L'a' ) );
+}
+
+TEST(EncodingTest, Utf8ToUtf16)
+{
+    // ascii longer than one 16 byte block followed by multi byte text
+    const std::string text = "abcdefghijklmnopqrstuvwxyz \xE5\x88\x9D\xE9\x9F\xB3 \xF0\x9F\x98\x80";
+    EXPECT_EQ( Utility::Utf8ToUtf16( text.data(), text.size() ), L"abcdefghijklmnopqrstuvwxyz 初音 \xD83D\xDE00" );
+
+    // overlong and stray continuation bytes
+    EXPECT_EQ( Utility::Utf8ToUtf16( "\xC0\xAFx\x80", 4 ), L"\xFFFD\xFFFDx\xFFFD" );
+
+    // stops at destination size
+    wchar_t buffer[4];
+    EXPECT_EQ( Utility::Utf8ToUtf16( text.data(), text.size(), buffer, 4 ), 4 );
+    EXPECT_EQ( std::wstring( buffer, 4 ), L"abcd" );
+}
@@ -0,0 +1,19 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Hash.h"
+
+using namespace Utility;
+
+TEST(HashTest, HashBytes64)
+{
+    // Reference values of xxHash64, seed 0
+    EXPECT_EQ( HashBytes64( "", 0 ), 0xEF46DB3751D8E999ULL );
+    EXPECT_EQ( HashBytes64( "a", 1 ), 0xD24EC4F1A98C6E5BULL );
+    EXPECT_EQ( HashBytes64( "abc", 3 ), 0x44BC2CF5AD770999ULL );
+    const char text[] = "Nobody inspects the spammish repetition";
+    EXPECT_EQ( HashBytes64( text, sizeof(text) - 1 ), 0xFBCEA83C8A378BF1ULL );
+
+    // Seed and one byte apart give different keys
+    EXPECT_NE( HashBytes64( text, sizeof(text) - 1, 1 ), HashBytes64( text, sizeof(text) - 1 ) );
+    EXPECT_NE( HashBytes64( text, sizeof(text) - 2 ), HashBytes64( text + 1, sizeof(text) - 2 ) );
+}
@@ -0,0 +1,57 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "NameTable.h"
+
+using namespace Utility;
+
+TEST(NameTableTest, InternAndFind)
+{
+    NameTable table;
+    EXPECT_EQ( table.Find( L"center" ), NameTable::kInvalid );
+
+    const uint32_t center = table.Intern( L"center" );
+    const uint32_t knee = table.Intern( L"knee" );
+    EXPECT_EQ( center, 0 );
+    EXPECT_EQ( knee, 1 );
+    // Same name, same id
+    EXPECT_EQ( table.Intern( L"center" ), center );
+    EXPECT_EQ( table.Find( L"knee" ), knee );
+    EXPECT_EQ( table.Size(), 2 );
+
+    EXPECT_EQ( table.Find( L"ankle" ), NameTable::kInvalid );
+    EXPECT_EQ( table.Find( L"" ), NameTable::kInvalid );
+    // Keyed on bytes: a prefix, or the same text in another encoding, is another name
+    EXPECT_EQ( table.Find( L"cent" ), NameTable::kInvalid );
+    EXPECT_EQ( table.Find( "center", 6 ), NameTable::kInvalid );
+
+    size_t size = 0;
+    const char* bytes = table.GetBytes( knee, size );
+    EXPECT_EQ( std::wstring( reinterpret_cast<const wchar_t*>(bytes), size / sizeof(wchar_t) ), L"knee" );
+
+    table.Clear();
+    EXPECT_EQ( table.Size(), 0 );
+    EXPECT_EQ( table.Find( L"center" ), NameTable::kInvalid );
+}
+
+TEST(NameTableTest, IdsSurviveRehash)
+{
+    // Grows from 16 slots several times over
+    NameTable table;
+    const uint32_t numNames = 1000;
+    for (uint32_t i = 0; i < numNames; i++)
+        ASSERT_EQ( table.Intern( L"bone" + std::to_wstring( i ) ), i );
+
+    EXPECT_EQ( table.Size(), numNames );
+    for (uint32_t i = 0; i < numNames; i++)
+    {
+        const std::wstring name = L"bone" + std::to_wstring( i );
+        EXPECT_EQ( table.Find( name ), i );
+        EXPECT_EQ( table.Intern( name ), i );
+    }
+    EXPECT_EQ( table.Find( L"bone" + std::to_wstring( numNames ) ), NameTable::kInvalid );
+
+    // Reserve rehashes too
+    table.Reserve( numNames * 4 );
+    EXPECT_EQ( table.Find( L"bone500" ), 500 );
+    EXPECT_EQ( table.Intern( L"extra" ), numNames );
+}
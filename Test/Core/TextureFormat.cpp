@@ -0,0 +1,34 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "TextureFormat.h"
+
+using namespace Utility;
+
+TEST(TextureFormatTest, Signature)
+{
+    const char dds[] = "DDS \x7C\0\0\0";
+    const char png[] = "\x89PNG\r\n\x1A\n";
+    const char jpg[] = "\xFF\xD8\xFF\xE0";
+    const char hdr[] = "#?RADIANCE\n";
+    EXPECT_EQ( DetectTextureFormat( dds, sizeof(dds) - 1 ), kTextureDDS );
+    EXPECT_EQ( DetectTextureFormat( png, sizeof(png) - 1 ), kTextureWIC );
+    EXPECT_EQ( DetectTextureFormat( jpg, sizeof(jpg) - 1 ), kTextureWIC );
+    EXPECT_EQ( DetectTextureFormat( "BM", 2 ), kTextureWIC );
+    EXPECT_EQ( DetectTextureFormat( hdr, sizeof(hdr) - 1 ), kTextureHDR );
+
+    // Signature wins over the extension
+    EXPECT_EQ( DetectTextureFormat( png, sizeof(png) - 1, L"toon01.tga" ), kTextureWIC );
+}
+
+TEST(TextureFormatTest, TGA)
+{
+    // uncompressed 32 bit true color, 2x2
+    uint8_t header[18] = { 0, 0, 2, 0,0,0,0,0, 0,0,0,0, 2,0, 2,0, 32, 8 };
+    EXPECT_EQ( DetectTextureFormat( header, sizeof(header) ), kTextureTGA );
+
+    header[2] = 5; // no such image type
+    EXPECT_EQ( DetectTextureFormat( header, sizeof(header) ), kTextureUnknown );
+    EXPECT_EQ( DetectTextureFormat( header, sizeof(header), L"Tex/Skin.TGA" ), kTextureTGA );
+
+    EXPECT_EQ( DetectTextureFormat( header, 0 ), kTextureUnknown );
+}
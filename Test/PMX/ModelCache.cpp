@@ -0,0 +1,66 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Pmx.h"
+#include "Pmx/ModelCache.h"
+#include <thread>
+
+using namespace Graphics::Pmx;
+
+namespace
+{
+    const std::wstring SourcePath = ResourcePath( L"resource/観客_右利き_サイリウム有AL.pmx" );
+}
+
+TEST(PMXModelCacheTest, SaveFromThreads)
+{
+    Utility::ByteArray source = Utility::ReadFileSync( SourcePath );
+    ::Pmx::PMX pmx;
+    pmx.Fill( source->data(), source->size(), true );
+    ASSERT_TRUE( pmx.IsValid() );
+
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    ASSERT_TRUE( fs::create_directory( dir ) );
+    const std::wstring cachePath = (dir / L"model.pmxc").wstring();
+
+    // Loaders of one model bake and save it at once
+    const int numSaves = 8;
+    bool bSaved[2][numSaves] = {};
+    auto Save = [&]( int t ) {
+        for (int n = 0; n < numSaves; n++)
+        {
+            ModelCache cache;
+            if (cache.Bake( pmx, true, SourcePath, source ))
+                bSaved[t][n] = cache.Save( cachePath );
+        }
+    };
+    std::thread first( Save, 0 ), second( Save, 1 );
+    first.join();
+    second.join();
+    for (int t = 0; t < 2; t++)
+        for (int n = 0; n < numSaves; n++)
+            EXPECT_TRUE( bSaved[t][n] ) << "thread " << t << " save " << n;
+
+    // Only the cache is left, no temp file
+    std::vector<fs::path> files( (fs::directory_iterator( dir )), fs::directory_iterator() );
+    ASSERT_EQ( files.size(), 1 );
+    EXPECT_EQ( files[0].filename(), fs::path( L"model.pmxc" ) );
+
+    {
+        ModelCache opened;
+        Utility::ByteArray read;
+        ASSERT_TRUE( opened.Open( cachePath, SourcePath, true, read ) );
+        EXPECT_EQ( opened.GetName(), pmx.m_Description.Name );
+
+        // Mapped by 'opened', so not replaced
+        ModelCache baked;
+        ASSERT_TRUE( baked.Bake( pmx, true, SourcePath, source ) );
+        EXPECT_FALSE( baked.Save( cachePath ) );
+        EXPECT_TRUE( opened.IsValid() );
+    }
+    ModelCache baked;
+    ASSERT_TRUE( baked.Bake( pmx, true, SourcePath, source ) );
+    EXPECT_TRUE( baked.Save( cachePath ) );
+
+    boost::system::error_code ec;
+    fs::remove_all( dir, ec );
+}
@@ -0,0 +1,51 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Pmx/Morph.h"
+
+using namespace Graphics::Pmx;
+
+TEST(PMXMorphTest, MorphGroupResolve)
+{
+    using ::Pmx::MorphType;
+
+    auto morph = []( MorphType type, uint32_t offset, uint32_t count ) {
+        BakedMorph m = {};
+        m.Type = uint8_t(type);
+        m.Offset = offset;
+        m.Count = count;
+        return m;
+    };
+    MorphTables tables;
+    tables.Morphs = {
+        morph( MorphType::kGroup, 0, 2 ), // 0: drives group 1 and vertex morph 2
+        morph( MorphType::kGroup, 2, 2 ), // 1: drives vertex morph 3, and group 0 back
+        morph( MorphType::kVertex, 0, 1 ),
+        morph( MorphType::kVertex, 1, 1 ),
+        morph( MorphType::kFlip, 4, 2 ),
+    };
+    tables.Links = { { 1, 0.5f }, { 2, 1.f }, { 3, 1.f }, { 0, 1.f }, { 2, 1.f }, { 3, 0.5f } };
+    tables.Vertices = { { 0, XMFLOAT3( 1.f, 0.f, 0.f ) }, { 1, XMFLOAT3( 0.f, 1.f, 0.f ) } };
+
+    const std::vector<XMFLOAT3> positions( 2, XMFLOAT3( 0.f, 0.f, 0.f ) );
+    MorphEvaluator evaluator;
+    evaluator.Build( std::move( tables ), positions, {}, 0, 0 );
+    ASSERT_EQ( evaluator.GetMorphCount(), 5 );
+
+    // Nested groups resolve in one pass, the link closing the cycle is dropped
+    evaluator.SetWeight( 0, 1.f );
+    evaluator.Resolve();
+    EXPECT_FLOAT_EQ( evaluator.GetWeight( 1 ), 0.5f );
+    EXPECT_FLOAT_EQ( evaluator.GetWeight( 2 ), 1.f );
+    EXPECT_FLOAT_EQ( evaluator.GetWeight( 3 ), 0.5f );
+
+    // Flip picks its second morph at 0.6 and adds it at the link's weight
+    evaluator.SetWeight( 4, 0.6f );
+    evaluator.Resolve();
+    EXPECT_FLOAT_EQ( evaluator.GetWeight( 2 ), 1.f );
+    EXPECT_FLOAT_EQ( evaluator.GetWeight( 3 ), 1.f );
+
+    EXPECT_TRUE( evaluator.ApplyVertices() );
+    auto& result = evaluator.GetPositionMorph().GetPositions();
+    EXPECT_FLOAT_EQ( result[0].x, 1.f );
+    EXPECT_FLOAT_EQ( result[1].y, 1.f );
+}
@@ -0,0 +1,403 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Vmd.h"
+#include "KeyFrameAnimation.h"
+#include "MotionClip.h"
+#include "MotionMixer.h"
+#include "VertexMorph.h"
+
+namespace {
+    // Minimal in memory vmd with bone and face blocks only
+    class VmdWriter
+    {
+    public:
+        VmdWriter()
+        {
+            Bytes( "Vocaloid Motion Data 0002", 30 );
+            Bytes( "test", 20 );
+        }
+
+        void Bytes( const char* data, size_t size )
+        {
+            std::string field( data );
+            field.resize( size, '\0' );
+            m_Data.insert( m_Data.end(), field.begin(), field.end() );
+        }
+
+        template <typename T>
+        void Value( const T& t )
+        {
+            auto p = reinterpret_cast<const char*>(&t);
+            m_Data.insert( m_Data.end(), p, p + sizeof(T) );
+        }
+
+        void Bone( const char* name, int32_t frame, float x )
+        {
+            Bytes( name, 15 );
+            Value( frame );
+            Value( DirectX::XMFLOAT3( x, 0, 0 ) );
+            Value( DirectX::XMFLOAT4( 0, 0, 0, 1 ) );
+            Bytes( "", 64 );
+        }
+
+        void Face( const char* name, uint32_t frame, float weight )
+        {
+            Bytes( name, 15 );
+            Value( frame );
+            Value( weight );
+        }
+
+        std::vector<char> m_Data;
+    };
+}
+
+TEST(VMDMotionTest, BucketTracks)
+{
+    VmdWriter writer;
+    writer.Value( uint32_t(4) );
+    writer.Bone( "center", 10, 1.f );
+    writer.Bone( "arm", 0, 2.f );
+    writer.Bone( "center", 0, 3.f );
+    writer.Bone( "center", 5, 4.f );
+    writer.Value( uint32_t(1) );
+    writer.Face( "smile", 3, 0.5f );
+    for (int i = 0; i < 3; i++)
+        writer.Value( uint32_t(0) ); // camera, light, self shadow
+
+    Vmd::VMD vmd;
+    vmd.Fill( writer.m_Data.data(), writer.m_Data.size(), false );
+    ASSERT_TRUE( vmd.IsValid() );
+    EXPECT_EQ( vmd.Name, L"test" );
+
+    ASSERT_EQ( vmd.BoneTracks.size(), 2 );
+    ASSERT_EQ( vmd.BoneKeys.size(), 4 );
+    auto& center = vmd.BoneTracks[0];
+    EXPECT_EQ( center.Name, L"center" );
+    EXPECT_EQ( center.Count, 3 );
+    EXPECT_EQ( vmd.BoneKeys[center.Offset].Frame, 0 );
+    EXPECT_FLOAT_EQ( vmd.BoneKeys[center.Offset].Offset.x, 3.f );
+    EXPECT_EQ( vmd.BoneKeys[center.Offset + 1].Frame, 5 );
+    EXPECT_EQ( vmd.BoneKeys[center.Offset + 2].Frame, 10 );
+    auto& arm = vmd.BoneTracks[1];
+    EXPECT_EQ( arm.Name, L"arm" );
+    EXPECT_EQ( arm.Count, 1 );
+    EXPECT_FLOAT_EQ( vmd.BoneKeys[arm.Offset].Offset.x, 2.f );
+
+    ASSERT_EQ( vmd.FaceTracks.size(), 1 );
+    EXPECT_EQ( vmd.FaceTracks[0].Name, L"smile" );
+    EXPECT_FLOAT_EQ( vmd.FaceKeys[0].Weight, 0.5f );
+}
+
+TEST(VMDMotionTest, TruncatedVMD)
+{
+    VmdWriter writer;
+    writer.Value( uint32_t(100) );
+    writer.Bone( "center", 0, 0.f );
+
+    Vmd::VMD vmd;
+    vmd.Fill( writer.m_Data.data(), writer.m_Data.size(), false );
+    EXPECT_FALSE( vmd.IsValid() );
+}
+
+TEST(VMDMotionTest, BezierCurveTable)
+{
+    using namespace Animation;
+
+    // same control points give same table
+    EXPECT_EQ( BezierCurve::Get( 64, 0, 64, 127 ), BezierCurve::Get( 64, 0, 64, 127 ) );
+    EXPECT_FLOAT_EQ( BezierCurve::Linear()->Evaluate( 0.3f ), 0.3f );
+
+    // a file's cache hands out the shared tables
+    BezierCurveCache curves;
+    EXPECT_EQ( curves.Get( 64, 0, 64, 127 ), BezierCurve::Get( 64, 0, 64, 127 ) );
+    EXPECT_EQ( curves.Get( 64, 0, 64, 200 ), BezierCurve::Get( 64, 0, 64, 127 ) );
+
+    // steep and flat ends included
+    const uint8_t points[][4] = {
+        { 20, 20, 107, 107 }, { 0, 127, 0, 127 }, { 127, 0, 127, 0 },
+        { 127, 127, 0, 0 }, { 0, 64, 64, 127 }, { 90, 10, 30, 120 } };
+    const float scale = 1.0f / 127.0f;
+    for (auto& c : points)
+    {
+        const BezierCurve* curve = BezierCurve::Get( c[0], c[1], c[2], c[3] );
+        const Math::Vector4 coeff( c[0] * scale, c[1] * scale, c[2] * scale, c[3] * scale );
+        for (int i = 0; i <= 100; i++)
+        {
+            const float p = i / 100.f;
+            EXPECT_NEAR( curve->Evaluate( p ), Bezier( coeff, p ), 1e-3f );
+        }
+    }
+}
+
+TEST(VMDMotionTest, FindPreviousFrameIndex)
+{
+    using namespace Animation;
+
+    std::vector<MorphKeyFrame> keys;
+    for (int32_t frame : { 0, 3, 5, 6, 10, 20, 21, 40, 41, 42, 60 })
+        keys.push_back( { frame, 0.f } );
+    // Last key before t, by plain search
+    auto Expected = [&keys]( float t ) {
+        int32_t index = -1;
+        while (index + 1 < int32_t(keys.size()) && keys[index + 1].Frame < t)
+            index++;
+        return index;
+    };
+    auto Check = [&]( float t, int32_t& cursor ) {
+        const int32_t index = FindPreviousFrameIndex( keys, t, cursor );
+        EXPECT_EQ( index, Expected( t ) ) << "t " << t;
+        EXPECT_EQ( index, FindPreviousFrameIndex( keys, t ) ) << "t " << t;
+        EXPECT_EQ( cursor, index ) << "t " << t;
+    };
+
+    // Forward playback, from before the first key to after the last
+    int32_t cursor = 0;
+    for (float t = -2.f; t < 65.f; t += 0.5f)
+        Check( t, cursor );
+
+    // Seek back, then play on
+    Check( 4.f, cursor );
+    for (float t = 4.f; t < 12.f; t += 1.f)
+        Check( t, cursor );
+
+    // Jumps over more than kMaxStep (4) keys, forward and back
+    Check( 1.f, cursor );
+    Check( 41.5f, cursor );
+    Check( 0.5f, cursor );
+    Check( 61.f, cursor );
+}
+
+TEST(VMDMotionTest, MotionClipMatchesKeyFrames)
+{
+    using namespace Animation;
+
+    // 6 tracks: two groups of four lanes, one track without keys
+    const int numKeys[] = { 3, 0, 1, 5, 2, 4 };
+    std::vector<BoneMotion> motions( _countof(numKeys) );
+    for (size_t i = 0; i < motions.size(); i++)
+    {
+        for (int k = 0; k < numKeys[i]; k++)
+        {
+            BoneKeyFrame key;
+            key.Frame = k * 10 + int(i);
+            key.Local.SetTranslation( Vector3( float(k), float(i), -float(k * i) ) );
+            key.Local.SetRotation( Normalize( Quaternion( 0.3f * k, 0.1f * i, -0.2f * k ) ) );
+            for (int c = 0; c < 4; c++)
+                key.Curve[c] = BezierCurve::Get( uint8_t(20 + 10 * c), uint8_t(k * 25), uint8_t(107 - k), 127 );
+            motions[i].InsertKeyFrame( key );
+        }
+        motions[i].SortKeyFrame();
+    }
+
+    MotionClip clip;
+    clip.Build( motions, false );
+    ASSERT_EQ( clip.GetTrackCount(), motions.size() );
+
+    std::vector<TrackBinding> bindings( motions.size() );
+    for (size_t i = 0; i < motions.size(); i++)
+        bindings[i] = { int32_t(i), XMFLOAT3( 0.f, 0.f, 0.f ) };
+    std::vector<int32_t> cursors( motions.size(), 0 );
+    std::vector<OrthogonalTransform> pose( motions.size() ), expected( motions.size() );
+    for (float t = -1.f; t < 50.f; t += 0.7f)
+    {
+        clip.Sample( t, bindings.data(), cursors.data(), pose.data() );
+        for (size_t i = 0; i < motions.size(); i++)
+        {
+            motions[i].Interpolate( t, expected[i] );
+            // translation is quantized to 16 bits of the track's range
+            EXPECT_TRUE( Near( pose[i].GetTranslation(), expected[i].GetTranslation(), Scalar( 1e-3f ) ) );
+            EXPECT_NEAR( float(Dot( pose[i].GetRotation(), expected[i].GetRotation() )), 1.f, 1e-4f );
+        }
+    }
+}
+
+TEST(VMDMotionTest, MotionClipReduceKeys)
+{
+    using namespace Animation;
+
+    // Linear rotation and translation sampled every frame, plus a stop at the end
+    std::vector<BoneMotion> motions( 1 );
+    for (int k = 0; k <= 60; k++)
+    {
+        const float s = std::min( k, 40 ) / 40.f;
+        BoneKeyFrame key;
+        key.Frame = k;
+        key.Local.SetTranslation( Vector3( 2.f * s, 0.f, -s ) );
+        key.Local.SetRotation( Slerp( Quaternion( kIdentity ), Quaternion( Vector3( kYUnitVector ), 0.5f ), s ) );
+        for (int c = 0; c < 4; c++)
+            key.Curve[c] = BezierCurve::Linear();
+        motions[0].InsertKeyFrame( key );
+    }
+
+    MotionClip clip;
+    clip.Build( motions );
+    EXPECT_LE( clip.GetKeyCount(), 4u );
+
+    const TrackBinding binding = { 0, XMFLOAT3( 0.f, 0.f, 0.f ) };
+    int32_t cursor = 0;
+    for (float t = 0.f; t <= 60.f; t += 0.5f)
+    {
+        OrthogonalTransform pose, expected;
+        clip.Sample( t, &binding, &cursor, &pose );
+        motions[0].Interpolate( t, expected );
+        EXPECT_TRUE( Near( pose.GetTranslation(), expected.GetTranslation(), Scalar( 2e-3f ) ) );
+        EXPECT_NEAR( std::fabs( float(Dot( pose.GetRotation(), expected.GetRotation() )) ), 1.f, 1e-5f );
+    }
+}
+
+TEST(VMDMotionTest, MotionClipSharedBinding)
+{
+    using namespace Animation;
+
+    VmdWriter writer;
+    writer.Value( uint32_t(3) );
+    writer.Bone( "center", 0, 1.f );
+    writer.Bone( "arm", 0, 2.f );
+    writer.Bone( "center", 10, 3.f );
+    writer.Value( uint32_t(0) ); // face
+    for (int i = 0; i < 3; i++)
+        writer.Value( uint32_t(0) ); // camera, light, self shadow
+
+    Vmd::VMD vmd;
+    vmd.Fill( writer.m_Data.data(), writer.m_Data.size(), false );
+    ASSERT_TRUE( vmd.IsValid() );
+
+    auto clip = std::make_shared<MotionClip>();
+    clip->Build( vmd );
+    ASSERT_EQ( clip->GetTrackCount(), 2 );
+
+    // Two models with different skeletons play the same clip
+    std::vector<OrthogonalTransform> restA( 2 ), restB( 3 );
+    restA[1].SetTranslation( Vector3( 0.f, 5.f, 0.f ) );
+    restB[2].SetTranslation( Vector3( 0.f, -1.f, 0.f ) );
+    // Tracks bind by the id of their name, shared with the models
+    for (size_t i = 0; i < clip->GetTrackCount(); i++)
+        EXPECT_EQ( clip->GetTrackId( i ), FindBoneName( clip->GetTrackName( i ) ) );
+    const uint32_t center = FindBoneName( L"center" ), arm = FindBoneName( L"arm" );
+    auto findA = [=]( uint32_t id ) { return id == center ? 1 : int32_t(TrackBinding::kUnbound); };
+    auto findB = [=]( uint32_t id ) { return id == center ? 2 : id == arm ? 0 : int32_t(TrackBinding::kUnbound); };
+
+    MotionBinding a, b;
+    a.Bind( clip, restA, findA );
+    b.Bind( clip, restB, findB );
+    EXPECT_EQ( a.GetClip(), b.GetClip() );
+
+    std::vector<OrthogonalTransform> poseA = restA, poseB = restB;
+    a.Sample( 5.f, poseA.data() );
+    b.Sample( 5.f, poseB.data() );
+
+    // keyed translation is an offset from each model's own rest
+    EXPECT_TRUE( Near( poseA[1].GetTranslation(), Vector3( 2.f, 5.f, 0.f ), Scalar( 1e-3f ) ) );
+    EXPECT_TRUE( Near( poseA[0].GetTranslation(), Vector3( kZero ), Scalar( 1e-6f ) ) );
+    EXPECT_TRUE( Near( poseB[2].GetTranslation(), Vector3( 2.f, -1.f, 0.f ), Scalar( 1e-3f ) ) );
+    EXPECT_TRUE( Near( poseB[0].GetTranslation(), Vector3( 2.f, 0.f, 0.f ), Scalar( 1e-3f ) ) );
+    EXPECT_TRUE( Near( poseB[1].GetTranslation(), Vector3( kZero ), Scalar( 1e-6f ) ) );
+}
+
+TEST(VMDMotionTest, MotionMixerCrossFade)
+{
+    using namespace Animation;
+
+    // Single key clip holding one pose of the "center" bone
+    auto MakeClip = []( float x, float angle ) {
+        std::vector<BoneMotion> motions( 1 );
+        motions[0].m_Name = L"center";
+        BoneKeyFrame key;
+        key.Frame = 0;
+        key.Local.SetTranslation( Vector3( x, 0.f, 0.f ) );
+        key.Local.SetRotation( Quaternion( Vector3( kYUnitVector ), angle ) );
+        for (int c = 0; c < 4; c++)
+            key.Curve[c] = BezierCurve::Linear();
+        motions[0].InsertKeyFrame( key );
+        auto clip = std::make_shared<MotionClip>();
+        clip->Build( motions, false );
+        return MotionClipPtr( clip );
+    };
+    std::vector<OrthogonalTransform> rest( 2 );
+    auto Bind = [&rest]( MotionClipPtr clip ) {
+        MotionBinding binding;
+        binding.Bind( clip, rest, []( uint32_t id ) { return id == FindBoneName( L"center" ) ? 1 : int32_t(TrackBinding::kUnbound); } );
+        return binding;
+    };
+
+    MotionMixer mixer;
+    mixer.AddLayer( Bind( MakeClip( 0.f, 0.f ) ), kBlendOverride, 1.f, 0.f );
+    std::vector<OrthogonalTransform> pose = rest;
+    mixer.Evaluate( 10.f, pose );
+
+    const uint32_t next = mixer.AddLayer( Bind( MakeClip( 2.f, 1.f ) ), kBlendOverride, 1.f, mixer.GetTime() );
+    ASSERT_NE( next, MotionMixer::kInvalidLayer );
+    mixer.CrossFade( next, 10.f );
+
+    // Halfway through the fade
+    pose = rest;
+    mixer.Evaluate( 15.f, pose );
+    EXPECT_EQ( mixer.GetLayerCount(), 2 );
+    EXPECT_TRUE( Near( pose[1].GetTranslation(), Vector3( 1.f, 0.f, 0.f ), Scalar( 1e-3f ) ) );
+    EXPECT_NEAR( std::fabs( float(Dot( pose[1].GetRotation(), Quaternion( Vector3( kYUnitVector ), 0.5f ) )) ), 1.f, 1e-5f );
+
+    // Faded in, the old dance is dropped
+    pose = rest;
+    mixer.Evaluate( 20.f, pose );
+    EXPECT_EQ( mixer.GetLayerCount(), 1 );
+    EXPECT_TRUE( Near( pose[1].GetTranslation(), Vector3( 2.f, 0.f, 0.f ), Scalar( 1e-3f ) ) );
+
+    // Additive layer adds half of its offset, and nothing where masked off
+    const uint32_t additive = mixer.AddLayer( Bind( MakeClip( 1.f, 0.f ) ), kBlendAdditive, 0.5f, 0.f );
+    pose = rest;
+    mixer.Evaluate( 21.f, pose );
+    EXPECT_TRUE( Near( pose[1].GetTranslation(), Vector3( 2.5f, 0.f, 0.f ), Scalar( 1e-3f ) ) );
+    mixer.SetMask( additive, std::vector<float>( rest.size(), 0.f ) );
+    pose = rest;
+    mixer.Evaluate( 22.f, pose );
+    EXPECT_TRUE( Near( pose[1].GetTranslation(), Vector3( 2.f, 0.f, 0.f ), Scalar( 1e-3f ) ) );
+}
+
+TEST(VMDMotionTest, VertexMorphIncremental)
+{
+    using namespace Animation;
+
+    std::vector<XMFLOAT3> base( 300 );
+    for (size_t i = 0; i < base.size(); i++)
+        base[i] = XMFLOAT3( float(i), 0.f, 0.f );
+    const std::vector<uint32_t> mouth = { 10, 11, 12, 200 }, eye = { 12, 250 };
+    const std::vector<XMFLOAT3> mouthOffset( mouth.size(), XMFLOAT3( 0.f, 1.f, 0.f ) );
+    const std::vector<XMFLOAT3> eyeOffset( eye.size(), XMFLOAT3( 0.f, 0.f, 2.f ) );
+
+    VertexMorph morph;
+    morph.SetBase( base );
+    morph.AddMorph( mouth, mouthOffset );
+    morph.AddMorph( eye, eyeOffset );
+    morph.ClearDirty();
+
+    // Weights moved over many updates end where a single evaluation puts them
+    for (int frame = 0; frame < 100; frame++)
+    {
+        morph.SetWeight( 0, (frame % 10) * 0.1f );
+        morph.SetWeight( 1, frame * 0.01f );
+        morph.Apply();
+    }
+    morph.ClearDirty();
+    morph.SetWeight( 0, 0.5f );
+    morph.SetWeight( 1, 1.f );
+    EXPECT_TRUE( morph.Apply() );
+    auto& positions = morph.GetPositions();
+    EXPECT_NEAR( positions[11].y, 0.5f, 1e-4f );
+    EXPECT_NEAR( positions[12].y, 0.5f, 1e-4f );
+    EXPECT_NEAR( positions[12].z, 2.f, 1e-4f );
+    EXPECT_NEAR( positions[250].z, 2.f, 1e-4f );
+    EXPECT_EQ( positions[100].y, 0.f );
+
+    // Only the touched vertices are dirty: 10..12, 200 and 250
+    auto& dirty = morph.GetDirtyRanges();
+    ASSERT_EQ( dirty.size(), 3 );
+    EXPECT_EQ( dirty[0].Begin, 10 );
+    EXPECT_EQ( dirty[0].End, 13 );
+    EXPECT_EQ( dirty[1].Begin, 200 );
+    EXPECT_EQ( dirty[2].Begin, 250 );
+
+    // Unchanged weights do no work
+    morph.ClearDirty();
+    EXPECT_FALSE( morph.Apply() );
+    EXPECT_TRUE( morph.GetDirtyRanges().empty() );
+}
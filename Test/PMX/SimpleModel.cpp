@@ -3,6 +3,7 @@
 #include "Pmx.h"
 #include "Math/Vector.h"
 #include <DirectXMath.h>
+#include "Pmx/BoneSchedule.h"
 
 const std::wstring PmxModel = L"resource/観客_右利き_サイリウム有AL.pmx";
 const std::wstring PmxModelPath = ResourcePath(PmxModel);
@@ -72,4 +73,74 @@ TEST(PMXModelTest, ParsePMX)
 
     EXPECT_EQ( pmx.m_Morphs.size(), 7 );
     EXPECT_EQ( pmx.m_Morphs[6].Name, L"LightMin" );
-}
\ No newline at end of file
+}
+
+TEST(PMXModelTest, ParsePMXFromMappedFile)
+{
+    bool bRightHand = false;
+    Utility::MappedFile file;
+    ASSERT_TRUE( file.Open( PmxModelPath ) );
+    EXPECT_EQ( file.Size(), 10047 );
+
+    Utility::ByteReader reader( file );
+    Pmx::PMX pmx;
+    pmx.Fill( reader, bRightHand );
+    EXPECT_TRUE( pmx.IsValid() );
+    EXPECT_FALSE( reader.IsFail() );
+    EXPECT_TRUE( reader.IsEnd() );
+
+    EXPECT_EQ( pmx.m_Vertices[179].bdef1.BoneIndex, 3 );
+    EXPECT_EQ( pmx.m_Indices[191*3+1], 128 );
+
+    const Pmx::VertexStream& vs = pmx.m_VertexStream;
+    EXPECT_EQ( vs.Size(), pmx.m_Vertices.size() );
+    EXPECT_EQ( vs.BoneIndex[179].x, 3 );
+    EXPECT_NEAR( vs.Weight[179].x, 1.f, 1e-6f );
+    EXPECT_NEAR( vs.Weight[179].y, 0.f, 1e-6f );
+    EXPECT_THAT( Math::Vector3(vs.Pos[179]), MatcherNearFast( 1e-3f, Math::Vector3( -2.965733f, 23.75405f, -3.743936f ) ) );
+    EXPECT_EQ( pmx.m_Bones[10].NameEnglish, L"R toe" );
+    EXPECT_EQ( pmx.m_Morphs[6].Name, L"LightMin" );
+}
+
+TEST(PMXModelTest, TruncatedPMX)
+{
+    bool bRightHand = false;
+    Utility::ByteArray ba = Utility::ReadFileSync( PmxModelPath );
+
+    // cut in the middle of the vertex list
+    Pmx::PMX pmx;
+    pmx.Fill( ba->data(), ba->size() / 2, bRightHand );
+    EXPECT_FALSE( pmx.IsValid() );
+}
+
+TEST(PMXModelTest, BoneSchedule)
+{
+    using Graphics::Pmx::BoneSchedule;
+
+    // 1 and 5 under 0, 2 and 3 under 1, 4 under 3, 6 and 7 under 5
+    const std::vector<uint32_t> subtreeEnd = { 8, 5, 3, 5, 5, 8, 7, 8 };
+    // Inherent entries 1 and 4 read entry 0, entry 3 reads entry 1
+    const std::vector<int32_t> inherentAfter = { -1, 0, -1, 1, 0 };
+    BoneSchedule schedule;
+    schedule.Build( subtreeEnd, inherentAfter, 2 );
+
+    const std::vector<uint32_t> order = { 0, 2, 1, 4, 3 };
+    const std::vector<uint32_t> levels = { 0, 1, 2, 3 };
+    EXPECT_EQ( schedule.GetTransformOrder(), order );
+    EXPECT_EQ( schedule.GetTransformLevels(), levels );
+    ASSERT_EQ( schedule.GetTransformTasks().size(), 3 );
+    EXPECT_EQ( schedule.GetTransformTasks()[2].Begin, 4 );
+    EXPECT_EQ( schedule.GetTransformTasks()[2].End, 5 );
+
+    // Subtrees of at most 2 bones, siblings 6 and 7 share a task
+    const std::vector<uint32_t> spine = { 0, 1, 5 };
+    EXPECT_EQ( schedule.GetPoseSpine(), spine );
+    const auto& tasks = schedule.GetPoseTasks();
+    ASSERT_EQ( tasks.size(), 3 );
+    EXPECT_EQ( tasks[0].Begin, 2 );
+    EXPECT_EQ( tasks[0].End, 3 );
+    EXPECT_EQ( tasks[1].Begin, 3 );
+    EXPECT_EQ( tasks[1].End, 5 );
+    EXPECT_EQ( tasks[2].Begin, 6 );
+    EXPECT_EQ( tasks[2].End, 8 );
+}
@@ -0,0 +1,478 @@
+﻿#include "stdafx.h"
+#include "Common.h"
+#include "Pmx.h"
+#include "Pmx/ModelCache.h"
+#include "Pmx/Model.h"
+#include "Pmx/IKBatch.h"
+#include "MotionClip.h"
+#include "EngineTuning.h"
+
+using namespace Graphics;
+using namespace Graphics::Pmx;
+
+namespace
+{
+    ::Pmx::Bone MakeBone( int32_t parent, uint32_t layer, bool bAfterPhysics = false )
+    {
+        ::Pmx::Bone bone;
+        bone.ParentBoneIndex = parent;
+        bone.MoprhHierarchy = layer;
+        bone.bTransformAfterPhysics = bAfterPhysics;
+        return bone;
+    }
+
+    //   0 - 2 (after physics)
+    //     - 3 - 1
+    //   4 (out of range parent, layer 1)
+    //   5 - 6 - 5 (cycle)
+    //   7 (self parent)
+    std::vector<::Pmx::Bone> MakeSkeleton()
+    {
+        std::vector<::Pmx::Bone> bones;
+        bones.push_back( MakeBone( -1, 0 ) );
+        bones.push_back( MakeBone( 3, 0 ) );
+        bones.push_back( MakeBone( 0, 0, true ) );
+        bones.push_back( MakeBone( 0, 0 ) );
+        bones.push_back( MakeBone( 99, 1 ) );
+        bones.push_back( MakeBone( 6, 0 ) );
+        bones.push_back( MakeBone( 5, 0 ) );
+        bones.push_back( MakeBone( 7, 0 ) );
+        return bones;
+    }
+
+    void LoadSkeleton( const ::Pmx::PMX& pmx, Model& model )
+    {
+        ModelCache cache;
+        ASSERT_TRUE( cache.Bake( pmx, true, L"", std::make_shared<Utility::FileContainer>() ) );
+        ASSERT_TRUE( model.LoadSkeleton( cache ) );
+    }
+
+    // center - thigh - knee - ankle - toe, and a leg IK on the ankle
+    ::Pmx::PMX MakeLeg( bool bLimitKnee )
+    {
+        ::Pmx::PMX pmx;
+        const wchar_t* names[] = { L"center", L"thigh", L"knee", L"ankle", L"leg IK", L"toe" };
+        const int32_t parents[] = { -1, 0, 1, 2, 0, 3 };
+        const DirectX::XMFLOAT3 positions[] = {
+            { 0.f, 10.f, 0.f }, { 0.f, 8.f, 0.f }, { 0.f, 4.f, -0.2f },
+            { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f }, { 0.f, 0.f, -1.f } };
+        for (int i = 0; i < _countof( names ); i++)
+        {
+            pmx.m_Bones.push_back( MakeBone( parents[i], 0 ) );
+            pmx.m_Bones[i].Name = names[i];
+            pmx.m_Bones[i].Position = positions[i];
+        }
+
+        auto& ik = pmx.m_Bones[4];
+        ik.bIK = true;
+        ik.Ik.BoneIndex = 3;
+        ik.Ik.NumIteration = 20;
+        ik.Ik.LimitedRadian = 0.5f;
+        ik.Ik.Link.resize( 2 );
+        ik.Ik.Link[0].BoneIndex = 2;
+        ik.Ik.Link[1].BoneIndex = 1;
+        // Knee bends about x only. Min and max as Model::SolveIK reads them, swapped
+        ik.Ik.Link[0].bLimit = bLimitKnee;
+        ik.Ik.Link[0].MinLimit = DirectX::XMFLOAT3( -0.01f, 0.f, 0.f );
+        ik.Ik.Link[0].MaxLimit = DirectX::XMFLOAT3( -3.1f, 0.f, 0.f );
+        return pmx;
+    }
+
+    // Single key clip posing each of 'names' at the local transform of 'poses'
+    void PlayPose( Model& model, const std::vector<std::wstring>& names, const std::vector<OrthogonalTransform>& poses )
+    {
+        using namespace Animation;
+
+        std::vector<BoneMotion> motions( names.size() );
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            motions[i].m_Name = names[i];
+            BoneKeyFrame key;
+            key.Frame = 0;
+            key.Local = poses[i];
+            for (int c = 0; c < 4; c++)
+                key.Curve[c] = BezierCurve::Linear();
+            motions[i].InsertKeyFrame( key );
+        }
+        auto clip = std::make_shared<MotionClip>();
+        clip->Build( motions, false );
+
+        MotionBinding binding;
+        binding.Bind( clip, model.m_LocalPoseDefault, [&model]( uint32_t nameId ) {
+            const uint32_t index = model.FindBone( nameId );
+            return index == NameTable::kInvalid ? int32_t(TrackBinding::kUnbound) : static_cast<int32_t>(index);
+        } );
+        model.m_Motion.AddLayer( std::move( binding ), kBlendOverride, 1.f, 0.f );
+    }
+
+    //
+    // CCD as solved on the whole pose before the chain-local solve: link frames come
+    // from inverting the link's pose, and every rotation updates the link's subtree
+    //
+    void SolveFullPose( Model& model, const IKAttr& ik )
+    {
+        auto UpdateSubtree = [&model]( uint32_t bone ) {
+            for (uint32_t i = bone; i < model.m_BoneSubtreeEnd[bone]; i++)
+            {
+                const int32_t parent = model.m_BoneParent[i];
+                model.m_Pose[i] = parent >= 0 ? model.m_Pose[parent] * model.m_LocalPose[i] : model.m_LocalPose[i];
+            }
+        };
+
+        const Vector3 ikBonePos = model.m_Pose[ik.BoneIndex].GetTranslation();
+        for (int n = 0; n < ik.NumIteration; n++)
+        {
+            for (size_t k = 0; k < ik.Link.size(); k++)
+            {
+                const Vector3 targetPos = model.m_Pose[ik.TargetBoneIndex].GetTranslation();
+                if (Length( ikBonePos - targetPos ) < 0.0001f)
+                    return;
+
+                const uint32_t link = ik.Link[k].BoneIndex;
+                const OrthogonalTransform toLink = ~model.m_Pose[link];
+                const Vector3 src = Normalize( toLink * targetPos );
+                const Vector3 dst = Normalize( toLink * ikBonePos );
+                if (Length( src - dst ) < 0.0001f)
+                    return;
+
+                float angle = ACos( Dot( dst, src ) );
+                angle = std::min( ik.LimitedRadian, angle );
+                if (angle < 0.0001f)
+                    continue;
+
+                Quaternion q( Normalize( Cross( src, dst ) ), angle );
+                if (ik.Link[k].bLimit)
+                {
+                    Vector3 euler( q.Euler() );
+                    euler = Clamp( euler, Vector3( ik.Link[k].MaxLimit ), Vector3( ik.Link[k].MinLimit ) );
+                    q = Quaternion( euler.GetX(), euler.GetY(), euler.GetZ() );
+                }
+                OrthogonalTransform& local = model.m_LocalPose[link];
+                local = OrthogonalTransform( q * local.GetRotation(), local.GetTranslation() );
+                UpdateSubtree( link );
+            }
+        }
+    }
+
+    void ExpectSamePose( const std::vector<OrthogonalTransform>& a, const std::vector<OrthogonalTransform>& b, float tolerance )
+    {
+        ASSERT_EQ( a.size(), b.size() );
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            EXPECT_NEAR( std::fabs( float(Dot( a[i].GetRotation(), b[i].GetRotation() )) ), 1.f, tolerance ) << "bone " << i;
+            EXPECT_TRUE( Near( a[i].GetTranslation(), b[i].GetTranslation(), Scalar( tolerance ) ) ) << "bone " << i;
+        }
+    }
+}
+
+TEST(PMXSkeletonTest, SortBones)
+{
+    BoneOrder order;
+    SortBones( MakeSkeleton(), order );
+
+    // Siblings 3 before 2 (after physics), roots 7 before 4 (layer 1), the cycle last
+    const std::vector<uint32_t> source = { 0, 3, 1, 2, 7, 4, 5, 6 };
+    const std::vector<int32_t> index = { 0, 2, 3, 1, 5, 6, 7, 4 };
+    const std::vector<int32_t> parent = { -1, 0, 1, 0, -1, -1, -1, 6 };
+    const std::vector<uint32_t> subtreeEnd = { 4, 3, 3, 4, 5, 6, 8, 8 };
+    EXPECT_EQ( order.Source, source );
+    EXPECT_EQ( order.Index, index );
+    EXPECT_EQ( order.Parent, parent );
+    EXPECT_EQ( order.SubtreeEnd, subtreeEnd );
+}
+
+TEST(PMXSkeletonTest, SortInherents)
+{
+    std::vector<BakedBone> bones( 10 );
+    auto Inherit = [&bones]( uint32_t i, int32_t source, float coefficient, bool bRotation, bool bTranslation ) {
+        bones[i].ParentInherentBoneIndex = source;
+        bones[i].ParentInherentBoneCoefficent = coefficient;
+        bones[i].bInherentRotation = bRotation;
+        bones[i].bInherentTranslation = bTranslation;
+    };
+    for (uint32_t i = 0; i < bones.size(); i++)
+        Inherit( i, -1, 0.f, false, false );
+    // Chain 1 <- 3 <- 2 off the plain bone 0
+    Inherit( 1, 0, 1.f, true, false );
+    Inherit( 2, 3, 0.5f, true, false );
+    Inherit( 3, 1, 1.f, false, true );
+    // Cycle of 4 and 5, then 6 reading itself
+    Inherit( 4, 5, 1.f, false, true );
+    Inherit( 5, 4, 1.f, true, false );
+    Inherit( 6, 6, 1.f, true, false );
+    // Left out: zero coefficient, source out of the model, neither rotation nor translation
+    Inherit( 7, 0, 0.f, true, false );
+    Inherit( 8, 99, 1.f, true, false );
+    Inherit( 9, 0, 1.f, false, false );
+
+    std::vector<InherentAttr> inherents;
+    SortInherents( bones, inherents );
+
+    const uint32_t bone[] = { 1, 3, 2, 5, 4, 6 };
+    const uint32_t source[] = { 0, 1, 3, 4, 5, 6 };
+    const uint32_t flags[] = {
+        InherentAttr::kRotation,
+        InherentAttr::kTranslation,
+        InherentAttr::kRotation | InherentAttr::kSourceTranslation,
+        InherentAttr::kRotation | InherentAttr::kSourceTranslation,
+        InherentAttr::kTranslation,
+        InherentAttr::kRotation };
+    ASSERT_EQ( inherents.size(), _countof( bone ) );
+    for (size_t e = 0; e < inherents.size(); e++)
+    {
+        EXPECT_EQ( inherents[e].BoneIndex, bone[e] ) << "entry " << e;
+        EXPECT_EQ( inherents[e].Source, source[e] ) << "entry " << e;
+        EXPECT_EQ( inherents[e].Flags, flags[e] ) << "entry " << e;
+    }
+    EXPECT_FLOAT_EQ( inherents[2].Coefficient, 0.5f );
+}
+
+TEST(PMXSkeletonTest, BakeRemapsBones)
+{
+    ::Pmx::PMX pmx;
+    pmx.m_Bones = MakeSkeleton();
+    pmx.m_Bones[0].DestinationOriginIndex = 3;
+
+    // IKs on 1 and 3, sorted to 2 and 1, are kept in source order
+    pmx.m_Bones[1].bIK = true;
+    pmx.m_Bones[1].Ik.BoneIndex = 4;
+    pmx.m_Bones[1].Ik.Link.resize( 1 );
+    pmx.m_Bones[1].Ik.Link[0].BoneIndex = 0;
+    pmx.m_Bones[1].Ik.Link[0].bLimit = true;
+    pmx.m_Bones[3].bIK = true;
+    pmx.m_Bones[3].Ik.BoneIndex = 2;
+    pmx.m_Bones[3].Ik.Link.resize( 1 );
+    pmx.m_Bones[3].Ik.Link[0].BoneIndex = 1;
+
+    pmx.m_Bones[2].bInherentRotation = true;
+    pmx.m_Bones[2].ParentInherentBoneIndex = 4;
+    pmx.m_Bones[2].ParentInherentBoneCoefficent = 0.5f;
+    pmx.m_Bones[6].bInherentTranslation = true;
+    pmx.m_Bones[6].ParentInherentBoneIndex = 2;
+    pmx.m_Bones[6].ParentInherentBoneCoefficent = 1.f;
+
+    ::Pmx::Morph morph;
+    morph.Type = ::Pmx::MorphType::kBone;
+    morph.BoneList.resize( 2 );
+    morph.BoneList[0].BoneIndex = 1;
+    morph.BoneList[1].BoneIndex = 6;
+    pmx.m_Morphs.push_back( morph );
+
+    auto& vs = pmx.m_VertexStream;
+    vs.Pos.assign( 1, DirectX::XMFLOAT3( 0.f, 0.f, 0.f ) );
+    vs.Normal.assign( 1, DirectX::XMFLOAT3( 0.f, 1.f, 0.f ) );
+    vs.UV.assign( 1, DirectX::XMFLOAT2( 0.f, 0.f ) );
+    vs.SkinningType.assign( 1, ::Pmx::Vertex::kBdef4 );
+    vs.BoneIndex.assign( 1, DirectX::XMINT4( 1, 3, 6, 7 ) );
+    vs.Weight.assign( 1, DirectX::XMFLOAT4( 0.25f, 0.25f, 0.25f, 0.25f ) );
+    vs.EdgeSize.assign( 1, 1.f );
+
+    ModelCache cache;
+    ASSERT_TRUE( cache.Bake( pmx, false, L"", std::make_shared<Utility::FileContainer>() ) );
+
+    uint32_t numBones = 0;
+    auto bones = cache.Get<BakedBone>( kSectionBone, numBones );
+    ASSERT_EQ( numBones, 8 );
+    EXPECT_EQ( bones[0].DestinationIndex, 1 );
+    for (uint32_t i = 0; i < numBones; i++)
+        EXPECT_LT( bones[i].Parent, int32_t(i) );
+
+    uint32_t numIKs = 0, numLinks = 0;
+    auto iks = cache.Get<BakedIK>( kSectionIK, numIKs );
+    auto links = cache.Get<IKChild>( kSectionIKLink, numLinks );
+    ASSERT_EQ( numIKs, 2 );
+    ASSERT_EQ( numLinks, 2 );
+    EXPECT_EQ( iks[0].BoneIndex, 2 );
+    EXPECT_EQ( iks[0].TargetBoneIndex, 5 );
+    EXPECT_EQ( links[iks[0].LinkOffset].BoneIndex, 0 );
+    EXPECT_TRUE( links[iks[0].LinkOffset].bLimit );
+    EXPECT_EQ( iks[1].BoneIndex, 1 );
+    EXPECT_EQ( iks[1].TargetBoneIndex, 3 );
+    EXPECT_EQ( links[iks[1].LinkOffset].BoneIndex, 2 );
+
+    uint32_t numInherents = 0;
+    auto inherents = cache.Get<InherentAttr>( kSectionInherent, numInherents );
+    ASSERT_EQ( numInherents, 2 );
+    EXPECT_EQ( inherents[0].BoneIndex, 3 );
+    EXPECT_EQ( inherents[0].Source, 5 );
+    EXPECT_EQ( inherents[0].Flags, uint32_t(InherentAttr::kRotation) );
+    EXPECT_EQ( inherents[1].BoneIndex, 7 );
+    EXPECT_EQ( inherents[1].Source, 3 );
+    EXPECT_EQ( inherents[1].Flags, uint32_t(InherentAttr::kTranslation) );
+
+    MorphTables morphs;
+    cache.GetMorphs( morphs );
+    ASSERT_EQ( morphs.Bones.size(), 2 );
+    EXPECT_EQ( morphs.Bones[0].Bone, 2 );
+    EXPECT_EQ( morphs.Bones[1].Bone, 7 );
+
+    uint32_t numVertices = 0;
+    auto attributes = cache.Get<VertexAttribute>( kSectionAttribute, numVertices );
+    ASSERT_EQ( numVertices, 1 );
+    const uint32_t boneID[4] = { 2, 1, 7, 4 };
+    for (int k = 0; k < 4; k++)
+        EXPECT_EQ( attributes[0].BoneID[k], boneID[k] );
+}
+
+TEST(PMXSkeletonTest, IKBatchMatchesUpdateIK)
+{
+    // Six models of one chain shape fill a block of 4 lanes and half of the next. The
+    // second starts on its target and leaves at once, the fifth is out of reach and
+    // runs every iteration; knees are limited on every other model
+    const Vector3 offsets[] = {
+        Vector3( 0.f, 2.f, -1.f ), Vector3( 0.f, 0.f, 0.f ), Vector3( 1.f, 1.f, 1.f ),
+        Vector3( 0.f, 5.f, 3.f ), Vector3( 0.f, -3.f, 0.f ), Vector3( -1.f, 3.f, -2.f ) };
+    const size_t numModels = _countof( offsets );
+
+    for (int parallel = 0; parallel < 2; parallel++)
+    {
+        std::vector<std::unique_ptr<Model>> serial, batched;
+        std::vector<Model*> models;
+        for (size_t i = 0; i < numModels; i++)
+        {
+            serial.emplace_back( new Model );
+            batched.emplace_back( new Model );
+            LoadSkeleton( MakeLeg( i % 2 == 0 ), *serial.back() );
+            LoadSkeleton( MakeLeg( i % 2 == 0 ), *batched.back() );
+            const OrthogonalTransform pose( Quaternion( kIdentity ), offsets[i] );
+            PlayPose( *serial.back(), { L"leg IK" }, { pose } );
+            PlayPose( *batched.back(), { L"leg IK" }, { pose } );
+            models.push_back( batched.back().get() );
+        }
+
+        for (auto& model : serial)
+            model->Update( 0.f );
+        IKBatch batch;
+        Model::UpdateBatch( models, 0.f, batch, parallel != 0 );
+        EXPECT_EQ( batch.GetGroupCount(), 1 );
+
+        for (size_t i = 0; i < numModels; i++)
+        {
+            SCOPED_TRACE( i );
+            ExpectSamePose( serial[i]->m_LocalPose, batched[i]->m_LocalPose, 1e-4f );
+            ExpectSamePose( serial[i]->m_Skinning, batched[i]->m_Skinning, 1e-3f );
+        }
+        // Already on the target, nothing rotated
+        const uint32_t knee = batched[1]->FindBone( L"knee" );
+        EXPECT_NEAR( float(batched[1]->m_LocalPose[knee].GetRotation().GetW()), 1.f, 1e-6f );
+    }
+}
+
+TEST(PMXSkeletonTest, ParallelSkeletonMatchesSerial)
+{
+    // Big enough for the bone tasks: a spine with branches off it and chains of
+    // inherent bones reading each other
+    const int numBones = 320;
+    ::Pmx::PMX pmx;
+    for (int i = 0; i < numBones; i++)
+    {
+        pmx.m_Bones.push_back( MakeBone( i == 0 ? -1 : i % 3 == 0 ? i / 2 : i - 1, 0 ) );
+        pmx.m_Bones[i].Name = L"bone" + std::to_wstring( i );
+        pmx.m_Bones[i].Position = DirectX::XMFLOAT3( float(i % 7), 0.1f * i, float(i % 3) );
+        if (i >= 20 && i % 10 == 0)
+        {
+            pmx.m_Bones[i].bInherentRotation = true;
+            pmx.m_Bones[i].ParentInherentBoneIndex = i - 10;
+            pmx.m_Bones[i].ParentInherentBoneCoefficent = 0.5f;
+        }
+        if (i >= 20 && i % 15 == 0)
+        {
+            pmx.m_Bones[i].bInherentTranslation = true;
+            pmx.m_Bones[i].ParentInherentBoneIndex = i - 15;
+            pmx.m_Bones[i].ParentInherentBoneCoefficent = 1.f;
+        }
+    }
+
+    std::vector<std::wstring> names;
+    std::vector<OrthogonalTransform> poses;
+    for (int i = 0; i < numBones; i += 4)
+    {
+        names.push_back( L"bone" + std::to_wstring( i ) );
+        poses.emplace_back( Quaternion( Normalize( Vector3( 1.f, float(i % 5), -1.f ) ), 0.01f * i ), Vector3( 0.f, 0.f, 0.1f * (i % 3) ) );
+    }
+
+    Model serial, parallel;
+    LoadSkeleton( pmx, serial );
+    LoadSkeleton( pmx, parallel );
+    PlayPose( serial, names, poses );
+    PlayPose( parallel, names, poses );
+
+    const bool bParallelSkeleton = s_bParallelSkeleton;
+    s_bParallelSkeleton = false;
+    serial.Update( 0.f );
+    s_bParallelSkeleton = true;
+    parallel.Update( 0.f );
+    s_bParallelSkeleton = bParallelSkeleton;
+
+    ASSERT_EQ( serial.m_Skinning.size(), numBones );
+    ASSERT_EQ( parallel.m_Skinning.size(), numBones );
+    EXPECT_EQ( memcmp( serial.m_Skinning.data(), parallel.m_Skinning.data(), sizeof( OrthogonalTransform ) * numBones ), 0 );
+    EXPECT_EQ( memcmp( serial.m_Pose.data(), parallel.m_Pose.data(), sizeof( OrthogonalTransform ) * numBones ), 0 );
+}
+
+TEST(PMXSkeletonTest, ChainIKMatchesFullPose)
+{
+    //   0 - 1 - 2 - 3 - 4    links 3 and 1 (3 under 1 through 2) reach 4 for the IK 5
+    //     - 5
+    //     - 6 - 7 - 8        links 7 and 6 turn toward 9 for the IK 10, 9 not under them
+    //     - 9
+    //     - 10
+    ::Pmx::PMX pmx;
+    const int32_t parents[] = { -1, 0, 1, 2, 3, 0, 0, 6, 7, 0, 0 };
+    const DirectX::XMFLOAT3 positions[] = {
+        { 0.f, 10.f, 0.f }, { 0.f, 9.f, 0.f }, { 0.f, 7.f, 0.3f }, { 0.f, 5.f, 0.f }, { 0.f, 2.f, 0.5f },
+        { 0.f, 2.f, 0.5f }, { 1.f, 9.f, 0.f }, { 1.f, 6.f, 0.f }, { 1.f, 3.f, 0.5f }, { 2.f, 4.f, 0.f },
+        { 2.f, 4.f, 0.f } };
+    for (int i = 0; i < _countof( parents ); i++)
+    {
+        pmx.m_Bones.push_back( MakeBone( parents[i], 0 ) );
+        pmx.m_Bones[i].Name = L"bone" + std::to_wstring( i );
+        pmx.m_Bones[i].Position = positions[i];
+    }
+    auto SetIK = [&pmx]( int32_t bone, int32_t target, int32_t link0, int32_t link1, int32_t numIteration ) {
+        auto& ik = pmx.m_Bones[bone];
+        ik.bIK = true;
+        ik.Ik.BoneIndex = target;
+        ik.Ik.NumIteration = numIteration;
+        ik.Ik.LimitedRadian = 0.4f;
+        ik.Ik.Link.resize( 2 );
+        ik.Ik.Link[0].BoneIndex = link0;
+        ik.Ik.Link[1].BoneIndex = link1;
+    };
+    SetIK( 5, 4, 3, 1, 15 );
+    SetIK( 10, 9, 7, 6, 10 );
+    auto& limited = pmx.m_Bones[5].Ik.Link[0];
+    limited.bLimit = true;
+    limited.MinLimit = DirectX::XMFLOAT3( -0.01f, 0.f, 0.f );
+    limited.MaxLimit = DirectX::XMFLOAT3( -3.1f, 0.f, 0.f );
+
+    const std::vector<std::wstring> names = { L"bone0", L"bone5", L"bone10" };
+    const std::vector<OrthogonalTransform> poses = {
+        OrthogonalTransform( Quaternion( Vector3( kYUnitVector ), 0.3f ) ),
+        OrthogonalTransform( Vector3( 0.5f, 2.f, 1.f ) ),
+        OrthogonalTransform( Vector3( -1.f, 1.f, 0.5f ) ) };
+
+    // 'chain' solves in Update, 'full' is posed without IK and solved here
+    Model chain, full;
+    LoadSkeleton( pmx, chain );
+    LoadSkeleton( pmx, full );
+    ASSERT_EQ( chain.m_IKs.size(), 2 );
+    PlayPose( chain, names, poses );
+    PlayPose( full, names, poses );
+    AnimationLod lod = AnimationLod::Full();
+    lod.bIK = false;
+    full.SetAnimationLod( lod );
+
+    chain.Update( 0.f );
+    full.Update( 0.f );
+    for (auto& ik : full.m_IKs)
+        SolveFullPose( full, ik );
+    for (uint32_t i = 0; i < full.m_Pose.size(); i++)
+    {
+        const int32_t parent = full.m_BoneParent[i];
+        full.m_Pose[i] = parent >= 0 ? full.m_Pose[parent] * full.m_LocalPose[i] : full.m_LocalPose[i];
+    }
+
+    ExpectSamePose( chain.m_LocalPose, full.m_LocalPose, 1e-4f );
+    ExpectSamePose( chain.m_Pose, full.m_Pose, 1e-3f );
+}